@@ -13,7 +13,13 @@ out vec4 fragColor;
 
 // shader's global variables, called the uniform variables
 uniform bool b_solid_color;
-uniform vec4 solid_color;
+
+// per-circle data from the ring buffer (must match circ.vert)
+layout(std140, row_major) uniform object_block
+{
+	mat4x3	model_matrix;
+	vec4	solid_color;
+};
 
 void main()
 {
@@ -8,13 +8,19 @@ layout(location=2) in vec2 texcoord;
 out vec3 norm;	// the second output: not used yet
 out vec2 tc;	// the third output: not used yet
 
+// per-circle data from the ring buffer (must match circ.frag)
+layout(std140, row_major) uniform object_block
+{
+	mat4x3	model_matrix;	// affine 4x4 transformation matrix without its last row (0,0,0,1)
+	vec4	solid_color;
+};
+
 // uniform variables
-uniform mat4	model_matrix;	// 4x4 transformation matrix: explained later in the lecture
 uniform mat4	aspect_matrix;	// tricky 4x4 aspect-correction matrix
 
 void main()
 {
-	gl_Position = aspect_matrix*model_matrix*vec4(position,1);
+	gl_Position = aspect_matrix*vec4(model_matrix*vec4(position,1),1);
 
 	// other outputs to rasterizer/fragment shader
 	norm = normal;
@@ -0,0 +1,208 @@
+#pragma once
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include <chrono>
+#include <string>
+#if defined(__linux__)
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
+//*************************************
+// headless offscreen rendering for benchmarks and image diffs
+// - Linux: EGL on a surfaceless Mesa display (works with llvmpipe, no X server needed)
+// - elsewhere: a hidden GLFW window
+// - rendering goes to an FBO; chosen frames are written as .ppm or .png
+// usage: --headless [--frames N] [--dump k[,k...]] [--out prefix] [--format ppm|png] [--size WxH] [--dt sec]
+struct headless_t
+{
+	bool				enabled = false;
+	int					frames = 300;			// number of frames to render
+	std::vector<int>	dump_frames;			// frame indices to write to disk
+	std::string			out_prefix = "frame";	// output path prefix
+	std::string			format = "ppm";			// ppm or png
+	double				dt = 1.0 / 60.0;		// fixed simulation step for reproducible images
+	ivec2				size = ivec2(1280, 720);
+
+	GLuint				fbo = 0, color_buffer = 0, depth_buffer = 0;
+	GLFWwindow*			hidden_window = nullptr;
+#if defined(__linux__)
+	EGLDisplay			display = EGL_NO_DISPLAY;
+	EGLContext			context = EGL_NO_CONTEXT;
+#endif
+	std::chrono::steady_clock::time_point t0;
+
+	bool	parse(int argc, char* argv[]);
+	bool	create();					// context + extensions + framebuffer
+	void	destroy();
+	double	time(int frame) const { return frame * dt; }
+	void	begin();					// starts the benchmark clock
+	void	end_frame(int frame);		// writes the frame if requested
+	void	report(int frame_count) const;
+	bool	write_image(const char* path) const;
+};
+
+inline bool headless_t::parse(int argc, char* argv[])
+{
+	for (int k = 1; k < argc; k++)
+	{
+		std::string a = argv[k];
+		bool has_value = k + 1 < argc;
+		if (a == "--headless") enabled = true;
+		else if (a == "--frames" && has_value) frames = std::max(1, atoi(argv[++k]));
+		else if (a == "--out" && has_value) out_prefix = argv[++k];
+		else if (a == "--format" && has_value) format = argv[++k];
+		else if (a == "--dt" && has_value) dt = atof(argv[++k]);
+		else if (a == "--size" && has_value) { int w, h; if (sscanf(argv[++k], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) size = ivec2(w, h); }
+		else if (a == "--dump" && has_value)
+		{
+			for (char* s = argv[++k]; *s; )
+			{
+				dump_frames.push_back(int(strtol(s, &s, 10)));
+				if (*s == ',') s++; else break;
+			}
+		}
+	}
+	if (format != "ppm" && format != "png") { printf("%s(): unknown format %s; using ppm\n", __func__, format.c_str()); format = "ppm"; }
+	return enabled;
+}
+
+inline bool headless_t::create()
+{
+	bool b_context = false;
+#if defined(__linux__)
+	auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display) display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor) && eglBindAPI(EGL_OPENGL_API))
+	{
+		// the highest core profile first; the GPU-driven paths need 4.3+
+		static const int versions[][2] = { {4,6}, {4,5}, {4,3}, {4,1}, {3,3} };
+		for (auto& v : versions)
+		{
+			EGLint attribs[] = { EGL_CONTEXT_MAJOR_VERSION, v[0], EGL_CONTEXT_MINOR_VERSION, v[1], EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+			context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+			if (context != EGL_NO_CONTEXT) break;
+		}
+		b_context = context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+		if (b_context && !gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) { printf("%s(): failed to load GL functions\n", __func__); return false; }
+	}
+	if (!b_context) printf("%s(): EGL is unavailable; falling back to a hidden window\n", __func__);
+#endif
+	if (!b_context)
+	{
+		if (!glfwInit()) { printf("%s(): failed in glfwInit()\n", __func__); return false; }
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		if (!(hidden_window = glfwCreateWindow(size.x, size.y, "headless", nullptr, nullptr))) { printf("%s(): failed to create a hidden window\n", __func__); return false; }
+		glfwMakeContextCurrent(hidden_window);
+		if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) { printf("%s(): failed to load GL functions\n", __func__); return false; }
+	}
+	printf("> headless: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	// offscreen framebuffer replacing the default one
+	glGenRenderbuffers(1, &color_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+	glGenRenderbuffers(1, &depth_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { printf("%s(): incomplete framebuffer\n", __func__); return false; }
+	glViewport(0, 0, size.x, size.y);
+	return true;
+}
+
+inline void headless_t::destroy()
+{
+	if (fbo) { glDeleteFramebuffers(1, &fbo); fbo = 0; }
+	if (color_buffer) { glDeleteRenderbuffers(1, &color_buffer); color_buffer = 0; }
+	if (depth_buffer) { glDeleteRenderbuffers(1, &depth_buffer); depth_buffer = 0; }
+#if defined(__linux__)
+	if (context != EGL_NO_CONTEXT) { eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT); eglDestroyContext(display, context); context = EGL_NO_CONTEXT; }
+	if (display != EGL_NO_DISPLAY) { eglTerminate(display); display = EGL_NO_DISPLAY; }
+#endif
+	if (hidden_window) { glfwDestroyWindow(hidden_window); glfwTerminate(); hidden_window = nullptr; }
+}
+
+inline void headless_t::begin()
+{
+	glFinish();
+	t0 = std::chrono::steady_clock::now();
+}
+
+inline void headless_t::end_frame(int frame)
+{
+	if (std::find(dump_frames.begin(), dump_frames.end(), frame) == dump_frames.end()) return;
+	char path[1024]; snprintf(path, sizeof(path), "%s%04d.%s", out_prefix.c_str(), frame, format.c_str());
+	if (write_image(path)) printf("> wrote %s\n", path);
+}
+
+inline void headless_t::report(int frame_count) const
+{
+	glFinish();
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	printf("[headless] %d frames at %dx%d in %.3f s: %.2f fps (%.3f ms/frame)\n", frame_count, size.x, size.y, sec, frame_count / sec, 1000.0 * sec / frame_count);
+}
+
+inline bool headless_t::write_image(const char* path) const
+{
+	int w = size.x, h = size.y;
+	std::vector<unsigned char> pixels(size_t(w) * h * 3);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+	FILE* fp = fopen(path, "wb"); if (!fp) { printf("%s(): unable to open %s\n", __func__, path); return false; }
+	if (format == "ppm")
+	{
+		fprintf(fp, "P6\n%d %d\n255\n", w, h);
+		for (int y = h - 1; y >= 0; y--) fwrite(&pixels[size_t(y) * w * 3], 1, size_t(w) * 3, fp);	// GL rows are bottom-up
+	}
+	else
+	{
+		// minimal PNG: filter-less scanlines in stored (uncompressed) deflate blocks
+		auto crc = [](uint c, const unsigned char* p, size_t n) { c = ~c; while (n--) { c ^= *p++; for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1))); } return ~c; };
+		auto be32 = [](unsigned char* p, uint v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; };
+		auto chunk = [&](const char* type, const std::vector<unsigned char>& data)
+		{
+			unsigned char len[4], tag[4] = { (unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3] }, c[4];
+			be32(len, uint(data.size())); fwrite(len, 1, 4, fp); fwrite(tag, 1, 4, fp);
+			if (!data.empty()) fwrite(data.data(), 1, data.size(), fp);
+			be32(c, crc(crc(0, tag, 4), data.data(), data.size())); fwrite(c, 1, 4, fp);
+		};
+
+		std::vector<unsigned char> raw; raw.reserve((size_t(w) * 3 + 1) * h);
+		for (int y = h - 1; y >= 0; y--) { raw.push_back(0); raw.insert(raw.end(), &pixels[size_t(y) * w * 3], &pixels[size_t(y) * w * 3] + size_t(w) * 3); }
+
+		std::vector<unsigned char> z = { 0x78, 0x01 };
+		uint a = 1, b = 0;
+		for (size_t k = 0; k < raw.size(); k += 65535)
+		{
+			size_t n = std::min(size_t(65535), raw.size() - k);
+			z.push_back(k + n == raw.size() ? 1 : 0);
+			z.push_back((unsigned char)(n)); z.push_back((unsigned char)(n >> 8)); z.push_back((unsigned char)(~n)); z.push_back((unsigned char)(~n >> 8));
+			z.insert(z.end(), raw.begin() + k, raw.begin() + k + n);
+		}
+		for (unsigned char v : raw) { a = (a + v) % 65521; b = (b + a) % 65521; }
+		unsigned char adler[4]; be32(adler, (b << 16) | a); z.insert(z.end(), adler, adler + 4);
+
+		std::vector<unsigned char> ihdr(13); be32(&ihdr[0], w); be32(&ihdr[4], h); ihdr[8] = 8; ihdr[9] = 2;	// 8-bit RGB
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		fwrite(signature, 1, 8, fp);
+		chunk("IHDR", ihdr); chunk("IDAT", z); chunk("IEND", {});
+	}
+	fclose(fp);
+	return true;
+}
+
+#endif // __HEADLESS_H__
@@ -1,6 +1,12 @@
 #include "cgmath.h"		// slee's simple math library
 #include "cgut.h"		// slee's OpenGL utility
+#include "simd_math.h"	// SSE/AVX mat4 products
 #include "circle.h"		// circle class definition
+#include "ringbuffer.h"	// per-frame dynamic data
+#include "profiler.h"	// CPU/GPU frame profiler
+#include "frame_pacer.h"	// frame scheduler
+#include "program_cache.h"	// program binaries cached on disk
+#include "headless.h"		// --headless: offscreen benchmark
 
 //*************************************
 // global constants
@@ -8,20 +14,33 @@ static const char*	window_name = "Moving Circles";
 static const char*	vert_shader_path = "shaders/circ.vert";
 static const char*	frag_shader_path = "shaders/circ.frag";
 uint				NUM_TESS = 72;		// initial tessellation factor of the circle as a polygon
-static double		FPS = 1.0 / 60.0;
+static double		FPS = 1.0 / 60.0;	// default frame period (target-fps pacing)
+//*************************************
+// per-object data in the std140 layout of object_block in the shaders
+struct object_t
+{
+	affine3x4	model_matrix;	// row_major mat4x3 in the shaders
+	vec4	solid_color;
+};
+
 //*************************************
 // window objects
 GLFWwindow*	window = nullptr;
 ivec2		window_size = cg_default_window_size(); // initial window size
+headless_t	headless;	// --headless: offscreen rendering without a window
 
 //*************************************
 // OpenGL objects
 GLuint	program = 0;		// ID holder for GPU program
+program_cache_t	program_cache;	// skips shader compilation on later runs
 GLuint	vertex_array = 0;	// ID holder for vertex array object
+ringbuffer_t	object_ring;	// per-object uniform blocks of the current frame
 
 //*************************************
 // global variables
 int		frame = 0;						// index of rendering frames
+profiler_t	profiler;					// F12 or exit dumps profile.json
+frame_pacer_t	pacer;					// 'v' cycles the frame pacing mode
 float	t = 0.0f;						// current simulation parameter
 bool	b_solid_color = true;			// use circle's color?
 bool	b_index_buffer = true;			// use index buffering?
@@ -40,8 +59,10 @@ std::vector<vertex>	unit_circle_vertices;	// host-side vertices
 //*************************************
 void update()
 {
+	profile_scope_t scope( profiler, "update" );
+
 	// update global simulation parameter
-	t = float(glfwGetTime());
+	t = float(headless.enabled ? headless.time(frame + 1) : glfwGetTime());	// headless: the first step is one dt after the start, as with the clock
 
 	// tricky aspect correction matrix for non-square window
 	float aspect = window_size.x/float(window_size.y);
@@ -65,35 +86,52 @@ void update()
 
 void render()
 {
+	profile_scope_t scope( profiler, "render" );
+
 	// clear screen (with background color) and clear depth buffer
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
 	// notify GL that we use our own program
 	glUseProgram( program );
 
+	// per-circle update: write all per-circle uniforms in one linear pass
+	{ profile_scope_t wait_scope( profiler, "fence wait", true ); object_ring.begin_frame(); }
+	std::vector<GLintptr> offsets( circles.size() );
+	{
+		profile_scope_t physics_scope( profiler, "physics" );
+		for( size_t k=0; k < circles.size(); k++ )
+		{
+			circle_t& c = circles[k];
+			c.update(circles, circleCount, t);
+
+			offsets[k] = object_ring.alloc( sizeof(object_t) );
+			if( offsets[k] < 0 ) continue;	// the ring is full: not drawn in this frame
+			object_t* o = (object_t*) object_ring.data( offsets[k] );
+			o->model_matrix = c.model_matrix;
+			o->solid_color = c.color;
+		}
+	}
+	object_ring.flush();
+
 	// bind vertex array object
 	glBindVertexArray( vertex_array );
 
-	// render two circles: trigger shader program to process vertex data
-	for( auto& c : circles )
+	// render circles: trigger shader program to process vertex data
+	profiler.begin_gpu( "circles" );
+	for( size_t k=0; k < circles.size(); k++ )
 	{
-		// per-circle update
-		c.update(circles, circleCount, t);
-
-		// update per-circle uniforms
-		GLint uloc;
-		uloc = glGetUniformLocation( program, "solid_color" );		
-		if(uloc>-1) glUniform4fv( uloc, 1, c.color );	// pointer version
-		uloc = glGetUniformLocation( program, "model_matrix" );		
-		if(uloc>-1) glUniformMatrix4fv( uloc, 1, GL_TRUE, c.model_matrix );
-
-		// per-circle draw calls
+		// per-circle uniforms and draw calls
+		if( offsets[k] < 0 ) continue;
+		object_ring.bind_range( 0, offsets[k], sizeof(object_t) );
 		if(b_index_buffer)	glDrawElements( GL_TRIANGLES, NUM_TESS*3, GL_UNSIGNED_INT, nullptr );
 		else				glDrawArrays( GL_TRIANGLES, 0, NUM_TESS*3 ); // NUM_TESS = N
 	}
+	profiler.end_gpu();
+	object_ring.end_frame();
 
 	// swap front and back buffers, and display to screen
-	glfwSwapBuffers( window );
+	profile_scope_t swap_scope( profiler, "swap", true );
+	if(!headless.enabled) glfwSwapBuffers( window );
 }
 
 void reshape( GLFWwindow* window, int width, int height )
@@ -102,6 +140,7 @@ void reshape( GLFWwindow* window, int width, int height )
 	// viewport: the window area that are affected by rendering 
 	window_size = ivec2(width,height);
 	glViewport( 0, 0, width, height );
+	pacer.request_redraw();
 }
 
 void print_help()
@@ -109,6 +148,8 @@ void print_help()
 	printf( "[help]\n" );
 	printf( "- press ESC or 'q' to terminate the program\n" );
 	printf( "- press F1 or 'h' to see help\n" );
+	printf( "- press F12 to dump the profile (profile.json)\n" );
+	printf( "- press 'v' to cycle frame pacing (vsync/adaptive/target fps/unlimited)\n" );
 	printf( "- press '+/-' to increase/decrease the number of circles (min=20, max=512)\n" );
 #ifndef GL_ES_VERSION_2_0
 	printf( "- press 'w' to toggle wireframe\n" );
@@ -185,10 +226,13 @@ void update_vertex_buffer( const std::vector<vertex>& vertices, uint N )
 
 void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 {
+	pacer.request_redraw();
 	if (action == GLFW_PRESS)
 	{
 		if (key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q)	glfwSetWindowShouldClose(window, GL_TRUE);
 		else if (key == GLFW_KEY_H || key == GLFW_KEY_F1)	print_help();
+		else if (key == GLFW_KEY_F12)	profiler.dump();
+		else if (key == GLFW_KEY_V)		pacer.next_mode();
 		else if (key == GLFW_KEY_KP_ADD || (key == GLFW_KEY_EQUAL && (mods & GLFW_MOD_SHIFT)))
 		{
 			if (circleCount < 512) circles = std::move(create_circles(rand(), ++circleCount));
@@ -248,6 +292,11 @@ bool user_init()
 	glEnable( GL_CULL_FACE );								// turn on backface culling
 	glEnable( GL_DEPTH_TEST );								// turn on depth tests
 	
+	// per-circle uniform block; sized for the maximum number of circles
+	GLuint block_index = glGetUniformBlockIndex( program, "object_block" );
+	if(block_index!=GL_INVALID_INDEX) glUniformBlockBinding( program, block_index, 0 );
+	if(!object_ring.create( sizeof(object_t), 512 )) return false;
+
 	// define the position of four corner vertices
 	unit_circle_vertices = std::move(create_circle_vertices( NUM_TESS ));
 
@@ -259,16 +308,47 @@ bool user_init()
 
 void user_finalize()
 {
+	profiler.dump();
+	program_cache.print_stats();
+	object_ring.print_stats();
+	object_ring.destroy();
 }
 
 int main( int argc, char* argv[] )
 {
+	// --math-bench: the SIMD transforms of simd_math.h against cgmath.h, without a window
+	for( int k=1; k < argc; k++ ) if(strcmp(argv[k], "--math-bench")==0) return simd_math_bench() ? 0 : 1;
+
+	// headless benchmark: offscreen context, fixed time steps, no event loop
+	if(headless.parse( argc, argv ))
+	{
+		window_size = headless.size;
+		if(!headless.create()){ headless.destroy(); return 1; }
+		if(!(program=program_cache.create_program( vert_shader_path, frag_shader_path ))){ headless.destroy(); return 1; }
+		if(!user_init()){ printf( "Failed to user_init()\n" ); headless.destroy(); return 1; }
+
+		headless.begin();
+		for( frame=0; frame < headless.frames; frame++ )
+		{
+			profiler.begin_frame();
+			update();
+			render();
+			headless.end_frame( frame );
+			profiler.end_frame();
+		}
+		headless.report( headless.frames );
+
+		user_finalize();
+		headless.destroy();
+		return 0;
+	}
+
 	// create window and initialize OpenGL extensions
 	if(!(window = cg_create_window( window_name, window_size.x, window_size.y ))){ glfwTerminate(); return 1; }
 	if(!cg_init_extensions( window )){ glfwTerminate(); return 1; }	// init OpenGL extensions
 
 	// initializations and validations of GLSL program
-	if(!(program=cg_create_program( vert_shader_path, frag_shader_path ))){ glfwTerminate(); return 1; }	// create and compile shaders/program
+	if(!(program=program_cache.create_program( vert_shader_path, frag_shader_path ))){ glfwTerminate(); return 1; }	// create and compile shaders/program
 	if(!user_init()){ printf( "Failed to user_init()\n" ); glfwTerminate(); return 1; }					// user initialization
 
 	// register event callbacks
@@ -277,15 +357,27 @@ int main( int argc, char* argv[] )
 	glfwSetMouseButtonCallback( window, mouse );	// callback for mouse click inputs
 	glfwSetCursorPosCallback( window, motion );		// callback for mouse movements
 
+	// the circles move every frame; paced at FPS unless overridden
+	pacer.mode = frame_pacer_t::TARGET_FPS;
+	pacer.target_fps = 1.0 / FPS;
+	// frame pacing: --vsync, --adaptive, --unlimited or --fps N
+	pacer.parse( argc, argv );
+	pacer.set_mode( pacer.mode );
+
 	// enters rendering/event loop
 	for( frame=0; !glfwWindowShouldClose(window); frame++ )
 	{
 		glfwPollEvents();	// polling and processing of events
+		pacer.begin_frame( true );	// the circles always move; never idles
+		profiler.begin_frame();
 		update();			// per-frame update
 		render();			// per-frame render
+		profiler.end_frame();
+		pacer.end_frame();	// sleeps until the next deadline in the target-fps mode
 	}
 	
 	// normal termination
+	pacer.print_stats();
 	user_finalize();
 	cg_destroy_window(window);
 
@@ -0,0 +1,140 @@
+#pragma once
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include <chrono>
+#include <initializer_list>
+#include <utility>
+
+//*************************************
+// triple-buffered ring buffer for per-frame dynamic data
+// - GL 4.4+: persistently/coherently mapped storage; the CPU writes straight into the GPU buffer
+// - older GL: a host-side shadow copy is uploaded once per frame by flush()
+// - one fence per section keeps the CPU from overwriting data that the GPU still reads
+// - a section holds the worst case of a frame, given to create() as (block size, count) pairs; alloc() returns -1
+//   once it is full, and the caller skips what it would have drawn from the block (counted as overflows)
+struct ringbuffer_t
+{
+	static const int NUM_SECTIONS = 3;	// frames in flight
+
+	GLuint		buffer = 0;				// ID holder for the buffer object
+	GLenum		target = GL_UNIFORM_BUFFER;
+	GLsizeiptr	section_size = 0;		// bytes reserved for a single frame
+	GLint		alignment = 256;		// offset alignment of a bound range
+	char*		ptr = nullptr;			// persistently mapped pointer (nullptr in the fallback path)
+	std::vector<char> shadow;			// host-side copy for the fallback path
+	GLsync		fence[NUM_SECTIONS] = { nullptr };
+	int			section = 0;			// section being written in this frame
+	GLsizeiptr	head = 0;				// write offset inside the current section
+
+	// fence statistics: many long waits = CPU waits on GPU; no waits = GPU waits on CPU
+	uint		frame_count = 0;
+	uint		wait_count = 0;
+	uint		overflow_count = 0;		// allocations refused because the section was full
+	double		wait_ms = 0.0, max_wait_ms = 0.0;
+
+	bool		create(GLsizeiptr block_size, uint max_blocks, GLenum buffer_target = GL_UNIFORM_BUFFER) { return create({ { block_size, max_blocks } }, buffer_target); }
+	bool		create(std::initializer_list<std::pair<GLsizeiptr, uint>> blocks, GLenum buffer_target = GL_UNIFORM_BUFFER);	// (size, count) of the allocations of a frame
+	void		destroy();
+	void		begin_frame();
+	GLintptr	alloc(GLsizeiptr size);					// returns an absolute offset, or -1 when full; the caller skips its draw then
+	void*		data(GLintptr offset) { return (ptr ? ptr : shadow.data()) + offset; }
+	void		flush();								// uploads the written range in the fallback path
+	void		end_frame();
+	void		bind_range(GLuint binding, GLintptr offset, GLsizeiptr size) const { glBindBufferRange(target, binding, buffer, offset, size); }
+	bool		is_persistent() const { return ptr != nullptr; }
+	void		print_stats() const;
+};
+
+inline bool ringbuffer_t::create(std::initializer_list<std::pair<GLsizeiptr, uint>> blocks, GLenum buffer_target)
+{
+	target = buffer_target;
+	if (target == GL_UNIFORM_BUFFER) glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	else if (target == GL_SHADER_STORAGE_BUFFER) glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment < 1) alignment = 256;
+	section_size = 0;
+	for (const auto& b : blocks) section_size += (b.first + alignment - 1) / alignment * alignment * b.second;
+
+	GLsizeiptr total = section_size * NUM_SECTIONS;
+	glGenBuffers(1, &buffer); if (!buffer) { printf("%s(): failed in glGenBuffers()\n", __func__); return false; }
+	glBindBuffer(target, buffer);
+	if (GLAD_GL_VERSION_4_4 && glBufferStorage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, total, nullptr, flags);
+		ptr = (char*) glMapBufferRange(target, 0, total, flags);
+	}
+	if (!ptr)
+	{
+		glBufferData(target, total, nullptr, GL_STREAM_DRAW);
+		shadow.resize(total);
+	}
+	glBindBuffer(target, 0);
+	return true;
+}
+
+inline void ringbuffer_t::destroy()
+{
+	for (auto& f : fence) { if (f) glDeleteSync(f); f = nullptr; }
+	if (ptr) { glBindBuffer(target, buffer); glUnmapBuffer(target); glBindBuffer(target, 0); ptr = nullptr; }
+	if (buffer) { glDeleteBuffers(1, &buffer); buffer = 0; }
+}
+
+inline void ringbuffer_t::begin_frame()
+{
+	head = 0;
+	frame_count++;
+
+	GLsync& f = fence[section];
+	if (!f) return;
+
+	// poll first; only a fence that is not signaled yet counts as a CPU stall
+	GLenum r = glClientWaitSync(f, 0, 0);
+	if (r == GL_TIMEOUT_EXPIRED)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		do r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+		while (r == GL_TIMEOUT_EXPIRED);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		wait_count++; wait_ms += ms; max_wait_ms = std::max(max_wait_ms, ms);
+	}
+	glDeleteSync(f); f = nullptr;
+}
+
+inline GLintptr ringbuffer_t::alloc(GLsizeiptr size)
+{
+	GLsizeiptr aligned = (size + alignment - 1) / alignment * alignment;
+	if (head + aligned > section_size)
+	{
+		if (!overflow_count++) printf("%s(): ring buffer section is full (%d bytes); the draws that do not fit are skipped\n", __func__, int(section_size));
+		return -1;
+	}
+	GLintptr offset = section * section_size + head;
+	head += aligned;
+	return offset;
+}
+
+inline void ringbuffer_t::flush()
+{
+	if (ptr || !head) return;
+	glBindBuffer(target, buffer);
+	glBufferSubData(target, section * section_size, head, shadow.data() + section * section_size);
+	glBindBuffer(target, 0);
+}
+
+inline void ringbuffer_t::end_frame()
+{
+	fence[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	section = (section + 1) % NUM_SECTIONS;
+}
+
+inline void ringbuffer_t::print_stats() const
+{
+	printf("[ringbuffer] %s, %d x %d bytes, %u frames\n", ptr ? "persistent mapping" : "glBufferSubData fallback", NUM_SECTIONS, int(section_size), frame_count);
+	printf("[ringbuffer] fence waits: %u (%.1f%% of frames), avg %.3f ms, max %.3f ms\n", wait_count, frame_count ? 100.0 * wait_count / frame_count : 0.0, wait_count ? wait_ms / wait_count : 0.0, max_wait_ms);
+	if (overflow_count) printf("[ringbuffer] %u allocations did not fit in a section; their draws were skipped\n", overflow_count);
+	printf("[ringbuffer] %s\n", wait_count * 10 > frame_count ? "CPU is waiting on the GPU (GPU-bound)" : "GPU is waiting on the CPU (CPU-bound)");
+}
+
+#endif // __RINGBUFFER_H__
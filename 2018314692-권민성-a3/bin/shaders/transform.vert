@@ -3,8 +3,13 @@ layout(location=0) in vec3 position;
 layout(location=1) in vec3 normal;
 layout(location=2) in vec2 texcoord;
 
+// per-object data from the ring buffer
+layout(std140, row_major) uniform object_block
+{
+	mat4x3	model_matrix;	// affine: the rows of the model matrix but the last (0,0,0,1)
+};
+
 // matrices
-uniform mat4 model_matrix;
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
 
@@ -15,7 +20,7 @@ out vec2 tc;
 void main()
 {
 	// transform the vertex position by model matrix
-	vec4 wpos = model_matrix *vec4(position, 1.0);
+	vec4 wpos = vec4(model_matrix*vec4(position, 1.0), 1.0);
 	// transform the position to the eye-space position
 	vec4 epos = view_matrix * wpos;
 	// project the eye-space position to the canonical view volume
@@ -0,0 +1,336 @@
+#pragma once
+#ifndef __CATALOG_H__
+#define __CATALOG_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+//*************************************
+// body catalog: a text source compiled once to a binary form that is mapped into memory
+//
+// text (*.txt), one record per line; '#' starts a comment
+//   body <name> <parent|-> <radius> <distance> <rotate> <revolve> [texture=<file>] [normal=<file>] [unlit] [occluder]
+//   ring <body> <scale> <texture> <alpha>
+//   belt <name> <count> <inner> <outer> <inclination> <size_min> <size_max> <revolve> <seed> [texture=<file>]
+//   emitters <body> <count> <altitude> <range> <r> <g> <b> <seed>
+// a parent must be listed before its children; "-" as a name leaves a body anonymous (e.g., asteroids)
+//
+// binary (*.bin, written next to the text): header_t, body_t[body_count], ring_t[ring_count], belt_t[belt_count], emitter_t[emitter_count], string table
+// - the text is parsed line by line and body records are written out as they are read,
+//   so memory does not grow with the number of bodies (except for the names used as parents)
+// - the records are used in place from the mapping; strings are offsets into the table (0 = none)
+// - load() checks the layout and every index and string offset before the records are used, so a corrupt file is rejected
+struct catalog_t
+{
+	enum { UNLIT = 1, OCCLUDER = 2 };
+
+	struct header_t
+	{
+		char		magic[4] = { 'B', 'C', 'A', 'T' };
+		uint		version = 3;
+		uint		body_count = 0, ring_count = 0, belt_count = 0, emitter_count = 0;
+		uint64_t	body_offset = 0, ring_offset = 0, belt_offset = 0, emitter_offset = 0, string_offset = 0, string_size = 0;
+	};
+
+	struct body_t
+	{
+		float	radius, distance, rotate, revolve;
+		int		parent;					// index of an earlier body, or -1
+		uint	name, texture, normal;	// string offsets
+		uint	flags;
+	};
+
+	struct ring_t
+	{
+		uint	body;
+		float	scale;
+		uint	texture, alpha;			// string offsets
+	};
+
+	// asteroids around the origin, generated from the seed instead of being listed one by one
+	struct belt_t
+	{
+		uint	name;					// string offset
+		uint	count;
+		float	inner, outer;			// range of orbit radii
+		float	inclination;			// max. orbit inclination in radians (degrees in the text)
+		float	size_min, size_max;
+		float	revolve;				// revolution speed at the inner radius; outer orbits follow Kepler's third law
+		uint	seed;
+		uint	texture;				// string offset
+	};
+
+	// small point lights around a body (e.g., city lights, probes), generated from the seed like the belts
+	struct emitter_t
+	{
+		uint	body;
+		uint	count;
+		float	altitude;				// distance from the body's center, in body radii
+		float	range;					// reach of each light, in body radii
+		float	color[3];
+		uint	seed;
+	};
+
+	const body_t*	bodies = nullptr;
+	const ring_t*	rings = nullptr;
+	const belt_t*	belts = nullptr;
+	const emitter_t* emitters = nullptr;
+	const char*		strings = nullptr;
+	uint			body_count = 0, ring_count = 0, belt_count = 0, emitter_count = 0;
+
+	// mapping of the binary file
+	const char*		data = nullptr;
+	size_t			size = 0;
+	std::vector<char> buffer;			// used instead of a mapping on Windows
+
+	bool		load(const char* text_path);	// compiles when the binary is missing or older, then maps it
+	void		close();
+	const char*	str(uint offset) const { return strings + offset; }
+
+	static bool	compile(const char* text_path, const char* binary_path);
+	static bool	is_newer(const char* a, const char* b);	// true when a is newer than b, or b is missing
+	static bool	is_current(const char* binary_path);		// written by this version of the compiler
+};
+
+inline bool catalog_t::is_current(const char* binary_path)
+{
+	FILE* fp = fopen(binary_path, "rb"); if (!fp) return false;
+	header_t h, expected;
+	bool b = fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, expected.magic, 4) == 0 && h.version == expected.version;
+	fclose(fp);
+	return b;
+}
+
+inline bool catalog_t::is_newer(const char* a, const char* b)
+{
+	struct stat sa, sb;
+	if (stat(b, &sb) != 0) return true;
+	if (stat(a, &sa) != 0) return false;
+#if defined(__linux__)
+	if (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec) return sa.st_mtim.tv_sec > sb.st_mtim.tv_sec;
+	return sa.st_mtim.tv_nsec >= sb.st_mtim.tv_nsec;
+#else
+	return sa.st_mtime >= sb.st_mtime;	// whole seconds only: an edit in the same second as the last compile must not be missed
+#endif
+}
+
+inline bool catalog_t::compile(const char* text_path, const char* binary_path)
+{
+	FILE* in = fopen(text_path, "rb"); if (!in) { printf("%s(): unable to open %s\n", __func__, text_path); return false; }
+	std::string tmp = std::string(binary_path) + ".tmp";
+	FILE* out = fopen(tmp.c_str(), "wb"); if (!out) { printf("%s(): unable to write %s\n", __func__, tmp.c_str()); fclose(in); return false; }
+
+	header_t h;
+	fwrite(&h, sizeof(h), 1, out);	// rewritten at the end
+
+	std::string strings(1, '\0');	// offset 0 is the empty string
+	std::unordered_map<std::string, uint> string_ids;
+	std::unordered_map<std::string, int> body_ids;
+	std::vector<ring_t> rings;
+	std::vector<belt_t> belts;
+	std::vector<emitter_t> emitters;
+	auto intern = [&](const char* s) -> uint
+	{
+		if (!s || !*s || (s[0] == '-' && !s[1])) return 0;
+		auto it = string_ids.find(s); if (it != string_ids.end()) return it->second;
+		uint offset = uint(strings.size());
+		strings.append(s).push_back('\0');
+		return string_ids[s] = offset;
+	};
+
+	char line[1024];
+	uint line_no = 0;
+	bool b_ok = true;
+	while (b_ok && fgets(line, sizeof(line), in))
+	{
+		line_no++;
+		size_t len = strlen(line);
+		if (len == sizeof(line) - 1 && line[len - 1] != '\n' && !feof(in)) { printf("%s(): %s:%u: line too long\n", __func__, text_path, line_no); b_ok = false; break; }
+		if (char* c = strchr(line, '#')) *c = '\0';
+
+		// split into whitespace-separated tokens in place
+		char* tok[16]; int n = 0;
+		for (char* p = line; *p && n < 16; )
+		{
+			while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') *p++ = '\0';
+			if (!*p) break;
+			tok[n++] = p;
+			while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+		}
+		if (n == 0) continue;
+
+		auto number = [&](const char* s, float& v) { char* end; v = strtof(s, &end); if (end == s || *end) { printf("compile(): %s:%u: invalid number '%s'\n", text_path, line_no, s); b_ok = false; } };
+		auto integer = [&](const char* s, uint& v) { char* end; v = uint(strtoul(s, &end, 10)); if (end == s || *end) { printf("compile(): %s:%u: invalid integer '%s'\n", text_path, line_no, s); b_ok = false; } };
+		if (strcmp(tok[0], "body") == 0 && n >= 7)
+		{
+			body_t b = {};
+			b.name = intern(tok[1]);
+			b.parent = -1;
+			if (strcmp(tok[2], "-") != 0)
+			{
+				auto it = body_ids.find(tok[2]);
+				if (it == body_ids.end()) { printf("%s(): %s:%u: unknown parent '%s'\n", __func__, text_path, line_no, tok[2]); b_ok = false; break; }
+				b.parent = it->second;
+			}
+			number(tok[3], b.radius); number(tok[4], b.distance); number(tok[5], b.rotate); number(tok[6], b.revolve);
+			for (int k = 7; k < n; k++)
+			{
+				if (strncmp(tok[k], "texture=", 8) == 0) b.texture = intern(tok[k] + 8);
+				else if (strncmp(tok[k], "normal=", 7) == 0) b.normal = intern(tok[k] + 7);
+				else if (strcmp(tok[k], "unlit") == 0) b.flags |= UNLIT;
+				else if (strcmp(tok[k], "occluder") == 0) b.flags |= OCCLUDER;
+				else { printf("%s(): %s:%u: unknown option '%s'\n", __func__, text_path, line_no, tok[k]); b_ok = false; }
+			}
+			if (!b_ok) break;
+			if (b.name) body_ids[tok[1]] = int(h.body_count);
+			fwrite(&b, sizeof(b), 1, out);
+			h.body_count++;
+		}
+		else if (strcmp(tok[0], "ring") == 0 && n == 5)
+		{
+			auto it = body_ids.find(tok[1]);
+			if (it == body_ids.end()) { printf("%s(): %s:%u: unknown body '%s'\n", __func__, text_path, line_no, tok[1]); b_ok = false; break; }
+			ring_t r = { uint(it->second), 0.0f, intern(tok[3]), intern(tok[4]) };
+			number(tok[2], r.scale);
+			rings.push_back(r);
+		}
+		else if (strcmp(tok[0], "belt") == 0 && (n == 10 || n == 11))
+		{
+			belt_t b = {};
+			b.name = intern(tok[1]);
+			integer(tok[2], b.count); number(tok[3], b.inner); number(tok[4], b.outer); number(tok[5], b.inclination);
+			number(tok[6], b.size_min); number(tok[7], b.size_max); number(tok[8], b.revolve); integer(tok[9], b.seed);
+			b.inclination *= PI / 180.0f;
+			if (n == 11)
+			{
+				if (strncmp(tok[10], "texture=", 8) == 0) b.texture = intern(tok[10] + 8);
+				else { printf("%s(): %s:%u: unknown option '%s'\n", __func__, text_path, line_no, tok[10]); b_ok = false; }
+			}
+			belts.push_back(b);
+		}
+		else if (strcmp(tok[0], "emitters") == 0 && n == 9)
+		{
+			auto it = body_ids.find(tok[1]);
+			if (it == body_ids.end()) { printf("%s(): %s:%u: unknown body '%s'\n", __func__, text_path, line_no, tok[1]); b_ok = false; break; }
+			emitter_t e = {};
+			e.body = uint(it->second);
+			integer(tok[2], e.count); number(tok[3], e.altitude); number(tok[4], e.range);
+			for (int k = 0; k < 3; k++) number(tok[5 + k], e.color[k]);
+			integer(tok[8], e.seed);
+			emitters.push_back(e);
+		}
+		else { printf("%s(): %s:%u: invalid record '%s'\n", __func__, text_path, line_no, tok[0]); b_ok = false; }
+	}
+	fclose(in);
+
+	if (b_ok)
+	{
+		h.ring_count = uint(rings.size());
+		h.belt_count = uint(belts.size());
+		h.emitter_count = uint(emitters.size());
+		h.body_offset = sizeof(header_t);
+		h.ring_offset = h.body_offset + uint64_t(h.body_count) * sizeof(body_t);
+		h.belt_offset = h.ring_offset + uint64_t(h.ring_count) * sizeof(ring_t);
+		h.emitter_offset = h.belt_offset + uint64_t(h.belt_count) * sizeof(belt_t);
+		h.string_offset = h.emitter_offset + uint64_t(h.emitter_count) * sizeof(emitter_t);
+		h.string_size = strings.size();
+		if (!rings.empty()) fwrite(rings.data(), sizeof(ring_t), rings.size(), out);
+		if (!belts.empty()) fwrite(belts.data(), sizeof(belt_t), belts.size(), out);
+		if (!emitters.empty()) fwrite(emitters.data(), sizeof(emitter_t), emitters.size(), out);
+		fwrite(strings.data(), 1, strings.size(), out);
+		fseek(out, 0, SEEK_SET);
+		b_ok = fwrite(&h, sizeof(h), 1, out) == 1;
+	}
+	b_ok = fclose(out) == 0 && b_ok;
+
+	remove(binary_path);
+	if (!b_ok || rename(tmp.c_str(), binary_path) != 0) { remove(tmp.c_str()); return false; }
+	printf("> compiled %s: %u bodies, %u rings, %u belts, %u emitter sets\n", binary_path, h.body_count, h.ring_count, h.belt_count, h.emitter_count);
+	return true;
+}
+
+inline bool catalog_t::load(const char* text_path)
+{
+	close();
+	std::string binary_path = text_path;
+	size_t dot = binary_path.find_last_of('.');
+	binary_path = (dot == std::string::npos ? binary_path : binary_path.substr(0, dot)) + ".bin";
+	if ((is_newer(text_path, binary_path.c_str()) || !is_current(binary_path.c_str())) && !compile(text_path, binary_path.c_str())) return false;
+
+#if !defined(_WIN32)
+	int fd = open(binary_path.c_str(), O_RDONLY); if (fd < 0) { printf("%s(): unable to open %s\n", __func__, binary_path.c_str()); return false; }
+	struct stat s; fstat(fd, &s);
+	size = size_t(s.st_size);
+	void* p = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (p == MAP_FAILED) { printf("%s(): unable to map %s\n", __func__, binary_path.c_str()); size = 0; return false; }
+	data = (const char*) p;
+#else
+	FILE* fp = fopen(binary_path.c_str(), "rb"); if (!fp) { printf("%s(): unable to open %s\n", __func__, binary_path.c_str()); return false; }
+	fseek(fp, 0, SEEK_END); buffer.resize(size_t(ftell(fp))); fseek(fp, 0, SEEK_SET);
+	size = fread(buffer.data(), 1, buffer.size(), fp); fclose(fp);
+	data = buffer.data();
+#endif
+
+	// validate the layout before handing out pointers into the file
+	const header_t* h = (const header_t*) data;
+	header_t expected;
+	bool b_valid = size >= sizeof(header_t) && memcmp(h->magic, expected.magic, 4) == 0 && h->version == expected.version
+		&& h->body_offset + uint64_t(h->body_count) * sizeof(body_t) <= size
+		&& h->ring_offset + uint64_t(h->ring_count) * sizeof(ring_t) <= size
+		&& h->belt_offset + uint64_t(h->belt_count) * sizeof(belt_t) <= size
+		&& h->emitter_offset + uint64_t(h->emitter_count) * sizeof(emitter_t) <= size
+		&& h->string_size > 0 && h->string_offset + h->string_size <= size && data[h->string_offset + h->string_size - 1] == '\0';
+
+	// then the records: parents come first, references stay in range, and strings start inside the table
+	auto string_ok = [&](uint offset) { return offset < h->string_size; };
+	for (uint k = 0; b_valid && k < h->body_count; k++)
+	{
+		const body_t& b = ((const body_t*) (data + h->body_offset))[k];
+		b_valid = b.parent >= -1 && b.parent < int(k) && string_ok(b.name) && string_ok(b.texture) && string_ok(b.normal);
+	}
+	for (uint k = 0; b_valid && k < h->ring_count; k++)
+	{
+		const ring_t& r = ((const ring_t*) (data + h->ring_offset))[k];
+		b_valid = r.body < h->body_count && string_ok(r.texture) && string_ok(r.alpha);
+	}
+	for (uint k = 0; b_valid && k < h->belt_count; k++)
+	{
+		const belt_t& b = ((const belt_t*) (data + h->belt_offset))[k];
+		b_valid = string_ok(b.name) && string_ok(b.texture);
+	}
+	for (uint k = 0; b_valid && k < h->emitter_count; k++) b_valid = ((const emitter_t*) (data + h->emitter_offset))[k].body < h->body_count;
+	if (!b_valid) { printf("%s(): %s is invalid; delete it to rebuild\n", __func__, binary_path.c_str()); close(); return false; }
+
+	body_count = h->body_count;
+	ring_count = h->ring_count;
+	belt_count = h->belt_count;
+	emitter_count = h->emitter_count;
+	bodies = (const body_t*) (data + h->body_offset);
+	rings = (const ring_t*) (data + h->ring_offset);
+	belts = (const belt_t*) (data + h->belt_offset);
+	emitters = (const emitter_t*) (data + h->emitter_offset);
+	strings = data + h->string_offset;
+	return true;
+}
+
+inline void catalog_t::close()
+{
+#if !defined(_WIN32)
+	if (data) munmap((void*) data, size);
+#endif
+	buffer.clear();
+	data = strings = nullptr;
+	bodies = nullptr; rings = nullptr; belts = nullptr; emitters = nullptr;
+	body_count = ring_count = belt_count = emitter_count = 0; size = 0;
+}
+
+#endif // __CATALOG_H__
@@ -0,0 +1,127 @@
+#pragma once
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "affine.h"
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define FRUSTUM_SSE
+#endif
+
+//*************************************
+// bounding-sphere frustum culling in batches of 8
+// - spheres are kept as SoA arrays padded to a multiple of 8; the padding never passes
+// - each batch is tested against the six planes of projection*view with one AVX register
+//   (or two SSE registers, or a plain loop elsewhere) and yields an 8-bit visibility mask
+// usage: culler.clear(); culler.add(center, radius) per object; culler.cull(P*V); culler.visible(k)
+struct frustum_culler_t
+{
+	vec4					planes[6];			// (n, d): visible side is dot(n, p) + d >= 0, |n| = 1
+	std::vector<float>		x, y, z, r;			// sphere centers and radii (world space)
+	std::vector<uint8_t>	masks;				// bit k of masks[i] is the visibility of sphere 8*i + k
+	uint					count = 0;
+	uint64_t				tested = 0, culled = 0;	// totals for print_stats()
+
+	void	clear() { count = 0; }
+	uint	add(vec3 center, float radius);		// returns the index of the sphere
+	uint	cull(const mat4& view_projection);	// returns the number of visible spheres
+	bool	visible(uint k) const { return (masks[k >> 3] >> (k & 7)) & 1; }
+	void	extract_planes(const mat4& m);
+	void	print_stats(const char* what = "spheres") const;
+
+	// bounding sphere of a model matrix (uniform scale) applied to a sphere of radius r at the origin
+	// (row-major: the translation is the last column)
+	static vec3		center_of(const mat4& m) { return vec3(m[3], m[7], m[11]); }
+	static float	scale_of(const mat4& m) { return sqrtf(m[0] * m[0] + m[4] * m[4] + m[8] * m[8]); }
+	static vec3		center_of(const affine3x4& m) { return vec3(m[3], m[7], m[11]); }	// the model matrices of the hierarchy
+	static float	scale_of(const affine3x4& m) { return sqrtf(m[0] * m[0] + m[4] * m[4] + m[8] * m[8]); }
+	static vec3		eye_of(const mat4& v) { return vec3(-(v[0] * v[3] + v[4] * v[7] + v[8] * v[11]), -(v[1] * v[3] + v[5] * v[7] + v[9] * v[11]), -(v[2] * v[3] + v[6] * v[7] + v[10] * v[11])); }	// view [R|t]: eye = -R^T t
+};
+
+inline uint frustum_culler_t::add(vec3 center, float radius)
+{
+	if (count % 8 == 0 && x.size() < count + 8)
+	{
+		size_t n = count + 8;
+		x.resize(n); y.resize(n); z.resize(n); r.resize(n);
+		masks.resize(n / 8);
+	}
+	x[count] = center.x; y[count] = center.y; z[count] = center.z; r[count] = radius;
+	return count++;
+}
+
+inline void frustum_culler_t::extract_planes(const mat4& m)
+{
+	// Gribb-Hartmann: rows of the clip transform; -w <= x, y, z <= w
+	vec4 r0(m[0], m[1], m[2], m[3]), r1(m[4], m[5], m[6], m[7]), r2(m[8], m[9], m[10], m[11]), r3(m[12], m[13], m[14], m[15]);
+	vec4 p[6] = { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2 };
+	for (int k = 0; k < 6; k++) planes[k] = p[k] / sqrtf(p[k].x * p[k].x + p[k].y * p[k].y + p[k].z * p[k].z);
+}
+
+inline uint frustum_culler_t::cull(const mat4& view_projection)
+{
+	extract_planes(view_projection);
+	uint batches = (count + 7) / 8;
+	for (uint k = count; k < batches * 8; k++) { x[k] = y[k] = z[k] = 0.0f; r[k] = -1e30f; }	// padding: always outside
+
+	uint n = 0;
+	for (uint b = 0; b < batches; b++)
+	{
+		const float *px = &x[b * 8], *py = &y[b * 8], *pz = &z[b * 8], *pr = &r[b * 8];
+		uint mask;
+#if defined(__AVX__)
+		__m256 vx = _mm256_loadu_ps(px), vy = _mm256_loadu_ps(py), vz = _mm256_loadu_ps(pz), nr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(pr));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const vec4& p : planes)
+		{
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, _mm256_set1_ps(p.x)), _mm256_mul_ps(vy, _mm256_set1_ps(p.y))), _mm256_add_ps(_mm256_mul_ps(vz, _mm256_set1_ps(p.z)), _mm256_set1_ps(p.w)));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, nr, _CMP_GE_OQ));
+		}
+		mask = uint(_mm256_movemask_ps(inside));
+#elif defined(FRUSTUM_SSE)
+		mask = 0;
+		for (int h = 0; h < 2; h++)
+		{
+			__m128 vx = _mm_loadu_ps(px + h * 4), vy = _mm_loadu_ps(py + h * 4), vz = _mm_loadu_ps(pz + h * 4), nr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(pr + h * 4));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const vec4& p : planes)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(p.x)), _mm_mul_ps(vy, _mm_set1_ps(p.y))), _mm_add_ps(_mm_mul_ps(vz, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(d, nr));
+			}
+			mask |= uint(_mm_movemask_ps(inside)) << (h * 4);
+		}
+#else
+		mask = 0;
+		for (int k = 0; k < 8; k++)
+		{
+			bool b_inside = true;
+			for (const vec4& p : planes) b_inside = b_inside && px[k] * p.x + py[k] * p.y + pz[k] * p.z + p.w >= -pr[k];
+			mask |= uint(b_inside) << k;
+		}
+#endif
+		masks[b] = uint8_t(mask);
+		for (uint m = mask; m; m &= m - 1) n++;
+	}
+
+	tested += count;
+	culled += count - n;
+	return n;
+}
+
+inline void frustum_culler_t::print_stats(const char* what) const
+{
+	if (!tested) return;
+#if defined(__AVX__)
+	const char* isa = "AVX";
+#elif defined(FRUSTUM_SSE)
+	const char* isa = "SSE";
+#else
+	const char* isa = "scalar";
+#endif
+	printf("[culling] %s: %llu %s tested, %.1f%% culled\n", isa, (unsigned long long) tested, what, 100.0 * culled / tested);
+}
+
+#endif // __FRUSTUM_H__
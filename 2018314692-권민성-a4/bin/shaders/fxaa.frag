@@ -0,0 +1,39 @@
+#ifdef GL_ES
+	precision mediump float;
+#endif
+
+// FXAA (after Lottes' FXAA 3.11 console version, antialias.h): the luma of the four diagonal neighbors gives the
+// direction across the local edge; two and four taps along the edge are averaged, and the wider average is kept
+// unless its luma leaves the range of the neighborhood (then it crossed another edge)
+in vec2 tc;
+out vec4 fragColor;
+
+uniform sampler2D SOURCE;	// the tone-mapped frame
+uniform vec2	texel;		// 1/size
+
+#define REDUCE_MIN	(1.0/128.0)
+#define REDUCE_MUL	(1.0/8.0)
+#define SPAN_MAX	8.0
+
+float luma( vec3 c ){ return dot(c,vec3(0.299,0.587,0.114)); }
+
+void main()
+{
+	vec3 m = texture( SOURCE, tc ).rgb;
+	float lnw = luma(texture( SOURCE, tc+vec2(-1,-1)*texel ).rgb);
+	float lne = luma(texture( SOURCE, tc+vec2( 1,-1)*texel ).rgb);
+	float lsw = luma(texture( SOURCE, tc+vec2(-1, 1)*texel ).rgb);
+	float lse = luma(texture( SOURCE, tc+vec2( 1, 1)*texel ).rgb);
+	float lm = luma(m);
+	float lmin = min(lm,min(min(lnw,lne),min(lsw,lse)));
+	float lmax = max(lm,max(max(lnw,lne),max(lsw,lse)));
+
+	vec2 dir = vec2( -((lnw+lne)-(lsw+lse)), (lnw+lsw)-(lne+lse) );
+	float reduce = max((lnw+lne+lsw+lse)*(0.25*REDUCE_MUL),REDUCE_MIN);
+	dir = clamp(dir/(min(abs(dir.x),abs(dir.y))+reduce),vec2(-SPAN_MAX),vec2(SPAN_MAX))*texel;
+
+	vec3 a = 0.5*(texture( SOURCE, tc+dir*(1.0/3.0-0.5) ).rgb + texture( SOURCE, tc+dir*(2.0/3.0-0.5) ).rgb);
+	vec3 b = a*0.5 + 0.25*(texture( SOURCE, tc-dir*0.5 ).rgb + texture( SOURCE, tc+dir*0.5 ).rgb);
+	float lb = luma(b);
+	fragColor = vec4( lb<lmin||lb>lmax ? a : b, 1 );
+}
@@ -0,0 +1,9 @@
+// bounding-cube proxy of an occlusion query (occlusion.h); only depth testing matters
+layout(location=0) in vec3 position;
+
+uniform mat4 mvp;
+
+void main()
+{
+	gl_Position = mvp*vec4(position,1.0);
+}
@@ -0,0 +1,14 @@
+#ifdef GL_ES
+	precision highp float;
+#endif
+
+// distance from the light instead of the projected depth, so that one comparison works for any face
+in vec3 fpos;
+
+uniform vec3 light_position;
+uniform float range;
+
+void main()
+{
+	gl_FragDepth = length(fpos-light_position)/range;
+}
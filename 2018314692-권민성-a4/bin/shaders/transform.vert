@@ -1,26 +1,110 @@
 // vertex attributes
+#ifdef RING
+vec3 position, normal;	// generated from gl_VertexID by ring_vertex(); rings have no vertex buffer
+vec2 texcoord;
+#else
 layout(location=0) in vec3 position;
 layout(location=1) in vec3 normal;
 layout(location=2) in vec2 texcoord;
+#endif
+#ifdef NORMAL_MAP
+layout(location=3) in vec4 tangent;	// xyz: tangent, w: handedness
+#endif
+#ifdef ASTEROID
+layout(location=4) in vec4 orbit;	// per instance: radius, phase, inclination, longitude of the ascending node
+layout(location=5) in vec4 spin;	// per instance: revolution speed, rotation speed, size, tilt of the rotation axis
+#endif
+#if defined(INDIRECT)||defined(RING)
+layout(location=6) in vec4 model_row0;	// per instance: top rows of the affine model matrix (a body from cull.comp, or a ring)
+layout(location=7) in vec4 model_row1;
+layout(location=8) in vec4 model_row2;
+#endif
+#ifdef INDIRECT
+layout(location=10) in uvec2 body_draw;	// per body: texture layer, normal map layer
+#endif
+#ifdef RING
+layout(location=11) in vec4 ring;	// per instance: inner radius, outer radius, segments, texture layer
+#endif
 
 // outputs of vertex shader = input to fragment shader
 out vec4 epos;	// eye-space position
 out vec3 norm;	// per-vertex normal before interpolation
 out vec2 tc;	// texture coordinate
+#ifdef NORMAL_MAP
+out vec4 tang;	// eye-space tangent and handedness
+#endif
+#ifdef INDIRECT
+flat out uvec2 draw;	// body_draw for the fragment shader
+#endif
+#ifdef RING
+flat out float layer;	// texture layer of the ring
+#endif
+
+// per-object data from the ring buffer (must match transform.frag)
+layout(std140, row_major) uniform object_block
+{
+	mat4x3	model_matrix;	// affine: the rows of the model matrix but the last (0,0,0,1)
+};
 
 // matrices
-uniform mat4 model_matrix;
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
+#ifdef ASTEROID
+uniform float theta;	// simulation time
+
+// placement of an asteroid on its inclined orbit, spinning about a tilted axis
+mat4 asteroid_matrix()
+{
+	float a = orbit.y+theta*spin.x;
+	vec3 p = orbit.x*vec3(cos(a),sin(a)*cos(orbit.z),sin(a)*sin(orbit.z));	// inclined about the line of nodes (x)
+	p = vec3(p.x*cos(orbit.w)-p.y*sin(orbit.w), p.x*sin(orbit.w)+p.y*cos(orbit.w), p.z);
+
+	float r = theta*spin.y, t = spin.w;
+	mat3 R = mat3(1,0,0, 0,cos(t),sin(t), 0,-sin(t),cos(t)) * mat3(cos(r),sin(r),0, -sin(r),cos(r),0, 0,0,1);
+	return mat4(vec4(R[0]*spin.z,0), vec4(R[1]*spin.z,0), vec4(R[2]*spin.z,0), vec4(p,1));
+}
+#endif
 
+#ifdef RING
+// annulus in the xy plane: six vertices (two triangles) per segment from the inner to the outer radius;
+// vertices past the instance's segments collapse to a point, so one draw covers rings of any resolution
+void ring_vertex()
+{
+	const ivec2 corner[6] = ivec2[6]( ivec2(0,0), ivec2(1,1), ivec2(0,1), ivec2(0,0), ivec2(1,0), ivec2(1,1) );	// (next segment, outer)
+	int segments = int(ring.z);
+	int s = min(gl_VertexID/6,segments-1);
+	ivec2 c = gl_VertexID<segments*6 ? corner[gl_VertexID%6] : ivec2(0);
+	float t = float(s+c.x)/float(segments), a = 6.2831853*t;
+	normal = vec3(cos(a),sin(a),0.0);	// radial, as in the former mesh
+	position = normal*(c.y==1?ring.y:ring.x);
+	texcoord = vec2(c.y==1?0.0:1.0,t);
+}
+#endif
 
 void main()
 {
-	vec4 wpos = model_matrix *vec4(position, 1.0);
+#ifdef RING
+	ring_vertex();
+	layer = ring.w;
+#endif
+#ifdef INDIRECT
+	draw = body_draw;
+#endif
+#ifdef ASTEROID
+	mat4 model = mat4(model_matrix)*asteroid_matrix();
+#elif defined(INDIRECT)||defined(RING)
+	mat4 model = transpose(mat4(model_row0,model_row1,model_row2,vec4(0,0,0,1)));
+#else
+	mat4 model = mat4(model_matrix);	// completed with the identity's bottom row
+#endif
+	vec4 wpos = model *vec4(position, 1.0);
 	epos = view_matrix * wpos;
 	gl_Position = projection_matrix * epos;
 
 	// pass eye-space normal and tc to fragment shader
-	norm = normalize(mat3(view_matrix*model_matrix)*normal);
+	norm = normalize(mat3(view_matrix*model)*normal);
 	tc=texcoord;
+#ifdef NORMAL_MAP
+	tang = vec4(normalize(mat3(view_matrix*model)*tangent.xyz), tangent.w);
+#endif
 }
\ No newline at end of file
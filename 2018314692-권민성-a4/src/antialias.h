@@ -0,0 +1,210 @@
+#pragma once
+#ifndef __ANTIALIAS_H__
+#define __ANTIALIAS_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+#include "profiler.h"
+
+//*************************************
+// anti-aliasing modes: multisampling with a blit resolve, or FXAA as a cheaper post-pass
+// - MSAA: the scene is drawn into a multisampled color/depth pair in the format of the scene target (RGBA8, or RGBA16F
+//   under hdr.h) and resolved into it by glBlitFramebuffer; it sits innermost, so bloom and tone mapping see the resolved image
+// - FXAA: the final LDR image (after tone mapping) goes into a texture that one fullscreen pass (fxaa.frag) filters
+//   into the window, smoothing along the local edge direction found from the luma
+// - the deferred path keeps its single-sampled G-buffer, so MSAA is skipped there; FXAA works with every path
+// - rings under oit.h are accumulated single-sampled and composited over the multisampled scene
+struct antialias_t
+{
+	enum { OFF, MSAA_2X, MSAA_4X, MSAA_8X, FXAA, NUM_MODES };
+
+	uint	mode = OFF;
+	GLint	max_samples = 1;
+	GLuint	program = 0;					// fxaa.frag
+	GLuint	vertex_array = 0;				// empty; the triangle comes from gl_VertexID
+	GLuint	msaa_fbo = 0, msaa_color = 0, msaa_depth = 0;
+	GLuint	fxaa_fbo = 0, fxaa_color = 0, fxaa_depth = 0;
+	GLenum	msaa_format = 0;				// of the current multisampled color; recreated when the scene target changes
+	uint	msaa_samples = 0;
+	ivec2	msaa_size = ivec2(0, 0), fxaa_size = ivec2(0, 0);
+	GLint	msaa_scene_fbo = 0, fxaa_scene_fbo = 0;	// framebuffers bound at the begin of each
+	GLint	polygon_mode[2] = {};
+	uint	frames[NUM_MODES] = {};
+	double	gpu_sum[NUM_MODES] = {};		// GPU time of the timed passes, per mode
+	uint	slot_mode[profiler_t::gpu_pass_t::LATENCY] = {};	// 1 + mode of the frame in each query slot; 0 for none
+
+	static const char*	name(uint m) { static const char* names[NUM_MODES] = { "off", "MSAA 2x", "MSAA 4x", "MSAA 8x", "FXAA" }; return names[m % NUM_MODES]; }
+	uint	samples() const { return mode >= MSAA_2X && mode <= MSAA_8X ? 2u << (mode - MSAA_2X) : 1; }
+	bool	create(program_cache_t& cache, const char* vert_path, const char* frag_path);
+	void	set_samples(uint n);			// 1, 2, 4 or 8; 1 turns MSAA off; create() lowers it to GL_MAX_SAMPLES
+	void	next_mode();					// off, MSAA 2x/4x/8x (up to GL_MAX_SAMPLES), FXAA
+	bool	begin_fxaa(ivec2 viewport_size);	// outermost: the LDR image of the frame; false unless FXAA
+	void	end_fxaa();						// filters it into the framebuffer of begin_fxaa()
+	bool	begin_msaa(ivec2 viewport_size, GLenum format);	// innermost: format of the scene target; false unless MSAA
+	void	end_msaa();						// resolves into the framebuffer of begin_msaa()
+	void	begin_frame(const profiler_t& profiler, bool b_counted = true);	// tags the query slot of the frame with its mode
+	void	record(const profiler_t& profiler);	// credits the frames resolved since then to the modes they were drawn in
+	void	print_stats() const;
+	void	destroy();
+	void	destroy_msaa();
+	void	destroy_fxaa();
+};
+
+inline bool antialias_t::create(program_cache_t& cache, const char* vert_path, const char* frag_path)
+{
+	glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+	if (!(program = cache.create_program(vert_path, frag_path))) return false;
+	glUniform1i(glGetUniformLocation(program, "SOURCE"), 0);
+	glGenVertexArrays(1, &vertex_array);
+	while (mode >= MSAA_2X && mode <= MSAA_8X && (2 << (mode - MSAA_2X)) > max_samples) mode--;	// the most samples supported
+	return true;
+}
+
+inline void antialias_t::set_samples(uint n)
+{
+	mode = n >= 8 ? MSAA_8X : n >= 4 ? MSAA_4X : n >= 2 ? MSAA_2X : OFF;
+}
+
+inline void antialias_t::next_mode()
+{
+	mode = (mode + 1) % NUM_MODES;
+	while (mode >= MSAA_2X && mode <= MSAA_8X && (2 << (mode - MSAA_2X)) > max_samples) mode++;	// skip the unsupported counts
+}
+
+// the GPU time of a frame is read back up to LATENCY frames later, after 'a' may have switched the mode
+inline void antialias_t::begin_frame(const profiler_t& profiler, bool b_counted)
+{
+	if (profiler.b_gpu_timed) slot_mode[profiler.frame_slot] = b_counted ? mode + 1 : 0;	// else the slot still holds an older frame
+}
+
+inline void antialias_t::record(const profiler_t& profiler)
+{
+	for (auto& [slot, us] : profiler.resolved)
+	{
+		uint m = slot_mode[slot]; slot_mode[slot] = 0;
+		if (m) { frames[m - 1]++; gpu_sum[m - 1] += us; }
+	}
+}
+
+inline bool antialias_t::begin_fxaa(ivec2 viewport_size)
+{
+	if (mode != FXAA || !program) return false;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fxaa_scene_fbo);
+	if (viewport_size.x != fxaa_size.x || viewport_size.y != fxaa_size.y)
+	{
+		destroy_fxaa();
+		fxaa_size = viewport_size;
+		glGenTextures(1, &fxaa_color);
+		glBindTexture(GL_TEXTURE_2D, fxaa_color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fxaa_size.x, fxaa_size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);	// the pass samples between texels along edges
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glGenRenderbuffers(1, &fxaa_depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, fxaa_depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, fxaa_size.x, fxaa_size.y);	// as the default framebuffer, for the depth blits of oit.h and deferred.h
+		glGenFramebuffers(1, &fxaa_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fxaa_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fxaa_color, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, fxaa_depth);
+		bool b_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, fxaa_scene_fbo);
+		if (!b_complete) { printf("%s(): incomplete framebuffer; anti-aliasing off\n", __func__); destroy_fxaa(); mode = OFF; return false; }
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, fxaa_fbo);
+	return true;
+}
+
+inline void antialias_t::end_fxaa()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fxaa_scene_fbo);
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(program);
+	glUniform2f(glGetUniformLocation(program, "texel"), 1.0f / fxaa_size.x, 1.0f / fxaa_size.y);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fxaa_color);
+	glBindVertexArray(vertex_array);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+}
+
+inline bool antialias_t::begin_msaa(ivec2 viewport_size, GLenum format)
+{
+	uint n = samples();
+	if (n < 2) return false;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &msaa_scene_fbo);
+	if (viewport_size.x != msaa_size.x || viewport_size.y != msaa_size.y || format != msaa_format || n != msaa_samples)
+	{
+		destroy_msaa();
+		msaa_size = viewport_size;
+		msaa_format = format;	// a resolve blit needs the same format on both sides
+		msaa_samples = n;
+		glGenRenderbuffers(1, &msaa_color);
+		glBindRenderbuffer(GL_RENDERBUFFER, msaa_color);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, GLsizei(n), format, msaa_size.x, msaa_size.y);
+		glGenRenderbuffers(1, &msaa_depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, msaa_depth);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, GLsizei(n), GL_DEPTH24_STENCIL8, msaa_size.x, msaa_size.y);
+		glGenFramebuffers(1, &msaa_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, msaa_fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaa_color);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, msaa_depth);
+		bool b_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, msaa_scene_fbo);
+		if (!b_complete) { printf("%s(): incomplete multisampled framebuffer; anti-aliasing off\n", __func__); destroy_msaa(); mode = OFF; return false; }
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, msaa_fbo);
+	return true;
+}
+
+inline void antialias_t::end_msaa()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, msaa_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, msaa_scene_fbo);
+	glBlitFramebuffer(0, 0, msaa_size.x, msaa_size.y, 0, 0, msaa_size.x, msaa_size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, msaa_scene_fbo);
+}
+
+inline void antialias_t::print_stats() const
+{
+	for (uint m = 0; m < NUM_MODES; m++)
+	{
+		if (!frames[m]) continue;
+		printf("[antialiasing] %s: %u timed frames, gpu %.3f ms/frame\n", name(m), frames[m], gpu_sum[m] / frames[m] / 1000.0);
+	}
+}
+
+inline void antialias_t::destroy_msaa()
+{
+	if (msaa_fbo) glDeleteFramebuffers(1, &msaa_fbo);
+	GLuint buffers[] = { msaa_color, msaa_depth };
+	glDeleteRenderbuffers(2, buffers);
+	msaa_fbo = msaa_color = msaa_depth = 0;
+	msaa_format = 0;
+	msaa_samples = 0;
+	msaa_size = ivec2(0, 0);
+}
+
+inline void antialias_t::destroy_fxaa()
+{
+	if (fxaa_fbo) glDeleteFramebuffers(1, &fxaa_fbo);
+	if (fxaa_color) glDeleteTextures(1, &fxaa_color);
+	if (fxaa_depth) glDeleteRenderbuffers(1, &fxaa_depth);
+	fxaa_fbo = fxaa_color = fxaa_depth = 0;
+	fxaa_size = ivec2(0, 0);
+}
+
+inline void antialias_t::destroy()
+{
+	destroy_msaa();
+	destroy_fxaa();
+	if (vertex_array) glDeleteVertexArrays(1, &vertex_array);
+	if (program) glDeleteProgram(program);
+	vertex_array = program = 0;
+}
+
+#endif // __ANTIALIAS_H__
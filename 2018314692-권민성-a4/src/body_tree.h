@@ -0,0 +1,105 @@
+#pragma once
+#ifndef __BODY_TREE_H__
+#define __BODY_TREE_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "catalog.h"
+#include "sphere.h"
+#include "frustum.h"
+
+//*************************************
+// transform hierarchy of the catalog bodies with subtree bounding spheres
+// - a subtree (a body, its rings and all of its descendants) never leaves bound[k] around the body's center:
+//   orbits keep their distance and every level only rotates and scales uniformly, so the bounds are built once
+// - traverse() goes level by level from the roots and culls each level in SIMD batches of 8;
+//   the descendants of a rejected subtree are neither transformed nor tested
+// - per-frame flags are frame stamps, so nothing is cleared per body
+struct body_tree_t
+{
+	std::vector<uint>		roots;
+	std::vector<uint>		child_begin, children;	// CSR: the children of k are children[child_begin[k] .. child_begin[k + 1])
+	std::vector<float>		radius;					// world radius of each body
+	std::vector<float>		bound;					// radius of the subtree sphere around the body's center
+	std::vector<uint>		visited, in_view;		// frame stamps: transformed / own sphere in the frustum
+	std::vector<uint>		visible_bodies;			// bodies in view after the last traverse(), by level
+	uint					stamp = 0;
+	uint					tested = 0;				// spheres tested by the last traverse()
+
+	frustum_culler_t		culler;
+	std::vector<uint>		level, next;
+
+	void	build(const catalog_t& catalog);
+	uint	traverse(float theta, std::vector<sphere_t>& spheres, const mat4& view_projection);	// returns the number of visible bodies
+	bool	is_visited(uint k) const { return visited[k] == stamp; }	// its model matrix is current
+	bool	is_visible(uint k) const { return in_view[k] == stamp; }
+};
+
+inline void body_tree_t::build(const catalog_t& catalog)
+{
+	uint n = catalog.body_count;
+	std::vector<float> scale(n), distance(n);
+	radius.assign(n, 0.0f);
+	std::vector<uint> child_count(n, 0);
+	roots.clear();
+	for (uint k = 0; k < n; k++)	// parents precede their children
+	{
+		const catalog_t::body_t& b = catalog.bodies[k];
+		float parent_scale = b.parent >= 0 ? scale[b.parent] : 1.0f;
+		scale[k] = radius[k] = b.radius * parent_scale;	// models end with S(radius) on top of the parent's
+		distance[k] = b.distance * parent_scale;
+		if (b.parent >= 0) child_count[b.parent]++; else roots.push_back(k);
+	}
+
+	child_begin.assign(n + 1, 0);
+	for (uint k = 0; k < n; k++) child_begin[k + 1] = child_begin[k] + child_count[k];
+	children.resize(child_begin[n]);
+	std::vector<uint> fill(child_begin.begin(), child_begin.end() - 1);
+	for (uint k = 0; k < n; k++) if (catalog.bodies[k].parent >= 0) children[fill[catalog.bodies[k].parent]++] = k;
+
+	// bottom-up: children come after their parents, so a reverse pass sees every child first
+	bound = radius;
+	for (uint k = 0; k < catalog.ring_count; k++) { const catalog_t::ring_t& r = catalog.rings[k]; bound[r.body] = std::max(bound[r.body], 4.0f * r.scale * scale[r.body]); }
+	for (uint k = n; k-- > 0; )
+	{
+		int p = catalog.bodies[k].parent;
+		if (p >= 0) bound[p] = std::max(bound[p], distance[k] + bound[k]);
+	}
+	visited.assign(n, 0);
+	in_view.assign(n, 0);
+}
+
+inline uint body_tree_t::traverse(float theta, std::vector<sphere_t>& spheres, const mat4& view_projection)
+{
+	stamp++;
+	tested = 0;
+	visible_bodies.clear();
+	level = roots;
+	while (!level.empty())
+	{
+		// two spheres per body: its subtree, then itself
+		culler.clear();
+		for (uint k : level)
+		{
+			spheres[k].update(theta, spheres);
+			visited[k] = stamp;
+			vec3 c = frustum_culler_t::center_of(spheres[k].model_matrix);
+			culler.add(c, bound[k]);
+			culler.add(c, radius[k]);
+		}
+		culler.cull(view_projection);
+		tested += culler.count;
+
+		next.clear();
+		for (uint i = 0; i < level.size(); i++)
+		{
+			if (!culler.visible(i * 2)) continue;
+			uint k = level[i];
+			if (culler.visible(i * 2 + 1)) { in_view[k] = stamp; visible_bodies.push_back(k); }
+			next.insert(next.end(), children.begin() + child_begin[k], children.begin() + child_begin[k + 1]);
+		}
+		level.swap(next);
+	}
+	return uint(visible_bodies.size());
+}
+
+#endif // __BODY_TREE_H__
@@ -0,0 +1,179 @@
+#pragma once
+#ifndef __DEFERRED_H__
+#define __DEFERRED_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+
+//*************************************
+// deferred shading with tiled light culling (GL 4.3)
+// - opaque surfaces are drawn with the GBUFFER variant into albedo (RGBA8, alpha flags unlit surfaces),
+//   eye-space normals (RGBA16F) and depth; nothing is lit while drawing
+// - one compute pass (deferred.comp) then works on 16x16-pixel tiles: it bounds the depth of the tile,
+//   culls every point light against the tile's frustum into a list in shared memory, and lights the tile's pixels
+//   with the Sun (phong() of transform.frag) plus only the lights in that list
+// - the lit image and the depth are blitted into the scene framebuffer, so translucent passes draw on top as in forward
+// - without compute shaders, the caller keeps forward shading (one light per fragment)
+struct deferred_renderer_t
+{
+	struct light_t		// std430 light_t of deferred.comp
+	{
+		vec4	position;		// world position, range
+		vec4	color;			// rgb; a unused
+	};
+	static const uint TILE_SIZE = 16, MAX_TILE_LIGHTS = 1024;	// must match deferred.comp
+
+	GLuint	program = 0;
+	GLuint	fbo = 0, albedo = 0, normal = 0, depth = 0;	// G-buffer
+	GLuint	lit = 0, lit_fbo = 0;			// output of the compute pass
+	GLuint	light_buffer = 0, stats_buffer = 0;
+	ivec2	size = ivec2(0, 0);
+	GLint	scene_fbo = 0;					// framebuffer that was bound at begin()
+	std::vector<light_t>	lights;			// filled by the caller every frame
+	uint	light_capacity = 0;
+	uint	frames = 0;
+
+	static bool	is_supported() { return GLAD_GL_VERSION_4_3 && glDispatchCompute; }
+	bool	create(program_cache_t& cache, const char* comp_path);
+	bool	resize(ivec2 new_size);
+	bool	begin(ivec2 viewport_size);		// binds and clears the G-buffer; false when unsupported
+	void	end(const mat4& projection_matrix);	// light culling and shading, then blits into the scene framebuffer
+	void	print_stats() const;
+	void	destroy();
+	void	destroy_targets();
+};
+
+inline bool deferred_renderer_t::create(program_cache_t& cache, const char* comp_path)
+{
+	if (!is_supported()) { printf("> deferred shading needs OpenGL 4.3; forward shading only\n"); return true; }
+	if (!(program = cache.create_compute(comp_path))) return false;
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "ALBEDO"), 0);
+	glUniform1i(glGetUniformLocation(program, "NORMALS"), 1);
+	glUniform1i(glGetUniformLocation(program, "DEPTH"), 2);
+	glUniform1i(glGetUniformLocation(program, "SHADOW"), 4);	// bound by the caller
+	glGenBuffers(1, &light_buffer);
+	glGenBuffers(1, &stats_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint) * 2, nullptr, GL_DYNAMIC_READ);
+	return true;
+}
+
+inline bool deferred_renderer_t::resize(ivec2 new_size)
+{
+	destroy_targets();
+	size = new_size;
+	auto target = [&](GLuint& texture, GLenum internal_format, GLenum format, GLenum type)
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size.x, size.y, 0, format, type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	};
+	target(albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+	target(normal, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+	target(depth, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);	// the format of the default framebuffer, so that the depth can be blitted
+	target(lit, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);	// keeps the emission above 1 for hdr.h
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+	bool b_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glGenFramebuffers(1, &lit_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, lit_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lit, 0);
+	b_complete = b_complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	if (!b_complete) { printf("%s(): incomplete G-buffer; forward shading only\n", __func__); destroy_targets(); glDeleteProgram(program); program = 0; }
+	return b_complete;
+}
+
+inline bool deferred_renderer_t::begin(ivec2 viewport_size)
+{
+	if (!program) return false;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &scene_fbo);
+	if (viewport_size.x != size.x || viewport_size.y != size.y) { if (!resize(viewport_size)) return false; }
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	const GLfloat zero[] = { 0, 0, 0, 0 };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, zero);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	return true;
+}
+
+inline void deferred_renderer_t::end(const mat4& projection_matrix)
+{
+	// this frame's lights; the buffer only grows
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, light_buffer);
+	uint n = uint(lights.size());
+	if (n > light_capacity) { light_capacity = std::max(n, light_capacity * 2); glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(light_t) * light_capacity, nullptr, GL_STREAM_DRAW); }
+	if (n) glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(light_t) * n, lights.data());
+	const uint zero[2] = { 0, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	GLfloat background[4]; glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+	glUseProgram(program);	// view_matrix and the Sun are set with the uniforms of the shader variants
+	glUniform4f(glGetUniformLocation(program, "projection"), projection_matrix[0], projection_matrix[5], projection_matrix[10], projection_matrix[11]);
+	glUniform2i(glGetUniformLocation(program, "size"), size.x, size.y);
+	glUniform1ui(glGetUniformLocation(program, "light_count"), n);
+	glUniform4fv(glGetUniformLocation(program, "background"), 1, background);
+	glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, albedo);
+	glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, normal);
+	glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, depth);
+	glActiveTexture(GL_TEXTURE0);
+	glBindImageTexture(0, lit, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, light_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, stats_buffer);
+	glDispatchCompute((size.x + TILE_SIZE - 1) / TILE_SIZE, (size.y + TILE_SIZE - 1) / TILE_SIZE, 1);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+	frames++;
+
+	// the lit image and the opaque depth become the scene, for the translucent passes that follow
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, lit_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scene_fbo);
+	glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+}
+
+inline void deferred_renderer_t::print_stats() const
+{
+	if (!frames) return;
+	uint s[2] = { 0, 0 };	// of the last frame: light-tile pairs, most lights in a tile
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(s), s);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	uint tiles = ((size.x + TILE_SIZE - 1) / TILE_SIZE) * ((size.y + TILE_SIZE - 1) / TILE_SIZE);
+	printf("[deferred] %u frames, %u point lights, %u tiles: %.2f lights per tile on average, at most %u (limit %u)\n", frames, uint(lights.size()), tiles, tiles ? s[0] / double(tiles) : 0.0, s[1], MAX_TILE_LIGHTS);
+}
+
+inline void deferred_renderer_t::destroy_targets()
+{
+	GLuint fbos[] = { fbo, lit_fbo }, targets[] = { albedo, normal, depth, lit };
+	glDeleteFramebuffers(2, fbos);
+	glDeleteTextures(4, targets);
+	fbo = lit_fbo = albedo = normal = depth = lit = 0;
+	size = ivec2(0, 0);
+}
+
+inline void deferred_renderer_t::destroy()
+{
+	destroy_targets();
+	GLuint buffers[] = { light_buffer, stats_buffer };
+	glDeleteBuffers(2, buffers);
+	if (program) glDeleteProgram(program);
+	light_buffer = stats_buffer = program = 0;
+	light_capacity = 0;
+}
+
+#endif // __DEFERRED_H__
@@ -0,0 +1,161 @@
+#pragma once
+#ifndef __FRAME_PACER_H__
+#define __FRAME_PACER_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#if !defined(_WIN32)
+	#include <time.h>
+#endif
+
+//*************************************
+// frame scheduler for the main loop
+// - VSYNC / ADAPTIVE: the swap interval paces the loop (adaptive tears instead of halving the rate when late)
+// - TARGET_FPS: no swap interval; sleeps to the next deadline with nanosleep and spins the last stretch
+// - UNLIMITED: renders as fast as possible
+// - a static scene with no pending redraw blocks in glfwWaitEvents() instead of rendering;
+//   changed(state) compares the view state with the last call, so the last frame stays on screen until it differs
+// usage: [--vsync | --adaptive | --unlimited | --fps N]
+struct frame_pacer_t
+{
+	enum mode_t { VSYNC, ADAPTIVE, TARGET_FPS, UNLIMITED, MODE_COUNT };
+	typedef std::chrono::steady_clock clock;
+
+	mode_t		mode = VSYNC;
+	double		target_fps = 60.0;
+	bool		b_redraw = true;		// set by event callbacks when the next frame must be drawn
+	bool		b_idle = false;			// the last loop iteration waited for events
+	uint64_t	state_hash = 0;			// hash of the view state seen by the last changed() call
+
+	// hybrid sleep: nanosleep until deadline-margin, then spin; the margin follows the observed oversleep
+	clock::time_point deadline;
+	double		spin_margin = 0.002;	// seconds
+
+	// jitter statistics over frame intervals
+	clock::time_point last_frame;
+	bool		b_has_last = false;
+	uint		intervals = 0, skipped = 0;
+	double		sum = 0.0, sum2 = 0.0, max_interval = 0.0, sum_dev = 0.0, max_dev = 0.0;
+
+	bool		parse(int argc, char* argv[]);
+	void		set_mode(mode_t m);
+	void		next_mode() { set_mode(mode_t((mode + 1) % MODE_COUNT)); }
+	const char*	mode_name() const { static const char* names[] = { "vsync", "adaptive vsync", "target fps", "unlimited" }; return names[mode]; }
+	void		request_redraw() { b_redraw = true; }
+	template <class T> bool changed(const T& state);	// T must have no padding bytes
+	bool		begin_frame(bool b_animating);	// false: nothing changed, waited for events instead
+	void		end_frame();
+	void		print_stats() const;
+	static void	sleep(double sec);
+};
+
+inline bool frame_pacer_t::parse(int argc, char* argv[])
+{
+	for (int k = 1; k < argc; k++)
+	{
+		std::string a = argv[k];
+		if (a == "--vsync") mode = VSYNC;
+		else if (a == "--adaptive") mode = ADAPTIVE;
+		else if (a == "--unlimited") mode = UNLIMITED;
+		else if (a == "--fps" && k + 1 < argc) { mode = TARGET_FPS; target_fps = std::max(1.0, atof(argv[++k])); }
+	}
+	return true;
+}
+
+inline void frame_pacer_t::set_mode(mode_t m)
+{
+	mode = m;
+	if (mode == ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+	{
+		printf("> adaptive vsync is not supported; using vsync\n");
+		mode = VSYNC;
+	}
+	glfwSwapInterval(mode == VSYNC ? 1 : mode == ADAPTIVE ? -1 : 0);
+	deadline = clock::now();
+	b_has_last = false;
+	printf("> frame pacing: %s", mode_name());
+	if (mode == TARGET_FPS) printf(" (%.0f fps)", target_fps);
+	printf("\n");
+}
+
+template <class T> inline bool frame_pacer_t::changed(const T& state)
+{
+	uint64_t h = 14695981039346656037ull;	// FNV-1a
+	const unsigned char* p = (const unsigned char*) &state;
+	for (size_t k = 0; k < sizeof(T); k++) { h ^= p[k]; h *= 1099511628211ull; }
+	bool b = h != state_hash;
+	state_hash = h;
+	return b;
+}
+
+inline bool frame_pacer_t::begin_frame(bool b_animating)
+{
+	if (!b_animating && !b_redraw)
+	{
+		glfwWaitEvents();	// sleeps until input; callbacks set b_redraw
+		b_idle = true;
+		skipped++;
+		return false;
+	}
+	if (b_idle) { b_has_last = false; deadline = clock::now(); b_idle = false; }	// do not count the idle gap as jitter
+	b_redraw = false;
+	return true;
+}
+
+inline void frame_pacer_t::end_frame()
+{
+	if (mode == TARGET_FPS)
+	{
+		auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / target_fps));
+		deadline += period;
+		auto now = clock::now();
+		if (now > deadline + period) deadline = now;	// fell behind; do not try to catch up
+		else
+		{
+			double remain = std::chrono::duration<double>(deadline - now).count();
+			if (remain > spin_margin)
+			{
+				auto t = clock::now();
+				sleep(remain - spin_margin);
+				double oversleep = std::chrono::duration<double>(clock::now() - t).count() - (remain - spin_margin);
+				spin_margin = std::min(0.004, std::max(0.0002, spin_margin * 0.9 + std::max(0.0, oversleep) * 0.2));
+			}
+			while (clock::now() < deadline) std::this_thread::yield();
+		}
+	}
+
+	auto now = clock::now();
+	if (b_has_last)
+	{
+		double dt = std::chrono::duration<double>(now - last_frame).count();
+		intervals++; sum += dt; sum2 += dt * dt; max_interval = std::max(max_interval, dt);
+		if (mode == TARGET_FPS) { double dev = fabs(dt - 1.0 / target_fps); sum_dev += dev; max_dev = std::max(max_dev, dev); }
+	}
+	last_frame = now;
+	b_has_last = true;
+}
+
+inline void frame_pacer_t::sleep(double sec)
+{
+	if (sec <= 0) return;
+#if !defined(_WIN32)
+	timespec ts = { time_t(sec), long((sec - time_t(sec)) * 1e9) };
+	while (nanosleep(&ts, &ts) != 0) {}	// resume after signals
+#else
+	std::this_thread::sleep_for(std::chrono::duration<double>(sec));
+#endif
+}
+
+inline void frame_pacer_t::print_stats() const
+{
+	printf("[pacer] %s: %u frames, %u idle waits\n", mode_name(), intervals + (b_has_last ? 1 : 0), skipped);
+	if (!intervals) return;
+	double mean = sum / intervals, stddev = sqrt(std::max(0.0, sum2 / intervals - mean * mean));
+	printf("[pacer] interval: mean %.3f ms (%.1f fps), stddev %.3f ms, max %.3f ms\n", mean * 1000.0, 1.0 / mean, stddev * 1000.0, max_interval * 1000.0);
+	if (mode == TARGET_FPS) printf("[pacer] deviation from %.0f fps: mean %.3f ms, max %.3f ms, spin margin %.3f ms\n", target_fps, sum_dev / intervals * 1000.0, max_dev * 1000.0, spin_margin * 1000.0);
+}
+
+#endif // __FRAME_PACER_H__
@@ -0,0 +1,197 @@
+#pragma once
+#ifndef __HDR_H__
+#define __HDR_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+#include "profiler.h"
+
+//*************************************
+// HDR scene target with bloom and tone mapping
+// - the scene is drawn into RGBA16F (with a DEPTH24_STENCIL8 depth, so that oit.h and deferred.h can blit depth as before),
+//   where emissive surfaces may go above 1
+// - bloom: the bright part is taken down to 1/scale of the window, then halved level by level; each level is blurred
+//   by a separable 9-tap Gaussian (5 bilinear taps per direction), and the levels are added back up from the smallest
+// - the tone map adds the bloom to the scene and compresses only above a knee, so the LDR colors below it stay as they were
+// - one fragment shader (hdr.frag) with a #define per stage, as the shader variants do
+struct hdr_t
+{
+	enum { THRESHOLD, DOWNSAMPLE, BLUR, UPSAMPLE, TONEMAP, NUM_STAGES };
+	static const uint MAX_LEVELS = 8;
+	struct level_t { GLuint texture[2] = {}, fbo[2] = {}; ivec2 size = ivec2(0, 0); };	// [0]: result, [1]: between the blur directions
+
+	bool	enabled = false;
+	uint	levels = 5;						// depth of the bloom chain
+	uint	scale = 2;						// first level at 1/2 or 1/4 of the window
+	float	threshold = 1.0f, knee = 0.8f;	// bloom from luminance above threshold; tone curve linear below knee
+	float	strength = 0.3f, exposure = 1.0f;
+	float	emission = 2.0f;				// brightness of unlit surfaces (the Sun) in HDR
+	GLuint	programs[NUM_STAGES] = {};
+	GLuint	vertex_array = 0;				// empty; the triangle comes from gl_VertexID
+	GLuint	fbo = 0, color = 0, depth_buffer = 0;
+	level_t	chain[MAX_LEVELS];
+	ivec2	size = ivec2(0, 0);
+	GLint	scene_fbo = 0;					// framebuffer that was bound at begin(); the tone map writes into it
+	GLint	polygon_mode[2] = {};
+
+	bool	create(program_cache_t& cache, const char* vert_path, const char* frag_path);
+	bool	resize(ivec2 new_size);
+	bool	begin(ivec2 viewport_size);		// binds the HDR target; false when disabled
+	void	end(profiler_t& profiler);		// bloom and tone map into the framebuffer of begin(); a GPU pass each
+	void	destroy();
+	void	destroy_targets();
+	void	draw(uint stage, GLuint source, const level_t* target, uint buffer);	// a fullscreen triangle of a stage
+};
+
+inline bool hdr_t::create(program_cache_t& cache, const char* vert_path, const char* frag_path)
+{
+	std::string vs = program_cache_t::read(vert_path), fs = program_cache_t::read(frag_path);
+	if (vs.empty() || fs.empty()) return false;
+	static const char* defines[NUM_STAGES] = { "THRESHOLD", "DOWNSAMPLE", "BLUR", "UPSAMPLE", "TONEMAP" };
+	std::string h = program_cache_t::version_header();
+	for (uint k = 0; k < NUM_STAGES; k++)
+	{
+		if (!(programs[k] = cache.create(h + vs, h + "#define " + defines[k] + "\n#line 1\n" + fs))) return false;
+		glUseProgram(programs[k]);
+		glUniform1i(glGetUniformLocation(programs[k], "SOURCE"), 0);
+		glUniform1i(glGetUniformLocation(programs[k], "BLOOM"), 1);
+	}
+	levels = std::min(std::max(levels, 1u), MAX_LEVELS);
+	scale = scale >= 4 ? 4 : 2;
+	knee = std::min(std::max(knee, 0.0f), 0.99f);
+	glGenVertexArrays(1, &vertex_array);
+	return true;
+}
+
+inline bool hdr_t::resize(ivec2 new_size)
+{
+	destroy_targets();
+	size = new_size;
+	auto target = [](GLuint& texture, GLuint& fbo, ivec2 s)
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, s.x, s.y, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);	// bilinear taps in the down/upsampling and the blur
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	};
+	bool b_complete = target(color, fbo, size);
+	glGenRenderbuffers(1, &depth_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+	b_complete = b_complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	ivec2 s = ivec2(std::max(size.x / int(scale), 1), std::max(size.y / int(scale), 1));
+	for (uint l = 0; l < levels; l++, s = ivec2(std::max(s.x / 2, 1), std::max(s.y / 2, 1)))
+	{
+		chain[l].size = s;
+		for (uint k = 0; k < 2; k++) b_complete = target(chain[l].texture[k], chain[l].fbo[k], s) && b_complete;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	if (!b_complete) { printf("%s(): incomplete HDR framebuffer; rendering in LDR\n", __func__); destroy_targets(); enabled = false; }
+	return b_complete;
+}
+
+inline bool hdr_t::begin(ivec2 viewport_size)
+{
+	if (!enabled || !programs[0]) return false;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &scene_fbo);
+	if (viewport_size.x != size.x || viewport_size.y != size.y) { if (!resize(viewport_size)) return false; }
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	return true;
+}
+
+inline void hdr_t::draw(uint stage, GLuint source, const level_t* target, uint buffer)
+{
+	glUseProgram(programs[stage]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source);
+	if (target) { glBindFramebuffer(GL_FRAMEBUFFER, target->fbo[buffer]); glViewport(0, 0, target->size.x, target->size.y); }
+	else { glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo); glViewport(0, 0, size.x, size.y); }
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+inline void hdr_t::end(profiler_t& profiler)
+{
+	static const char* blur_names[MAX_LEVELS] = { "bloom level 1", "bloom level 2", "bloom level 3", "bloom level 4", "bloom level 5", "bloom level 6", "bloom level 7", "bloom level 8" };	// kept by pointer
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glBindVertexArray(vertex_array);
+
+	// bright part at the first level, then each level from the one above
+	profiler.begin_gpu("bloom threshold");
+	glUseProgram(programs[THRESHOLD]);
+	glUniform1f(glGetUniformLocation(programs[THRESHOLD], "threshold"), threshold);
+	glUniform1f(glGetUniformLocation(programs[THRESHOLD], "spread"), scale / 4.0f);
+	draw(THRESHOLD, color, &chain[0], 0);
+	profiler.end_gpu();
+
+	for (uint l = 0; l < levels; l++)	// downsampling and blur of each level
+	{
+		profiler.begin_gpu(blur_names[l]);
+		if (l > 0) draw(DOWNSAMPLE, chain[l - 1].texture[0], &chain[l], 0);
+		glUseProgram(programs[BLUR]);
+		GLint uloc = glGetUniformLocation(programs[BLUR], "direction");
+		glUniform2f(uloc, 1.0f / chain[l].size.x, 0.0f);
+		draw(BLUR, chain[l].texture[0], &chain[l], 1);
+		glUniform2f(uloc, 0.0f, 1.0f / chain[l].size.y);
+		draw(BLUR, chain[l].texture[1], &chain[l], 0);
+		profiler.end_gpu();
+	}
+
+	// wider levels are added to the narrower ones, from the smallest up
+	profiler.begin_gpu("bloom upsample");
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	for (uint l = levels - 1; l > 0; l--) draw(UPSAMPLE, chain[l].texture[0], &chain[l - 1], 0);
+	glDisable(GL_BLEND);
+	profiler.end_gpu();
+
+	profiler.begin_gpu("tone map");
+	glUseProgram(programs[TONEMAP]);
+	glUniform1f(glGetUniformLocation(programs[TONEMAP], "strength"), strength);
+	glUniform1f(glGetUniformLocation(programs[TONEMAP], "exposure"), exposure);
+	glUniform1f(glGetUniformLocation(programs[TONEMAP], "knee"), knee);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, chain[0].texture[0]);
+	draw(TONEMAP, color, nullptr, 0);
+	glActiveTexture(GL_TEXTURE0);
+	profiler.end_gpu();
+
+	glEnable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+}
+
+inline void hdr_t::destroy_targets()
+{
+	if (fbo) glDeleteFramebuffers(1, &fbo);
+	if (color) glDeleteTextures(1, &color);
+	if (depth_buffer) glDeleteRenderbuffers(1, &depth_buffer);
+	fbo = color = depth_buffer = 0;
+	for (level_t& l : chain)
+	{
+		glDeleteFramebuffers(2, l.fbo);
+		glDeleteTextures(2, l.texture);
+		l = level_t();
+	}
+	size = ivec2(0, 0);
+}
+
+inline void hdr_t::destroy()
+{
+	destroy_targets();
+	for (GLuint& p : programs) { if (p) glDeleteProgram(p); p = 0; }
+	if (vertex_array) glDeleteVertexArrays(1, &vertex_array);
+	vertex_array = 0;
+}
+
+#endif // __HDR_H__
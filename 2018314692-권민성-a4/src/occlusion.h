@@ -0,0 +1,146 @@
+#pragma once
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+#include "frustum.h"
+#include "simd_math.h"
+
+//*************************************
+// GPU occlusion culling with conditional rendering; the draw path never reads a query back
+// - occluders (catalog option "occluder", e.g., the Sun and the gas giants) are drawn first
+// - every other visible body then draws its bounding cube into a GL_ANY_SAMPLES_PASSED query
+//   with color and depth writes off, and its draw is wrapped in glBeginConditionalRender(GL_QUERY_NO_WAIT):
+//   the GPU skips it when the cube is hidden, or draws it anyway when the result is not ready yet
+// - a cube that contains the eye or crosses the near plane cannot be tested; such a body is drawn as is
+// - results are read back a frame later, and only when available, for the statistics
+struct occlusion_culler_t
+{
+	bool				enabled = true;
+	GLuint				program = 0;
+	GLuint				vertex_array = 0, vertex_buffer = 0, index_buffer = 0;
+	std::vector<GLuint>	queries;			// per body; 0 = not queried this frame
+	std::vector<GLuint>	pool;				// query objects, created on demand
+	std::vector<uint>	issued;				// bodies queried in the current frame
+	uint				occluded = 0;		// bodies found hidden among the last collected queries
+	uint64_t			total_queries = 0, total_occluded = 0;
+
+	mat4				view_projection;
+	vec3				eye;
+	float				dnear = 1.0f;
+
+	bool	create(program_cache_t& cache, const char* vert_path, const char* frag_path, uint body_count);
+	void	begin_queries(const mat4& view_matrix, const mat4& projection_matrix, float near_plane);
+	void	query(uint k, vec3 center, float radius);
+	void	end_queries();
+	void	begin_draw(uint k) const { if (queries[k]) glBeginConditionalRender(queries[k], GL_QUERY_NO_WAIT); }
+	void	end_draw(uint k) const { if (queries[k]) glEndConditionalRender(); }
+	void	collect();						// statistics of the last frame's queries that are ready
+	void	print_stats() const;
+	void	destroy();
+};
+
+inline bool occlusion_culler_t::create(program_cache_t& cache, const char* vert_path, const char* frag_path, uint body_count)
+{
+	if (!(program = cache.create_program(vert_path, frag_path))) return false;
+
+	// unit cube around the origin; it encloses the unit sphere
+	const vec3 corners[8] = { vec3(-1,-1,-1), vec3(1,-1,-1), vec3(-1,1,-1), vec3(1,1,-1), vec3(-1,-1,1), vec3(1,-1,1), vec3(-1,1,1), vec3(1,1,1) };
+	const uint indices[36] = { 0,2,1, 1,2,3, 4,5,6, 5,7,6, 0,1,4, 1,5,4, 2,6,3, 3,6,7, 0,4,2, 2,4,6, 1,3,5, 3,7,5 };
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glGenBuffers(1, &index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), nullptr);
+	glBindVertexArray(0);
+
+	queries.assign(body_count, 0);
+	return true;
+}
+
+inline void occlusion_culler_t::begin_queries(const mat4& view_matrix, const mat4& projection_matrix, float near_plane)
+{
+	collect();
+	for (uint k : issued) queries[k] = 0;
+	issued.clear();
+	if (!enabled) return;
+
+	view_projection = projection_matrix * view_matrix;
+	eye = frustum_culler_t::eye_of(view_matrix);
+	dnear = near_plane;
+
+	glUseProgram(program);
+	glBindVertexArray(vertex_array);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+}
+
+inline void occlusion_culler_t::query(uint k, vec3 center, float radius)
+{
+	if (!enabled) return;
+	vec3 d = center - eye;
+	if (sqrtf(d.x * d.x + d.y * d.y + d.z * d.z) <= radius * 1.7321f + dnear) return;	// the cube may reach the eye or the near plane
+
+	if (issued.size() == pool.size()) { GLuint q; glGenQueries(1, &q); pool.push_back(q); }
+	GLuint q = pool[issued.size()];
+	queries[k] = q;
+	issued.push_back(k);
+
+	const simd_math_t& m = simd_math();
+	mat4 mvp = m.mul(m.mul(view_projection, mat4::translate(center)), mat4::scale(radius));
+	glUniformMatrix4fv(glGetUniformLocation(program, "mvp"), 1, GL_TRUE, mvp);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, q);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+}
+
+inline void occlusion_culler_t::end_queries()
+{
+	if (!enabled) return;
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_CULL_FACE);
+	glBindVertexArray(0);
+}
+
+inline void occlusion_culler_t::collect()
+{
+	if (issued.empty()) return;
+	GLint available = 0;
+	glGetQueryObjectiv(queries[issued.back()], GL_QUERY_RESULT_AVAILABLE, &available);	// results become available in order
+	if (!available) return;
+	occluded = 0;
+	for (uint k : issued)
+	{
+		GLuint passed = 1; glGetQueryObjectuiv(queries[k], GL_QUERY_RESULT, &passed);
+		if (!passed) occluded++;
+	}
+	total_queries += issued.size();
+	total_occluded += occluded;
+}
+
+inline void occlusion_culler_t::print_stats() const
+{
+	if (!total_queries) { printf("[occlusion] no queries\n"); return; }
+	printf("[occlusion] %llu queries, %.1f%% of the queried bodies hidden\n", (unsigned long long) total_queries, 100.0 * total_occluded / total_queries);
+}
+
+inline void occlusion_culler_t::destroy()
+{
+	if (!pool.empty()) glDeleteQueries(GLsizei(pool.size()), pool.data());
+	pool.clear(); issued.clear();
+	if (vertex_array) glDeleteVertexArrays(1, &vertex_array);
+	GLuint buffers[] = { vertex_buffer, index_buffer };
+	glDeleteBuffers(2, buffers);
+	if (program) glDeleteProgram(program);
+	vertex_array = vertex_buffer = index_buffer = program = 0;
+}
+
+#endif // __OCCLUSION_H__
@@ -0,0 +1,179 @@
+#pragma once
+#ifndef __SHADOW_H__
+#define __SHADOW_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+#include "simd_math.h"
+
+//*************************************
+// omnidirectional shadow map of the point light (the Sun) in one depth cube map
+// - the casters are drawn once into all six faces: shadow.geom emits each triangle to the layers in a per-draw face mask
+// - the faces store the distance from the light over range (not the projected depth), so that the shading of any
+//   variant compares length(p - light) with one lookup of a comparison sampler (PCF by the linear filter)
+// - a face is drawn again only when the bounding spheres of the casters that overlap it have changed by more than
+//   a fraction of a texel since it was last drawn; a sphere's shadow does not change as it spins about itself
+// - front faces are culled: the casters are closed spheres, so a receiver never compares against its own lit side
+struct shadow_map_t
+{
+	struct caster_t { uint index; vec4 sphere; };	// center and radius at the last draw of a face
+
+	bool	enabled = true;
+	GLuint	program = 0;
+	GLuint	texture = 0;					// GL_TEXTURE_CUBE_MAP, 24-bit depth with comparison
+	GLuint	fbo = 0;						// layered: the six faces
+	GLuint	face_fbos[6] = {};				// one face each, to clear only the faces that are drawn
+	uint	size = 1024;					// of a face in texels
+	float	range = 1.0f;					// stored depth = distance / range
+	vec3	light = vec3(0, 0, 0);
+	std::vector<caster_t>	rendered[6];	// casters of each face at its last draw
+	std::vector<uint>		masks;			// this frame: faces to draw for each caster
+	std::vector<caster_t>	current;
+	GLint	scene_fbo = 0, viewport[4] = {}, polygon_mode[2] = {};
+	uint	frames = 0, face_draws = 0, caster_draws = 0;
+
+	bool	create(program_cache_t& cache, const char* vert_path, const char* geom_path, const char* frag_path, uint face_size, float light_range);
+	uint	begin(vec3 light_position, const std::vector<vec4>& spheres);	// returns the faces to draw; 0: nothing changed
+	void	draw(uint k, const affine3x4& model_matrix, GLsizei index_count);	// caster k from the bound vertex array
+	void	end();
+	void	invalidate() { for (auto& r : rendered) r.assign(1, caster_t{ ~0u, vec4(0) }); }	// draws all faces next time
+	void	print_stats() const;
+	void	destroy();
+	static bool	overlaps(uint face, vec3 d, float r);	// sphere at d from the light against the pyramid of a face
+};
+
+inline bool shadow_map_t::create(program_cache_t& cache, const char* vert_path, const char* geom_path, const char* frag_path, uint face_size, float light_range)
+{
+	size = face_size; range = light_range;
+	if (!(program = cache.create_program(vert_path, frag_path, geom_path))) return false;
+
+	glGenTextures(1, &texture); if (!texture) { printf("%s(): failed in glGenTextures()\n", __func__); return false; }
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	for (GLenum f = 0; f < 6; f++) glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);	// PCF across the face edges
+
+	GLint binding = 0; glGetIntegerv(GL_FRAMEBUFFER_BINDING, &binding);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+	glDrawBuffer(GL_NONE); glReadBuffer(GL_NONE);
+	bool b_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glGenFramebuffers(6, face_fbos);
+	for (GLenum f = 0; f < 6; f++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, face_fbos[f]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, texture, 0);
+		glDrawBuffer(GL_NONE); glReadBuffer(GL_NONE);
+		b_complete = b_complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glClear(GL_DEPTH_BUFFER_BIT);	// no casters yet: nothing in shadow
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, binding);
+	if (!b_complete) { printf("%s(): incomplete shadow framebuffer; shadows disabled\n", __func__); destroy(); enabled = false; return true; }
+	printf("> shadow map: %ux%u cube (%.1f MB), range %g\n", size, size, 6.0 * size * size * 4 / 1048576.0, range);
+	return true;
+}
+
+inline bool shadow_map_t::overlaps(uint face, vec3 d, float r)
+{
+	// the face looks along +-axis a; its four side planes are at 45 degrees: s*d[a] >= |d[b]| for the other axes b
+	float v[3] = { d.x, d.y, d.z };
+	uint a = face / 2;
+	float u = (face & 1) ? -v[a] : v[a], slack = r * 1.41421356f;
+	return u - fabsf(v[(a + 1) % 3]) >= -slack && u - fabsf(v[(a + 2) % 3]) >= -slack;
+}
+
+inline uint shadow_map_t::begin(vec3 light_position, const std::vector<vec4>& spheres)
+{
+	masks.assign(spheres.size(), 0);
+	if (!enabled || !program) return 0;
+	if (light_position.x != light.x || light_position.y != light.y || light_position.z != light.z) { light = light_position; invalidate(); }
+
+	// a face is dirty when its list of overlapping casters differs or one of them moved by more than a quarter texel
+	float tolerance = 0.25f * 2.0f / float(size);	// angle of a quarter texel at the center of a face
+	uint dirty = 0;
+	for (uint f = 0; f < 6; f++)
+	{
+		current.clear();
+		for (uint k = 0; k < spheres.size(); k++)
+		{
+			vec3 d = vec3(spheres[k].x, spheres[k].y, spheres[k].z) - light;
+			if (d.length() - spheres[k].w < range && overlaps(f, d, spheres[k].w)) { current.push_back({ k, spheres[k] }); masks[k] |= 1u << f; }
+		}
+		bool b_dirty = current.size() != rendered[f].size();
+		for (uint i = 0; i < current.size() && !b_dirty; i++)
+		{
+			const vec4 &a = current[i].sphere, &b = rendered[f][i].sphere;
+			vec3 moved = vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+			float distance = (vec3(a.x, a.y, a.z) - light).length();
+			b_dirty = current[i].index != rendered[f][i].index || a.w != b.w || moved.length() > tolerance * distance;
+		}
+		if (b_dirty) { dirty |= 1u << f; rendered[f].swap(current); }
+	}
+	for (uint& m : masks) m &= dirty;
+	frames++;
+	if (!dirty) return 0;
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &scene_fbo);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	for (uint f = 0; f < 6; f++) if (dirty & (1u << f)) { glBindFramebuffer(GL_FRAMEBUFFER, face_fbos[f]); glClear(GL_DEPTH_BUFFER_BIT); face_draws++; }
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, size, size);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	// also in the wireframe mode
+	glCullFace(GL_FRONT);
+
+	// faces in the order of the cube map layers (+x, -x, +y, -y, +z, -z) with the GL cube map orientations
+	static const vec3 dirs[6] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+	static const vec3 ups[6] = { vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0) };
+	const simd_math_t& m = simd_math();
+	mat4 projection = m.perspective(PI / 2.0f, 1.0f, range * 1e-3f, range);
+	mat4 views[6], matrices[6]; for (uint f = 0; f < 6; f++) views[f] = m.look_at(light, light + dirs[f], ups[f]);
+	m.mul_batch(projection, views, matrices, 6);
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "face_matrices"), 6, GL_TRUE, matrices[0]);
+	glUniform3f(glGetUniformLocation(program, "light_position"), light.x, light.y, light.z);
+	glUniform1f(glGetUniformLocation(program, "range"), range);
+	return dirty;
+}
+
+inline void shadow_map_t::draw(uint k, const affine3x4& model_matrix, GLsizei index_count)
+{
+	if (!masks[k]) return;
+	glUniformMatrix4x3fv(glGetUniformLocation(program, "model_matrix"), 1, GL_TRUE, model_matrix);
+	glUniform1ui(glGetUniformLocation(program, "faces"), masks[k]);
+	glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr);
+	caster_draws++;
+}
+
+inline void shadow_map_t::end()
+{
+	glCullFace(GL_BACK);
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);	// core profiles only take both sides
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+inline void shadow_map_t::print_stats() const
+{
+	if (!frames) return;
+	printf("[shadows] %ux%u cube: %u frames, %u face draws (%.2f per frame), %u caster draws\n", size, size, frames, face_draws, face_draws / double(frames), caster_draws);
+}
+
+inline void shadow_map_t::destroy()
+{
+	if (fbo) glDeleteFramebuffers(1, &fbo);
+	if (face_fbos[0]) glDeleteFramebuffers(6, face_fbos);
+	if (texture) glDeleteTextures(1, &texture);
+	if (program) glDeleteProgram(program);
+	fbo = texture = program = 0;
+	for (GLuint& f : face_fbos) f = 0;
+}
+
+#endif // __SHADOW_H__
@@ -0,0 +1,386 @@
+#pragma once
+#ifndef __SOFT_RASTER_H__
+#define __SOFT_RASTER_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define SOFT_RASTER_SSE
+#endif
+
+//*************************************
+// multithreaded tile-based software rasterizer for the bodies: deterministic frames without a GPU
+// - end() transforms the queued draws on the calling thread (clip-space near-plane clipping, back-face culling)
+//   and bins each triangle into the 64x64-pixel tiles its bounding box touches
+// - the threads of a worker_pool_t take whole tiles from an atomic counter; a tile walks its bin in submission order,
+//   so the image does not depend on the thread count
+// - edge functions and the depth test run on 4 pixels at a time (SSE, or a plain loop elsewhere);
+//   attributes are interpolated perspective-correct and shaded as phong() and the UNLIT path of transform.frag,
+//   with bilinear texture lookups (no mipmaps, normal maps or shadows)
+// - present() uploads the image and blits it into the bound framebuffer, so --headless dumps it as usual
+struct soft_rasterizer_t
+{
+	static const int TILE = 64;
+	struct vertex_t { vec3 pos, norm; vec2 tex; };
+	struct texture_t	// RGBA8; rows in the order of the GL upload; also read by ray_tracer.h
+	{
+		int		width = 0, height = 0;
+		std::vector<uint32_t>	texels;
+		vec4	sample(vec2 tc) const;		// bilinear, clamped to the edges as the textures of create_texture()
+	};
+	struct draw_t { mat4 model; int texture; bool unlit; };
+	struct clip_vertex_t { vec4 clip; vec3 epos, norm; vec2 tex; };
+	struct triangle_t
+	{
+		float	x[3], y[3], z[3], w[3];		// window coordinates, depth in [0,1] and 1/w
+		vec3	epos[3], norm[3];
+		vec2	tex[3];
+		int		x0, y0, x1, y1;				// pixel bounds, inclusive
+		int		texture;
+		bool	unlit;
+	};
+	struct lighting_t { vec4 position, Ia, Id, Is, Ka, Ks; float shininess; };	// light_t and material_t of main.cpp
+
+	std::vector<vertex_t>	vertices;		// the mesh of every draw
+	std::vector<uint>		indices;
+	std::vector<texture_t>	textures;
+	std::vector<draw_t>		draws;			// of the current frame
+	std::vector<triangle_t>	triangles;
+	std::vector<std::vector<uint>>	bins;	// triangle indices per tile
+	std::vector<uint32_t>	color;			// bottom-up rows of stride pixels, as glReadPixels
+	std::vector<float>		depth;
+	ivec2	size = ivec2(0, 0);
+	int		stride = 0, tiles_x = 0, tiles_y = 0;
+	mat4	view_matrix, projection_matrix;
+	lighting_t	lighting;
+	uint32_t	clear_color = 0;
+
+	worker_pool_t		pool;
+	std::atomic<uint>	next_tile{ 0 };
+
+	// GL side of present()
+	GLuint	texture = 0, read_fbo = 0;
+	ivec2	texture_size = ivec2(0, 0);
+
+	// statistics
+	uint		frames = 0;
+	uint64_t	submitted = 0, rasterized = 0;	// triangles before and after clipping and culling
+	std::atomic<uint64_t>	shaded{ 0 };		// pixels that passed the depth test
+	double		setup_us = 0.0, raster_us = 0.0;
+
+	bool	create(uint thread_count = 0);		// 0: one per hardware thread, the calling thread included
+	template <class V> void set_mesh(const std::vector<V>& v, const std::vector<uint>& i);	// V has pos, norm and tex
+	int		add_texture(const image* i);		// returns the index for draw()
+	void	begin(ivec2 viewport_size, const mat4& view, const mat4& projection, const lighting_t& l, vec4 background);
+	void	draw(const mat4& model, int texture_index, bool b_unlit) { draws.push_back({ model, texture_index, b_unlit }); }
+	void	end(profiler_t& profiler);		// setup and the tiles, in a CPU scope each
+	void	present();
+	void	print_stats() const;
+	void	destroy();
+
+	void	setup(const draw_t& d);
+	void	emit(const clip_vertex_t& a, const clip_vertex_t& b, const clip_vertex_t& c, const draw_t& d);
+	void	work();								// tiles until none are left
+	void	raster_tile(uint tile);
+	vec4	shade(const triangle_t& t, float b0, float b1, float b2) const;
+	static uint32_t	pack(vec4 c);
+};
+
+inline bool soft_rasterizer_t::create(uint thread_count)
+{
+	pool.create(thread_count);
+	glGenTextures(1, &texture);
+	glGenFramebuffers(1, &read_fbo);
+	printf("> software rasterizer: %u threads, %dx%d tiles, %s edge functions\n", pool.thread_count(), TILE, TILE,
+#if defined(SOFT_RASTER_SSE)
+		"SSE");
+#else
+		"scalar");
+#endif
+	return texture && read_fbo;
+}
+
+template <class V> inline void soft_rasterizer_t::set_mesh(const std::vector<V>& v, const std::vector<uint>& i)
+{
+	vertices.resize(v.size());
+	for (size_t k = 0; k < v.size(); k++) vertices[k] = { v[k].pos, v[k].norm, v[k].tex };
+	indices = i;
+}
+
+inline int soft_rasterizer_t::add_texture(const image* i)
+{
+	texture_t t; t.width = i->width; t.height = i->height;
+	t.texels.resize(size_t(t.width) * t.height);
+	for (size_t k = 0; k < t.texels.size(); k++)
+	{
+		const unsigned char* p = i->ptr + k * i->channels;
+		uint32_t r = p[0], g = i->channels >= 3 ? p[1] : r, b = i->channels >= 3 ? p[2] : r, a = i->channels == 4 ? p[3] : 255;	// grayscale replicated as the swizzle of create_texture()
+		t.texels[k] = r | (g << 8) | (b << 16) | (a << 24);
+	}
+	textures.emplace_back(std::move(t));
+	return int(textures.size()) - 1;
+}
+
+inline void soft_rasterizer_t::begin(ivec2 viewport_size, const mat4& view, const mat4& projection, const lighting_t& l, vec4 background)
+{
+	if (viewport_size.x != size.x || viewport_size.y != size.y)
+	{
+		size = viewport_size;
+		tiles_x = (size.x + TILE - 1) / TILE; tiles_y = (size.y + TILE - 1) / TILE;
+		stride = tiles_x * TILE;	// whole tiles, so that the 4-pixel steps never leave the buffer
+		color.resize(size_t(stride) * tiles_y * TILE);
+		depth.resize(color.size());
+		bins.resize(size_t(tiles_x) * tiles_y);
+	}
+	view_matrix = view; projection_matrix = projection; lighting = l;
+	clear_color = pack(background);
+	draws.clear();
+	triangles.clear();
+	for (auto& b : bins) b.clear();
+}
+
+inline void soft_rasterizer_t::end(profiler_t& profiler)
+{
+	double t0 = profiler.now();
+	{
+		profile_scope_t scope(profiler, "raster setup");
+		for (const draw_t& d : draws) setup(d);
+	}
+	double t1 = profiler.now();
+	{
+		profile_scope_t scope(profiler, "raster tiles");
+		next_tile = 0;
+		pool.run([this]() { work(); });
+	}
+	setup_us += t1 - t0;
+	raster_us += profiler.now() - t1;
+	frames++;
+}
+
+// vertex stage, near-plane clipping, culling and binning of one draw
+inline void soft_rasterizer_t::setup(const draw_t& d)
+{
+	mat4 model_view = view_matrix * d.model;
+	mat3 normal_matrix = mat3(model_view[0], model_view[1], model_view[2], model_view[4], model_view[5], model_view[6], model_view[8], model_view[9], model_view[10]);
+	std::vector<clip_vertex_t> cv(vertices.size());
+	for (size_t k = 0; k < vertices.size(); k++)
+	{
+		const vertex_t& v = vertices[k];
+		vec4 e = model_view * vec4(v.pos.x, v.pos.y, v.pos.z, 1.0f);
+		cv[k] = { projection_matrix * e, vec3(e.x, e.y, e.z), (normal_matrix * v.norm).normalize(), v.tex };
+	}
+	auto lerp = [](const clip_vertex_t& a, const clip_vertex_t& b, float t) -> clip_vertex_t
+	{
+		return { a.clip + (b.clip - a.clip) * t, a.epos + (b.epos - a.epos) * t, a.norm + (b.norm - a.norm) * t, a.tex + (b.tex - a.tex) * t };
+	};
+	for (size_t k = 0; k + 2 < indices.size(); k += 3)
+	{
+		submitted++;
+		const clip_vertex_t* v[3] = { &cv[indices[k]], &cv[indices[k + 1]], &cv[indices[k + 2]] };
+		float dist[3]; int inside = 0;	// to the near plane z = -w
+		for (int j = 0; j < 3; j++) { dist[j] = v[j]->clip.z + v[j]->clip.w; inside += dist[j] >= 0.0f; }
+		if (inside == 3) { emit(*v[0], *v[1], *v[2], d); continue; }
+		if (inside == 0) continue;
+
+		// Sutherland-Hodgman against the one plane: a triangle or a quad
+		clip_vertex_t poly[4]; int n = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			int i = (j + 1) % 3;
+			if (dist[j] >= 0.0f) poly[n++] = *v[j];
+			if ((dist[j] >= 0.0f) != (dist[i] >= 0.0f)) poly[n++] = lerp(*v[j], *v[i], dist[j] / (dist[j] - dist[i]));
+		}
+		for (int j = 1; j + 1 < n; j++) emit(poly[0], poly[j], poly[j + 1], d);
+	}
+}
+
+inline void soft_rasterizer_t::emit(const clip_vertex_t& a, const clip_vertex_t& b, const clip_vertex_t& c, const draw_t& d)
+{
+	triangle_t t;
+	const clip_vertex_t* v[3] = { &a, &b, &c };
+	for (int j = 0; j < 3; j++)
+	{
+		float w = 1.0f / std::max(v[j]->clip.w, 1e-6f);
+		t.x[j] = (v[j]->clip.x * w * 0.5f + 0.5f) * size.x;
+		t.y[j] = (v[j]->clip.y * w * 0.5f + 0.5f) * size.y;
+		t.z[j] = v[j]->clip.z * w * 0.5f + 0.5f;
+		t.w[j] = w;
+		t.epos[j] = v[j]->epos; t.norm[j] = v[j]->norm; t.tex[j] = v[j]->tex;
+	}
+	float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+	if (area <= 0.0f) return;	// back-facing (counter-clockwise is front, as GL_CCW) or degenerate
+
+	// pixels whose centers may be inside
+	t.x0 = std::max(int(floorf(std::min({ t.x[0], t.x[1], t.x[2] }) - 0.5f)), 0);
+	t.y0 = std::max(int(floorf(std::min({ t.y[0], t.y[1], t.y[2] }) - 0.5f)), 0);
+	t.x1 = std::min(int(ceilf(std::max({ t.x[0], t.x[1], t.x[2] }) - 0.5f)), size.x - 1);
+	t.y1 = std::min(int(ceilf(std::max({ t.y[0], t.y[1], t.y[2] }) - 0.5f)), size.y - 1);
+	if (t.x0 > t.x1 || t.y0 > t.y1) return;
+	t.texture = d.texture; t.unlit = d.unlit;
+
+	uint index = uint(triangles.size());
+	triangles.push_back(t);
+	rasterized++;
+	for (int ty = t.y0 / TILE; ty <= t.y1 / TILE; ty++)
+		for (int tx = t.x0 / TILE; tx <= t.x1 / TILE; tx++) bins[size_t(ty) * tiles_x + tx].push_back(index);
+}
+
+inline void soft_rasterizer_t::work()
+{
+	uint tile_count = uint(bins.size());
+	for (uint tile; (tile = next_tile.fetch_add(1)) < tile_count;) raster_tile(tile);
+}
+
+inline void soft_rasterizer_t::raster_tile(uint tile)
+{
+	int tx = int(tile % tiles_x) * TILE, ty = int(tile / tiles_x) * TILE;
+	for (int y = ty; y < ty + TILE; y++)
+	{
+		std::fill_n(&color[size_t(y) * stride + tx], TILE, clear_color);
+		std::fill_n(&depth[size_t(y) * stride + tx], TILE, 1.0f);
+	}
+
+	uint64_t count = 0;
+	for (uint index : bins[tile])
+	{
+		const triangle_t& t = triangles[index];
+		int x0 = std::max(t.x0, tx) & ~3, x1 = std::min(t.x1, tx + TILE - 1), y0 = std::max(t.y0, ty), y1 = std::min(t.y1, ty + TILE - 1);
+
+		// edge functions e_k(p) = a_k*px + b_k*py + c_k, positive inside; e_k weighs vertex k
+		float a[3], b[3], c[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int i = (k + 1) % 3, j = (k + 2) % 3;
+			a[k] = t.y[i] - t.y[j]; b[k] = t.x[j] - t.x[i]; c[k] = t.x[i] * t.y[j] - t.x[j] * t.y[i];
+		}
+		float inv_area = 1.0f / (c[0] + c[1] + c[2]);	// the three edge functions sum to twice the area everywhere
+		float dz1 = t.z[1] - t.z[0], dz2 = t.z[2] - t.z[0];
+
+		for (int y = y0; y <= y1; y++)
+		{
+			float py = y + 0.5f;
+			float* zrow = &depth[size_t(y) * stride];
+			uint32_t* crow = &color[size_t(y) * stride];
+			for (int x = x0; x <= x1; x += 4)
+			{
+				float e[3][4], z[4]; int mask = 0;
+#if defined(SOFT_RASTER_SSE)
+				__m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3, 2, 1, 0)), pyv = _mm_set1_ps(py);
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				__m128 ev[3];
+				for (int k = 0; k < 3; k++)
+				{
+					ev[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[k]), px), _mm_mul_ps(_mm_set1_ps(b[k]), pyv)), _mm_set1_ps(c[k]));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(ev[k], _mm_setzero_ps()));
+					_mm_storeu_ps(e[k], ev[k]);
+				}
+				if (!_mm_movemask_ps(inside)) continue;
+				__m128 zv = _mm_add_ps(_mm_set1_ps(t.z[0]), _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ev[1], _mm_set1_ps(dz1)), _mm_mul_ps(ev[2], _mm_set1_ps(dz2))), _mm_set1_ps(inv_area)));
+				inside = _mm_and_ps(inside, _mm_cmplt_ps(zv, _mm_loadu_ps(zrow + x)));	// GL_LESS
+				mask = _mm_movemask_ps(inside);
+				_mm_storeu_ps(z, zv);
+#else
+				for (int l = 0; l < 4; l++)
+				{
+					float px = x + l + 0.5f;
+					bool b_in = true;
+					for (int k = 0; k < 3; k++) { e[k][l] = a[k] * px + b[k] * py + c[k]; b_in = b_in && e[k][l] >= 0.0f; }
+					z[l] = t.z[0] + (e[1][l] * dz1 + e[2][l] * dz2) * inv_area;
+					if (b_in && z[l] < zrow[x + l]) mask |= 1 << l;
+				}
+#endif
+				for (int l = 0; l < 4; l++)
+				{
+					if (!(mask & (1 << l)) || x + l > x1) continue;
+					zrow[x + l] = z[l];
+					crow[x + l] = pack(shade(t, e[0][l], e[1][l], e[2][l]));
+					count++;
+				}
+			}
+		}
+	}
+	shaded += count;
+}
+
+// perspective-correct attributes at screen-space weights b0..b2, lit as in transform.frag
+inline vec4 soft_rasterizer_t::shade(const triangle_t& t, float b0, float b1, float b2) const
+{
+	float w0 = b0 * t.w[0], w1 = b1 * t.w[1], w2 = b2 * t.w[2], s = 1.0f / (w0 + w1 + w2);
+	w0 *= s; w1 *= s; w2 *= s;
+	vec2 tc = t.tex[0] * w0 + t.tex[1] * w1 + t.tex[2] * w2;
+	vec4 albedo = t.texture < 0 ? vec4(1.0f, 1.0f, 1.0f, 1.0f) : textures[t.texture].sample(tc);
+	if (t.unlit) return albedo;
+
+	vec3 p = t.epos[0] * w0 + t.epos[1] * w1 + t.epos[2] * w2;
+	vec3 n = (t.norm[0] * w0 + t.norm[1] * w1 + t.norm[2] * w2).normalize();
+	vec4 lpos = view_matrix * lighting.position;
+	vec3 l = (vec3(lpos.x, lpos.y, lpos.z) - (lpos.w == 0.0f ? vec3(0.0f) : p)).normalize();
+	vec3 v = (vec3(0.0f) - p).normalize();
+	vec3 h = (l + v).normalize();
+	auto clamp0 = [](vec4 c) { return vec4(std::max(c.x, 0.0f), std::max(c.y, 0.0f), std::max(c.z, 0.0f), std::max(c.w, 0.0f)); };
+	vec4 Ira = lighting.Ka * lighting.Ia;
+	vec4 Ird = clamp0(albedo * lighting.Id * l.dot(n));
+	vec4 Irs = clamp0(lighting.Ks * lighting.Is * powf(std::max(h.dot(n), 0.0f), lighting.shininess));	// GLSL pow() of a negative base is undefined
+	return Ira + Ird + Irs;
+}
+
+inline vec4 soft_rasterizer_t::texture_t::sample(vec2 tc) const
+{
+	float fx = std::min(std::max(tc.x, 0.0f), 1.0f) * width - 0.5f, fy = std::min(std::max(tc.y, 0.0f), 1.0f) * height - 0.5f;
+	int x0 = int(floorf(fx)), y0 = int(floorf(fy));
+	float ax = fx - x0, ay = fy - y0;
+	int xa = std::min(std::max(x0, 0), width - 1), xb = std::min(std::max(x0 + 1, 0), width - 1);
+	int ya = std::min(std::max(y0, 0), height - 1), yb = std::min(std::max(y0 + 1, 0), height - 1);
+	auto texel = [&](int x, int y) { uint32_t c = texels[size_t(y) * width + x]; return vec4(float(c & 255), float((c >> 8) & 255), float((c >> 16) & 255), float(c >> 24)); };
+	vec4 c = (texel(xa, ya) * (1 - ax) + texel(xb, ya) * ax) * (1 - ay) + (texel(xa, yb) * (1 - ax) + texel(xb, yb) * ax) * ay;
+	return c / 255.0f;
+}
+
+inline uint32_t soft_rasterizer_t::pack(vec4 c)
+{
+	auto u8 = [](float f) { return uint32_t(std::min(std::max(f, 0.0f), 1.0f) * 255.0f + 0.5f); };
+	return u8(c.x) | (u8(c.y) << 8) | (u8(c.z) << 16) | (u8(c.w) << 24);
+}
+
+inline void soft_rasterizer_t::present()
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+	if (texture_size.x != size.x || texture_size.y != size.y)
+	{
+		texture_size = size;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, color.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, color.data());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	GLint draw_fbo = 0; glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, draw_fbo);
+}
+
+inline void soft_rasterizer_t::print_stats() const
+{
+	if (!frames) return;
+	printf("[software] %u frames: %.1f triangles submitted, %.1f rasterized, %.2f Mpixels shaded per frame\n", frames, submitted / double(frames), rasterized / double(frames), shaded.load() / 1e6 / frames);
+	printf("[software] setup %.3f ms/frame, tiles %.3f ms/frame on %u threads\n", setup_us / frames / 1000.0, raster_us / frames / 1000.0, pool.thread_count());
+}
+
+inline void soft_rasterizer_t::destroy()
+{
+	pool.destroy();
+	if (texture) glDeleteTextures(1, &texture);
+	if (read_fbo) glDeleteFramebuffers(1, &read_fbo);
+	texture = read_fbo = 0;
+	texture_size = ivec2(0, 0);
+}
+
+#endif // __SOFT_RASTER_H__
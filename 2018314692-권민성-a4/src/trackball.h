@@ -2,82 +2,239 @@
 #ifndef __TRACKBALL_H__
 #define __TRACKBALL_H__
 #include "cgmath.h"
+#include <algorithm>
+#include <cmath>
 
+//*************************************
+// unit quaternion of a rotation: (x,y,z) = axis * sin(angle/2), w = cos(angle/2)
+// - a product is 16 multiplies against the 27 of mat3*mat3, and the result is orthonormal again after a normalize()
+struct quaternion
+{
+	float	x = 0, y = 0, z = 0, w = 1;
+
+	quaternion() = default;
+	quaternion(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+
+	quaternion	operator*(const quaternion& b) const { return quaternion(w * b.x + x * b.w + y * b.z - z * b.y, w * b.y - x * b.z + y * b.w + z * b.x, w * b.z + x * b.y - y * b.x + z * b.w, w * b.w - x * b.x - y * b.y - z * b.z); }
+	quaternion	conjugate() const { return quaternion(-x, -y, -z, w); }
+	float		dot(const quaternion& b) const { return x * b.x + y * b.y + z * b.z + w * b.w; }
+	quaternion	normalize() const { float s = 1.0f / sqrtf(dot(*this)); return quaternion(x * s, y * s, z * s, w * s); }
+	vec3		rotate(const vec3& v) const;	// q v q^-1
+	float		angle() const { return 2.0f * atan2f(sqrtf(x * x + y * y + z * z), fabsf(w)); }	// of the shorter way
+
+	static quaternion	between(const vec3& a, const vec3& b);		// the shortest rotation from the unit a to the unit b
+	static quaternion	exp(const vec3& r);							// the rotation of |r| radians around r
+	static quaternion	from_rows(const vec3& r0, const vec3& r1, const vec3& r2);	// of an orthonormal matrix
+	static quaternion	nlerp(const quaternion& a, const quaternion& b, float t);	// the shorter way; unit
+};
+
+inline vec3 quaternion::rotate(const vec3& v) const
+{
+	vec3 u = vec3(x, y, z), c = u.cross(v) * 2.0f;	// v + w c + u x c
+	return v + c * w + u.cross(c);
+}
+
+// (a x b, 1 + a.b) is twice the half-angle rotation, so no trigonometry is needed
+inline quaternion quaternion::between(const vec3& a, const vec3& b)
+{
+	vec3 c = a.cross(b);
+	return quaternion(c.x, c.y, c.z, 1.0f + a.dot(b)).normalize();
+}
+
+inline quaternion quaternion::exp(const vec3& r)
+{
+	float t = r.length();
+	if (t < 1e-8f) return quaternion();
+	float s = sinf(t * 0.5f) / t;
+	return quaternion(r.x * s, r.y * s, r.z * s, cosf(t * 0.5f));
+}
+
+inline quaternion quaternion::from_rows(const vec3& r0, const vec3& r1, const vec3& r2)
+{
+	float m00 = r0.x, m11 = r1.y, m22 = r2.z, trace = m00 + m11 + m22;
+	quaternion q;
+	if (trace > 0) { float s = 0.5f / sqrtf(trace + 1.0f); q = quaternion((r2.y - r1.z) * s, (r0.z - r2.x) * s, (r1.x - r0.y) * s, 0.25f / s); }
+	else if (m00 > m11 && m00 > m22) { float s = 2.0f * sqrtf(1.0f + m00 - m11 - m22); q = quaternion(0.25f * s, (r0.y + r1.x) / s, (r0.z + r2.x) / s, (r2.y - r1.z) / s); }
+	else if (m11 > m22) { float s = 2.0f * sqrtf(1.0f + m11 - m00 - m22); q = quaternion((r0.y + r1.x) / s, 0.25f * s, (r1.z + r2.y) / s, (r0.z - r2.x) / s); }
+	else { float s = 2.0f * sqrtf(1.0f + m22 - m00 - m11); q = quaternion((r0.z + r2.x) / s, (r1.z + r2.y) / s, 0.25f * s, (r1.x - r0.y) / s); }
+	return q.normalize();
+}
+
+inline quaternion quaternion::nlerp(const quaternion& a, const quaternion& b, float t)
+{
+	float s = a.dot(b) < 0 ? -t : t;	// q and -q are the same rotation
+	return quaternion(a.x + (b.x * s - a.x * t), a.y + (b.y * s - a.y * t), a.z + (b.z * s - a.z * t), a.w + (b.w * s - a.w * t)).normalize();
+}
+
+//*************************************
+// orbit camera: view = T(0,0,-distance) * R(rotation) * T(-target)
+// - an event composes one quaternion with the state at begin(); the view matrix is built once per frame by view_matrix()
+// - the events move a goal state, which the shown state follows with a time constant of smoothing seconds;
+//   a drag released in motion keeps spinning and slows down with a time constant of inertia seconds
+// - rotation is renormalized every RENORMALIZE compositions, so the view stays orthonormal however long it is used
+// - rotation takes the world to the eye, so a drag of the eye-space trackball composes on the left
+// - a drag orbits target, which panning moves along with the eye; zooming keeps distance above min_distance
 struct trackball
 {
+	struct state_t
+	{
+		quaternion	rotation;
+		vec3		target = vec3(0, 0, 0);	// the point of the world that is orbited, at (0,0,-distance) in the eye space
+		float		distance = 1.0f;
+	};
+	static const uint RENORMALIZE = 64;
+
 	bool	b_tracking = false;		// code 0
 	bool	b_panning = false;		// code 1
 	bool	b_zooming = false;		// code 2
-	float	scale;			// controls how much rotation is applied
-	float	mv_scale=3.3f;		// scale for panning and zooming
-	mat4	view_matrix0;	// initial view matrix
-	vec2	m0;				// the last mouse position
+	bool	b_moving = false;		// the shown state has not reached the goal, or it is spinning
+	float	scale;					// controls how much rotation is applied
+	float	mv_scale = 3.3f;		// scale for panning and zooming
+	float	min_distance = 0.01f;	// zooming stops short of the target instead of passing through it and flipping the view
+	float	smoothing = 0.04f;		// seconds; 0 follows the mouse at once
+	float	inertia = 0.4f;			// seconds; 0 stops with the mouse
+	state_t	shown, goal, state0;	// state0: the goal at begin()
+	vec3	velocity = vec3(0, 0, 0);	// eye-space rotation vector per second
+	vec2	m0;						// the mouse position at begin()
+	double	time = 0, event_time = 0;	// of the last advance() and update()
+	uint	compositions = 0;
 
 	trackball(float rot_scale = 1.0f) : scale(rot_scale) {}
 	bool is_tracking() const { return b_tracking; }
 	bool is_panning() const { return b_panning; }
 	bool is_zooming() const { return b_zooming; }
-	void begin(const mat4& view_matrix, vec2 m, int code);
-	void end(int code);
-	mat4 update(vec2 m, int code) const;
+	void set(vec3 eye, vec3 at, vec3 up);	// as mat4::look_at(); stops any motion
+	void begin(vec2 m, int code, double t);
+	void end(int code, double t);
+	void update(vec2 m, int code, double t);
+	bool advance(double t);					// once a frame; false while the shown state stays the same
+	mat4 view_matrix() const;
+	void compose(const quaternion& q);		// goal.rotation = q * goal.rotation
 };
 
-inline void trackball::begin(const mat4& view_matrix, vec2 m, int code)
+inline void trackball::set(vec3 eye, vec3 at, vec3 up)
+{
+	vec3 n = (eye - at).normalize(), u = up.cross(n).normalize(), v = n.cross(u);	// the rows of look_at()
+	goal.rotation = quaternion::from_rows(u, v, n);
+	goal.target = at;
+	goal.distance = (eye - at).length();
+	shown = state0 = goal;
+	velocity = vec3(0, 0, 0);
+	b_moving = false;
+}
+
+inline void trackball::begin(vec2 m, int code, double t)
 {
 	if (code == 0) b_tracking = true;			// enable trackball tracking
 	else if (code == 1) b_panning = true;
 	else b_zooming = true;
 	m0 = m;						// save current mouse position
-	view_matrix0 = view_matrix;	// save current view matrix
+	state0 = goal;				// save current camera
+	velocity = vec3(0, 0, 0);	// grabbing stops a spin
+	if (!b_moving) time = t;	// the shown state waited since the last advance()
+	event_time = t;
 }
-inline void trackball::end(int code)
+
+inline void trackball::end(int code, double t)
 {
-	if (code == 0) b_tracking = false;			
+	if (code == 0) b_tracking = false;
 	else if (code == 1) b_panning = false;
 	else b_zooming = false;
+	if (code == 0 && t - event_time > 0.05) velocity = vec3(0, 0, 0);	// held still before the release
 }
 
-inline mat4 trackball::update(vec2 m, int code) const
+inline void trackball::update(vec2 m, int code, double t)
 {
+	if (!b_moving) time = t;
+	float dt = float(t - event_time);
+	event_time = t;
+	vec3 p1 = vec3(m - m0, 0);					// displacement
 	if (code == 0)
 	{
 		// project a 2D mouse position to a unit sphere
 		static const vec3 p0 = vec3(0, 0, 1.0f);	// reference position on sphere
-		vec3 p1 = vec3(m - m0, 0);					// displacement
-		if (!b_tracking || length(p1) < 0.0001f) return view_matrix0;		// ignore subtle movement
-		p1 *= scale;														// apply rotation scale
-		p1 = vec3(p1.x, p1.y, sqrtf(std::max(0.0f, 1.0f - length2(p1)))).normalize();	// back-project z=0 onto the unit sphere
-
-		// find rotation axis and angle in world space
-		// - trackball self-rotation should be done at first in the world space
-		// - mat3(view_matrix0): rotation-only view matrix
-		// - mat3(view_matrix0).transpose(): inverse view-to-world matrix
-		vec3 v = mat3(view_matrix0).transpose() * p0.cross(p1);
-		float theta = asin(std::min(v.length(), 1.0f));
-
-		// resulting view matrix, which first applies
-		// trackball rotation in the world space
-		return view_matrix0 * mat4::rotate(v.normalize(), theta);
+		if (!b_tracking) return;
+		quaternion previous = goal.rotation;
+		goal.rotation = state0.rotation;
+		if (length(p1) >= 0.0001f)				// ignore subtle movement
+		{
+			p1 *= scale;														// apply rotation scale
+			p1 = vec3(p1.x, p1.y, sqrtf(std::max(0.0f, 1.0f - length2(p1)))).normalize();	// back-project z=0 onto the unit sphere
+			compose(quaternion::between(p0, p1));	// in the eye space, so on the left of the world-to-eye rotation
+		}
+
+		// the spin of the release: the last steps, averaged over about 50 ms
+		if (dt > 1e-4f)
+		{
+			quaternion d = goal.rotation * previous.conjugate();
+			if (d.w < 0) d = quaternion(-d.x, -d.y, -d.z, -d.w);
+			vec3 r = vec3(d.x, d.y, d.z), step = r.length() > 1e-8f ? r.normalize() * (d.angle() / dt) : vec3(0, 0, 0);
+			velocity = velocity + (step - velocity) * (1.0f - expf(-dt / 0.05f));
+		}
 	}
 	else if (code == 1)
 	{
-		vec3 p1 = vec3(m - m0, 0);
-		if (!b_panning || length(p1) < 0.0001f) return view_matrix0;
-		p1 = p1 * mat4::scale(3.3f);
-		vec3 v = mat3(view_matrix0).transpose() * p1;
-		return view_matrix0 * mat4::translate(v);
+		if (!b_panning) return;
+		goal.target = state0.target - state0.rotation.conjugate().rotate(p1 * mv_scale);	// the eye-space offset, back in the world
+	}
+	else
+	{
+		if (!b_zooming) return;
+		goal.distance = std::max(min_distance, state0.distance + p1.y * mv_scale);
+	}
+}
+
+inline bool trackball::advance(double t)
+{
+	float dt = float(std::max(0.0, std::min(t - time, 0.1)));	// no jump after a stall
+	time = t;
+
+	// inertia: the goal keeps the spin of the release, decaying
+	if (!b_tracking)
+	{
+		if (inertia > 0 && length(velocity) > 0.01f)
+		{
+			compose(quaternion::exp(velocity * dt));
+			velocity = velocity * expf(-dt / inertia);
+		}
+		else velocity = vec3(0, 0, 0);
 	}
+
+	// smoothing: the shown state follows the goal exponentially, and snaps to it when close
+	float k = smoothing > 0 ? 1.0f - expf(-dt / smoothing) : 1.0f;
+	vec3 dp = goal.target - shown.target;
+	float dd = goal.distance - shown.distance;
+	bool b_close = 1.0f - fabsf(shown.rotation.dot(goal.rotation)) < 1e-10f && length(dp) < 1e-5f * std::max(1.0f, fabsf(goal.distance)) && fabsf(dd) < 1e-5f * std::max(1.0f, fabsf(goal.distance));
+	bool b_changed = b_moving;
+	if (k >= 1.0f || b_close) shown = goal;
 	else
 	{
-		vec3 p1 = vec3(m - m0, 0);
-		if (!b_zooming || length(p1) < 0.0001f) return view_matrix0;
-		p1.z = -p1.y;
-		p1.x = p1.y = 0;
-		p1 = p1 * mat4::scale(3.3f);
-
-		vec3 v = mat3(view_matrix0).transpose() * p1;
-		return view_matrix0 * mat4::translate(v);
+		shown.rotation = quaternion::nlerp(shown.rotation, goal.rotation, k);
+		shown.target = shown.target + dp * k;
+		shown.distance = shown.distance + dd * k;
 	}
+	b_moving = !b_close || (!b_tracking && length(velocity) > 0);
+	return b_changed || b_moving;
+}
+
+inline mat4 trackball::view_matrix() const
+{
+	const quaternion& q = shown.rotation;
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z, xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z, wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	vec3 r0 = vec3(1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy));
+	vec3 r1 = vec3(2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx));
+	vec3 r2 = vec3(2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy));
+	const vec3& p = shown.target;
+	return mat4(r0.x, r0.y, r0.z, -r0.dot(p),
+		r1.x, r1.y, r1.z, -r1.dot(p),
+		r2.x, r2.y, r2.z, -r2.dot(p) - shown.distance,
+		0, 0, 0, 1);
+}
+
+inline void trackball::compose(const quaternion& q)
+{
+	goal.rotation = q * goal.rotation;
+	if (++compositions % RENORMALIZE == 0) goal.rotation = goal.rotation.normalize();	// rounding drifts |q| away from 1
 }
 
 // utility function
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+#include "cgmath.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//*************************************
+// persistent worker threads of the CPU renderers (soft_raster.h, ray_tracer.h)
+// - run() calls the job on every worker and on the calling thread, and returns when all of them have;
+//   jobs split their work themselves (e.g., tiles from an atomic counter)
+// - the workers sleep on a condition variable between runs
+struct worker_pool_t
+{
+	std::vector<std::thread>	workers;
+	std::mutex					mutex;
+	std::condition_variable		cv_start, cv_done;
+	std::function<void()>		job;
+	uint						generation = 0, busy = 0;
+	bool						b_quit = false;
+
+	uint	thread_count() const { return uint(workers.size()) + 1; }
+	void	create(uint count = 0);			// 0: one per hardware thread, the calling thread included
+	void	run(const std::function<void()>& f);
+	void	destroy();
+};
+
+inline void worker_pool_t::create(uint count)
+{
+	if (!count) count = std::max(1u, std::thread::hardware_concurrency());
+	for (uint k = 1; k < count; k++)
+	{
+		workers.emplace_back([this]()
+		{
+			uint seen = 0;
+			for (;;)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv_start.wait(lock, [&]() { return b_quit || generation != seen; });
+				if (b_quit) return;
+				seen = generation;
+				lock.unlock();
+				job();
+				lock.lock();
+				if (--busy == 0) cv_done.notify_one();
+			}
+		});
+	}
+}
+
+inline void worker_pool_t::run(const std::function<void()>& f)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = f;
+		busy = uint(workers.size());
+		generation++;
+	}
+	cv_start.notify_all();
+	f();
+	std::unique_lock<std::mutex> lock(mutex);
+	cv_done.wait(lock, [&]() { return busy == 0; });
+}
+
+inline void worker_pool_t::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		b_quit = true;
+	}
+	cv_start.notify_all();
+	for (auto& w : workers) w.join();
+	workers.clear();
+	b_quit = false;
+}
+
+#endif // __WORKER_POOL_H__
@@ -7,7 +7,7 @@ struct circle_t
 	vec2	center=vec2(0);		// 2D position for translation
 	float	radius;				// radius
 	vec4	color;				// RGBA color in [0,1]
-	mat4	model_matrix;		// modeling transformation
+	affine3x4	model_matrix;	// modeling transformation; the bottom row (0,0,0,1) is implied
 	vec2	velocity=vec2(0);			// ӵ
 	float	mass;
 	float	circle_time = 0.0f;
@@ -67,31 +67,28 @@ inline void circle_t::update(std::vector<circle_t>& circles, int circle_cnt, flo
 	center += velocity/interval;		
 
 	// these transformations will be explained in later transformation lecture
-	mat4 scale_matrix =
+	affine3x4 scale_matrix =
 	{
 		radius, 0, 0, 0,
 		0, radius, 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1
+		0, 0, 1, 0
 	};
 
-	mat4 rotation_matrix =
+	affine3x4 rotation_matrix =
 	{
 		1, 0, 0, 0,
 		0, 1, 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1
+		0, 0, 1, 0
 	};
 
-	mat4 translate_matrix =
+	affine3x4 translate_matrix =
 	{
 		1, 0, 0, center.x,
 		0, 1, 0, center.y,
-		0, 0, 1, 0,
-		0, 0, 0, 1
+		0, 0, 1, 0
 	};
 	
-	model_matrix = translate_matrix*rotation_matrix*scale_matrix;
+	model_matrix = simd_math().compose(simd_math().compose(translate_matrix, rotation_matrix), scale_matrix);
 }
 
 inline void circle_t::collision(std::vector<circle_t>& circles, int circle_cnt) {
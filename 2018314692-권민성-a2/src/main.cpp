@@ -1,5 +1,9 @@
 #include "cgmath.h"		// slee's simple math library
 #include "cgut.h"		// slee's OpenGL utility
+#include "profiler.h"	// CPU/GPU frame profiler
+#include "frame_pacer.h"	// frame scheduler
+#include "program_cache.h"	// program binaries cached on disk
+#include "headless.h"		// --headless: offscreen benchmark
 
 //*************************************
 // global constants
@@ -23,19 +27,33 @@ struct camera
 	mat4	projection_matrix;
 };
 
+// everything that changes the image of a paused simulation; drawn again only when it differs
+struct view_state_t
+{
+	float	t;
+	mat4	view_matrix;
+	ivec2	window_size;
+	int		wireframe;
+	int		fc;
+};
+
 //*************************************
 // window objects
 GLFWwindow*	window = nullptr;
 ivec2		window_size = cg_default_window_size(); // initial window size
+headless_t	headless;	// --headless: offscreen rendering without a window
 
 //*************************************
 // OpenGL objects
 GLuint	program	= 0;	// ID holder for GPU program
+program_cache_t	program_cache;	// skips shader compilation on later runs
 GLuint	vertex_array = 0;	// ID holder for vertex array object
 
 //*************************************
 // global variables
 int		frame = 0;		// index of rendering frames
+profiler_t	profiler;	// F12 or exit dumps profile.json
+frame_pacer_t	pacer;	// 'v' cycles the frame pacing mode
 float	t, theta, pause_theta=0.0f;
 bool	rotate_flag = true;
 bool	b_wireframe = false;
@@ -53,6 +71,8 @@ std::vector<vertex>	unit_sphere_vertices;	// host-side vertices
 //*************************************
 void update()
 {
+	profile_scope_t scope(profiler, "update");
+
 	float aspect = window_size.x / float(window_size.y);
 	mat4 aspect_matrix = mat4::scale(std::min(1 / aspect, 1.0f), std::min(aspect, 1.0f), 1.0f);
 	mat4 view_projection_matrix = aspect_matrix * mat4{ 0,1,0,0,0,0,1,0,-1,0,0,1,0,0,0,1 };
@@ -72,6 +92,8 @@ void update()
 
 void render()
 {
+	profile_scope_t scope(profiler, "render");
+
 	// clear screen (with background color) and clear depth buffer
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 	
@@ -84,7 +106,7 @@ void render()
 	// render vertices: trigger shader programs to process vertex data
 
 	// configure transformation parameters
-	t = rotate_flag?float(glfwGetTime()):t;
+	t = rotate_flag?float(headless.enabled ? headless.time(frame) : glfwGetTime()):t;
 	theta = t * 0.5f;
 
 	// build the model matrix
@@ -97,11 +119,13 @@ void render()
 	GLint uloc = glGetUniformLocation(program, "model_matrix");
 	if(uloc> -1) glUniformMatrix4fv( uloc, 1, GL_TRUE, model_matrix );
 
+	profiler.begin_gpu( "sphere" );
 	glDrawElements( GL_TRIANGLES, 72*35*2*3, GL_UNSIGNED_INT, nullptr );
-	
+	profiler.end_gpu();
 
 	// swap front and back buffers, and display to screen
-	glfwSwapBuffers( window );
+	profile_scope_t swap_scope( profiler, "swap", true );
+	if(!headless.enabled) glfwSwapBuffers( window );
 }
 
 void reshape( GLFWwindow* window, int width, int height )
@@ -120,6 +144,8 @@ void print_help()
 	printf("- press 'w' to toggle wireframe\n");
 	printf("- press 'd' to toggle (tc.xy,0) > (tc.xxx) > (tc.yyy)\n");
 	printf("- press 'r' to rotate the sphere\n");
+	printf("- press F12 to dump the profile (profile.json)\n");
+	printf("- press 'v' to cycle frame pacing (vsync/adaptive/target fps/unlimited)\n");
 	printf( "\n" );
 }
 
@@ -182,6 +208,8 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 	{
 		if(key==GLFW_KEY_ESCAPE||key==GLFW_KEY_Q)	glfwSetWindowShouldClose( window, GL_TRUE );
 		else if(key==GLFW_KEY_H||key==GLFW_KEY_F1)	print_help();
+		else if(key==GLFW_KEY_F12)	profiler.dump();
+		else if(key==GLFW_KEY_V)	pacer.next_mode();
 		else if (key == GLFW_KEY_R)
 		{
 			rotate_flag = !rotate_flag;
@@ -208,6 +236,11 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 	}
 }
 
+void refresh( GLFWwindow* window )
+{
+	pacer.request_redraw();	// the window was exposed; the last frame has to be drawn again
+}
+
 void mouse( GLFWwindow* window, int button, int action, int mods )
 {
 	if(button==GLFW_MOUSE_BUTTON_LEFT&&action==GLFW_PRESS )
@@ -245,16 +278,42 @@ bool user_init()
 
 void user_finalize()
 {
+	profiler.dump();
+	program_cache.print_stats();
 }
 
 int main( int argc, char* argv[] )
 {
+	// headless benchmark: offscreen context, fixed time steps, no event loop
+	if(headless.parse( argc, argv ))
+	{
+		window_size = headless.size;
+		if(!headless.create()){ headless.destroy(); return 1; }
+		if(!(program=program_cache.create_program( vert_shader_path, frag_shader_path ))){ headless.destroy(); return 1; }
+		if(!user_init()){ printf( "Failed to user_init()\n" ); headless.destroy(); return 1; }
+
+		headless.begin();
+		for( frame=0; frame < headless.frames; frame++ )
+		{
+			profiler.begin_frame();
+			update();
+			render();
+			headless.end_frame( frame );
+			profiler.end_frame();
+		}
+		headless.report( headless.frames );
+
+		user_finalize();
+		headless.destroy();
+		return 0;
+	}
+
 	// create window and initialize OpenGL extensions
 	if(!(window = cg_create_window( window_name, window_size.x, window_size.y ))){ glfwTerminate(); return 1; }
 	if(!cg_init_extensions( window )){ glfwTerminate(); return 1; }	// version and extensions
 
 	// initializations and validations
-	if(!(program=cg_create_program( vert_shader_path, frag_shader_path ))){ glfwTerminate(); return 1; }	// create and compile shaders/program
+	if(!(program=program_cache.create_program( vert_shader_path, frag_shader_path ))){ glfwTerminate(); return 1; }	// create and compile shaders/program
 	if(!user_init()){ printf( "Failed to user_init()\n" ); glfwTerminate(); return 1; }					// user initialization
 
 	// register event callbacks
@@ -262,16 +321,28 @@ int main( int argc, char* argv[] )
     glfwSetKeyCallback( window, keyboard );			// callback for keyboard events
 	glfwSetMouseButtonCallback( window, mouse );	// callback for mouse click inputs
 	glfwSetCursorPosCallback( window, motion );		// callback for mouse movement
+	glfwSetWindowRefreshCallback( window, refresh );	// callback for window damage (e.g., uncovered)
+
+	// frame pacing: --vsync, --adaptive, --unlimited or --fps N
+	pacer.parse( argc, argv );
+	pacer.set_mode( pacer.mode );
 
 	// enters rendering/event loop
 	for( frame=0; !glfwWindowShouldClose(window); frame++ )
 	{
 		glfwPollEvents();	// polling and processing of events
+		view_state_t state = { t, cam.view_matrix, window_size, b_wireframe, fc };
+		bool b_dirty = pacer.changed( state ) || rotate_flag;
+		if(!pacer.begin_frame( b_dirty )) continue;	// nothing changed: the last frame stays on screen
+		profiler.begin_frame();
 		update();			// per-frame update
 		render();			// per-frame render
+		profiler.end_frame();
+		pacer.end_frame();	// sleeps until the next deadline in the target-fps mode
 	}
 
 	// normal termination
+	pacer.print_stats();
 	user_finalize();
 	cg_destroy_window(window);
 
@@ -2,12 +2,20 @@
 #include "cgut.h"		// slee's OpenGL utility
 #include "trackball.h"
 #include "sphere.h"
+#include "ringbuffer.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "frame_pacer.h"
+#include "frustum.h"
+#include "simd_math.h"
+#include "headless.h"
 
 //*************************************
 // global constants
 static const char* window_name = "Assignment 3: Moving planets - Minsung Kwon 2018314692";
 static const char* vert_shader_path = "shaders/transform.vert";
 static const char* frag_shader_path = "shaders/transform.frag";
+static const char* catalog_path = "catalog/solar-system.txt";
 
 //*************************************
 // common structures
@@ -25,21 +33,44 @@ struct camera
 	mat4	projection_matrix;
 };
 
+// per-object data in the std140 layout of object_block in the shaders
+struct object_t
+{
+	affine3x4	model_matrix;	// row_major mat4x3 in the shaders
+};
+
+// everything that changes the image of a paused simulation; drawn again only when it differs
+struct view_state_t
+{
+	float	theta;
+	mat4	view_matrix;
+	ivec2	window_size;
+	int		wireframe;
+	int		fc;
+};
+
 //*************************************
 // window objects
 GLFWwindow* window = nullptr;
 ivec2		window_size = cg_default_window_size(); // initial window size
+headless_t	headless;	// --headless: offscreen rendering without a window
 
 //*************************************
 // OpenGL objects
 GLuint	program = 0;	// ID holder for GPU program
+program_cache_t	program_cache;	// skips shader compilation on later runs
 GLuint	vertex_array = 0;	// ID holder for vertex array object
+ringbuffer_t	object_ring;	// per-object uniform blocks of the current frame
+frustum_culler_t	culler;	// bounding spheres of the bodies of the current frame
 
 //*************************************
 // global variables
 int		frame = 0;		// index of rendering frames
+profiler_t	profiler;	// CPU/GPU frame profiler; F12 or exit dumps profile.json
+frame_pacer_t	pacer;		// frame scheduler; 'v' cycles the pacing mode
 
-auto	spheres = std::move(create_spheres());
+catalog_t	catalog;	// bodies and their orbits, mapped from catalog/solar-system.bin
+std::vector<sphere_t>	spheres;
 
 float	theta, pause_theta = 0.0f;
 bool	b_wireframe = false;
@@ -66,12 +97,14 @@ std::vector<vertex>	unit_sphere_vertices;	// host-side vertices
 //*************************************
 void update()
 {
+	profile_scope_t scope(profiler, "update");
+
 	float aspect = window_size.x / float(window_size.y);
 	mat4 aspect_matrix = mat4::scale(std::min(1 / aspect, 1.0f), std::min(aspect, 1.0f), 1.0f);
 
 	// update projection matrix
 	cam.aspect = window_size.x / float(window_size.y);
-	cam.projection_matrix = mat4::perspective(cam.fovy, cam.aspect, cam.dnear, cam.dfar);
+	cam.projection_matrix = simd_math().perspective(cam.fovy, cam.aspect, cam.dnear, cam.dfar);
 
 	// update uniform variables in vertex/fragment shaders
 	GLint uloc;
@@ -83,31 +116,59 @@ void update()
 
 void render()
 {
+	profile_scope_t scope(profiler, "render");
+
 	// clear screen (with background color) and clear depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// notify GL that we use our own program
 	glUseProgram(program);
 
-	// bind vertex array object
-	glBindVertexArray(vertex_array);
+	theta = b_rotate ? float(headless.enabled ? headless.time(frame) : glfwGetTime()) : theta;
+	{
+		profile_scope_t physics_scope(profiler, "physics");
+		for (auto& s : spheres) s.update(theta, spheres);
+	}
 
+	// frustum culling of the bounding spheres
+	{
+		profile_scope_t cull_scope(profiler, "culling");
+		culler.clear();
+		for (auto& s : spheres) culler.add(frustum_culler_t::center_of(s.model_matrix), frustum_culler_t::scale_of(s.model_matrix));
+		uint visible = culler.cull(simd_math().mul(cam.projection_matrix, cam.view_matrix));
+		profiler.counter("visible objects", visible);
+		profiler.counter("culled objects", culler.count - visible);
+	}
 
-	// render vertices: trigger shader programs to process vertex data
-	theta = b_rotate ? float(glfwGetTime()) : theta;
-	for (auto& s : spheres)
+	// write the per-object data of the visible bodies in one linear pass
+	{ profile_scope_t wait_scope(profiler, "fence wait", true); object_ring.begin_frame(); }
+	std::vector<GLintptr> offsets(spheres.size());
+	for (uint k = 0; k < spheres.size(); k++)
 	{
-		s.update(theta, spheres);
+		if (!culler.visible(k)) continue;
+		offsets[k] = object_ring.alloc(sizeof(object_t));
+		if (offsets[k] < 0) continue;	// the ring is full: not drawn in this frame
+		((object_t*) object_ring.data(offsets[k]))->model_matrix = spheres[k].model_matrix;
+	}
+	object_ring.flush();
 
-		GLint uloc;
-		uloc = glGetUniformLocation(program, "model_matrix");
-		if (uloc > -1) glUniformMatrix4fv(uloc, 1, GL_TRUE, s.model_matrix);
+	// bind vertex array object
+	glBindVertexArray(vertex_array);
 
+	// render vertices: trigger shader programs to process vertex data
+	profiler.begin_gpu("spheres");
+	for (uint k = 0; k < spheres.size(); k++)
+	{
+		if (!culler.visible(k) || offsets[k] < 0) continue;
+		object_ring.bind_range(0, offsets[k], sizeof(object_t));
 		glDrawElements(GL_TRIANGLES, 72 * 36 * 2 * 3, GL_UNSIGNED_INT, nullptr);
 	}
+	profiler.end_gpu();
+	object_ring.end_frame();
 
 	// swap front and back buffers, and display to screen
-	glfwSwapBuffers(window);
+	profile_scope_t swap_scope(profiler, "swap", true);
+	if (!headless.enabled) glfwSwapBuffers(window);
 }
 
 void reshape(GLFWwindow* window, int width, int height)
@@ -125,7 +186,10 @@ void print_help()
 	printf("- press F1 or 'h' to see help\n");
 	printf("- press 'w' to toggle wireframe\n");
 	printf("- press Home to reset camera\n");
+	printf("- drag with the left button to orbit the target; ctrl+left or middle pans the target, shift+left or right zooms toward it\n");
 	printf("- press Pause to pause the simulation\n");
+	printf("- press F12 to dump the profile (profile.json)\n");
+	printf("- press 'v' to cycle frame pacing (vsync/adaptive/target fps/unlimited)\n");
 	printf("\n");
 }
 
@@ -197,6 +261,8 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 			if (b_rotate) glfwSetTime(pause_theta);
 			else pause_theta = theta;
 		}
+		else if (key == GLFW_KEY_F12)	profiler.dump();
+		else if (key == GLFW_KEY_V)		pacer.next_mode();
 		else if (key == GLFW_KEY_W)
 		{
 			b_wireframe = !b_wireframe;
@@ -217,7 +283,8 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 		else if (key == GLFW_KEY_LEFT_SHIFT) b_left_shift = true;
 		else if (key == GLFW_KEY_HOME)
 		{
-			cam.view_matrix = mat4::look_at(cam.eye, cam.at, cam.up);
+			cam.view_matrix = simd_math().look_at(cam.eye, cam.at, cam.up);
+			tb.set(cam.eye, cam.at, cam.up);
 		}
 	}
 	else if (action == GLFW_RELEASE)
@@ -227,30 +294,35 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 	}
 }
 
+void refresh(GLFWwindow* window)
+{
+	pacer.request_redraw();	// the window was exposed; the last frame has to be drawn again
+}
+
 void mouse(GLFWwindow* window, int button, int action, int mods)
 {
 	if (!b_left_control && !b_left_shift && button == GLFW_MOUSE_BUTTON_LEFT)
 	{
 		dvec2 pos; glfwGetCursorPos(window, &pos.x, &pos.y);
 		vec2 npos = cursor_to_ndc(pos, window_size);
-		if (action == GLFW_PRESS)			tb.begin(cam.view_matrix, npos, 0);
-		else if (action == GLFW_RELEASE)	tb.end(0);
+		if (action == GLFW_PRESS)			tb.begin(npos, 0, glfwGetTime());
+		else if (action == GLFW_RELEASE)	tb.end(0, glfwGetTime());
 	}
 	//panning
 	else if ((b_left_control && button == GLFW_MOUSE_BUTTON_LEFT) || button == GLFW_MOUSE_BUTTON_MIDDLE)	
 	{
 		dvec2 pos; glfwGetCursorPos(window, &pos.x, &pos.y);
 		vec2 npos = cursor_to_ndc(pos, window_size);
-		if (action == GLFW_PRESS) tb.begin(cam.view_matrix, npos, 1);
-		else if (action == GLFW_RELEASE) tb.end(1);
+		if (action == GLFW_PRESS) tb.begin(npos, 1, glfwGetTime());
+		else if (action == GLFW_RELEASE) tb.end(1, glfwGetTime());
 	}
 	//zooming
 	else if ((b_left_shift && button == GLFW_MOUSE_BUTTON_LEFT) || button == GLFW_MOUSE_BUTTON_RIGHT)	
 	{
 		dvec2 pos; glfwGetCursorPos(window, &pos.x, &pos.y);
 		vec2 npos = cursor_to_ndc(pos, window_size);
-		if (action == GLFW_PRESS) tb.begin(cam.view_matrix, npos, 2);
-		else if (action == GLFW_RELEASE) tb.end(2);
+		if (action == GLFW_PRESS) tb.begin(npos, 2, glfwGetTime());
+		else if (action == GLFW_RELEASE) tb.end(2, glfwGetTime());
 	}
 }
 
@@ -260,21 +332,21 @@ void motion(GLFWwindow* window, double x, double y)
 	if (tb.is_tracking())
 	{
 		vec2 npos = cursor_to_ndc(dvec2(x, y), window_size);
-		cam.view_matrix = tb.update(npos, 0);
+		tb.update(npos, 0, glfwGetTime());
 	}
 
 	// panning
 	if (tb.is_panning())
 	{
 		vec2 npos = cursor_to_ndc(dvec2(x, y), window_size);
-		cam.view_matrix = tb.update(npos, 1);
+		tb.update(npos, 1, glfwGetTime());
 	}
 
 	// zooming
 	if (tb.is_zooming())
 	{
 		vec2 npos = cursor_to_ndc(dvec2(x, y), window_size);
-		cam.view_matrix = tb.update(npos, 2);
+		tb.update(npos, 2, glfwGetTime());
 	}
 }
 
@@ -288,11 +360,21 @@ bool user_init()
 	glClearColor(39 / 255.0f, 40 / 255.0f, 34 / 255.0f, 1.0f);	// set clear color
 	glEnable(GL_CULL_FACE);								// turn on backface culling
 	glEnable(GL_DEPTH_TEST);								// turn on depth tests
+	tb.set(cam.eye, cam.at, cam.up);						// the trackball starts from the initial view
 
 	GLint uloc = glGetUniformLocation(program, "fc");
 	//glUseProgram(program);
 	glUniform1i(uloc, fc);
 
+	// bodies
+	if (!catalog.load(catalog_path)) return false;
+	spheres = create_spheres(catalog);
+
+	// per-object uniform block
+	GLuint block_index = glGetUniformBlockIndex(program, "object_block");
+	if (block_index != GL_INVALID_INDEX) glUniformBlockBinding(program, block_index, 0);
+	if (!object_ring.create(sizeof(object_t), uint(spheres.size()))) return false;
+
 	unit_sphere_vertices = std::move(create_sphere_vertices());
 
 	update_vertex_buffer(unit_sphere_vertices);
@@ -302,16 +384,49 @@ bool user_init()
 
 void user_finalize()
 {
+	profiler.dump();
+	program_cache.print_stats();
+	object_ring.print_stats();
+	object_ring.destroy();
+	culler.print_stats();
+	catalog.close();
 }
 
 int main(int argc, char* argv[])
 {
+	// --math-bench: the SIMD transforms of simd_math.h against cgmath.h, without a window
+	for (int k = 1; k < argc; k++) if (strcmp(argv[k], "--math-bench") == 0) return simd_math_bench() ? 0 : 1;
+
+	// headless benchmark: offscreen context, fixed time steps, no event loop
+	if (headless.parse(argc, argv))
+	{
+		window_size = headless.size;
+		if (!headless.create()) { headless.destroy(); return 1; }
+		if (!(program = program_cache.create_program(vert_shader_path, frag_shader_path))) { headless.destroy(); return 1; }
+		if (!user_init()) { printf("Failed to user_init()\n"); headless.destroy(); return 1; }
+
+		headless.begin();
+		for (frame = 0; frame < headless.frames; frame++)
+		{
+			profiler.begin_frame();
+			update();
+			render();
+			headless.end_frame(frame);
+			profiler.end_frame();
+		}
+		headless.report(headless.frames);
+
+		user_finalize();
+		headless.destroy();
+		return 0;
+	}
+
 	// create window and initialize OpenGL extensions
 	if (!(window = cg_create_window(window_name, window_size.x, window_size.y))) { glfwTerminate(); return 1; }
 	if (!cg_init_extensions(window)) { glfwTerminate(); return 1; }	// version and extensions
 
 	// initializations and validations
-	if (!(program = cg_create_program(vert_shader_path, frag_shader_path))) { glfwTerminate(); return 1; }	// create and compile shaders/program
+	if (!(program = program_cache.create_program(vert_shader_path, frag_shader_path))) { glfwTerminate(); return 1; }	// create and compile shaders/program
 	if (!user_init()) { printf("Failed to user_init()\n"); glfwTerminate(); return 1; }					// user initialization
 
 	// register event callbacks
@@ -319,16 +434,29 @@ int main(int argc, char* argv[])
 	glfwSetKeyCallback(window, keyboard);			// callback for keyboard events
 	glfwSetMouseButtonCallback(window, mouse);	// callback for mouse click inputs
 	glfwSetCursorPosCallback(window, motion);		// callback for mouse movement
+	glfwSetWindowRefreshCallback(window, refresh);	// callback for window damage (e.g., uncovered)
+
+	// frame pacing: --vsync (default), --adaptive, --unlimited or --fps N
+	pacer.parse(argc, argv);
+	pacer.set_mode(pacer.mode);
 
 	// enters rendering/event loop
 	for (frame = 0; !glfwWindowShouldClose(window); frame++)
 	{
 		glfwPollEvents();	// polling and processing of events
+		if (tb.advance(glfwGetTime())) cam.view_matrix = tb.view_matrix();	// the camera follows the mouse, smoothed, and coasts after a release
+		view_state_t state = { theta, cam.view_matrix, window_size, b_wireframe, fc };
+		bool b_dirty = pacer.changed(state) || b_rotate;
+		if (!pacer.begin_frame(b_dirty)) continue;	// nothing changed: the last frame stays on screen
+		profiler.begin_frame();
 		update();			// per-frame update
 		render();			// per-frame render
+		profiler.end_frame();
+		pacer.end_frame();	// sleeps until the next deadline in the target-fps mode
 	}
 
 	// normal termination
+	pacer.print_stats();
 	user_finalize();
 	cg_destroy_window(window);
 
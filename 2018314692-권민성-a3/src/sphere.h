@@ -1,4 +1,7 @@
 #pragma once
+#include "catalog.h"
+#include "simd_math.h"
+#include "affine.h"
 
 struct sphere_t
 {
@@ -6,47 +9,24 @@ struct sphere_t
 	float	dist_from_center;
 	float	rotate_scale;
 	float	revolve_scale;
-	mat4	model_matrix;
+	int		parent = -1;	// index into spheres; the model is relative to the parent's
+	affine3x4	model_matrix;	// the bottom row is (0,0,0,1); uploaded as 3x4
 
 	void	update(float theta, std::vector<sphere_t>& spheres);
 	void	set_attribute(float rad, float dist, float rot_s, float rev_s);
 	void	pause();
 };
 
-inline std::vector<sphere_t> create_spheres()
+// bodies of the catalog in its order; a parent always precedes its children
+inline std::vector<sphere_t> create_spheres(const catalog_t& catalog)
 {
-	std::vector<sphere_t> spheres;
-
-	sphere_t s;
-	// Sun
-	s.set_attribute(0.7f, 0.0f, 0.03f, 0.0f);
-	spheres.emplace_back(s);
-	// Mercury
-	s.set_attribute(0.08f, 1.2f, 1.2f, 2.1f);
-	spheres.emplace_back(s);
-	// Venus
-	s.set_attribute(0.1f, 1.7f, 0.8f, 1.2f);
-	spheres.emplace_back(s);
-	// Earth
-	s.set_attribute(0.21f, 2.4f, 0.6f, 0.83f);
-	spheres.emplace_back(s);
-	// Mars
-	s.set_attribute(0.18f, 3.0f, 0.27f, 0.355f);
-	spheres.emplace_back(s);
-	// Jupiter
-	s.set_attribute(0.38f, 5.1f, 0.15f, 0.262f);
-	spheres.emplace_back(s);
-	// Saturn
-	s.set_attribute(0.345f, 7.9f, 0.17f, 0.35f);
-	spheres.emplace_back(s);
-	// Uranus
-	s.set_attribute(0.25f, 8.8f, 0.12f, 0.34f);
-	spheres.emplace_back(s);
-	// Neptune
-	s.set_attribute(0.23f, 9.4f, 0.12f, 0.2f);
-	spheres.emplace_back(s);
-
-
+	std::vector<sphere_t> spheres(catalog.body_count);
+	for (uint k = 0; k < catalog.body_count; k++)
+	{
+		const catalog_t::body_t& b = catalog.bodies[k];
+		spheres[k].set_attribute(b.radius, b.distance, b.rotate, b.revolve);
+		spheres[k].parent = b.parent;
+	}
 	return spheres;
 }
 
@@ -55,8 +35,10 @@ inline void sphere_t::update(float theta, std::vector<sphere_t>& spheres)
 	float rotate_theta = theta * rotate_scale;
 	float revolve_theta = theta * revolve_scale;
 
-	mat4 scale_matrix = mat4::scale(radius);
-	model_matrix = mat4::rotate(vec3(0, 0, 1), revolve_theta) * mat4::translate(vec3(dist_from_center, 0, 0)) * mat4::rotate(vec3(0, 0, 1), rotate_theta) * scale_matrix;
+	affine3x4 scale_matrix = affine3x4::scale(radius);
+	const simd_math_t& m = simd_math();
+	model_matrix = m.compose(m.compose(m.compose(affine3x4::rotate(vec3(0, 0, 1), revolve_theta), affine3x4::translate(vec3(dist_from_center, 0, 0))), affine3x4::rotate(vec3(0, 0, 1), rotate_theta)), scale_matrix);
+	if (parent >= 0) model_matrix = m.compose(spheres[parent].model_matrix, model_matrix);
 }
 
 inline void	sphere_t::set_attribute(float rad, float dist, float rot_s, float rev_s)
@@ -0,0 +1,44 @@
+#ifdef GL_ES
+	precision mediump float;
+#endif
+
+// the stages of hdr.h, one per #define; every stage reads SOURCE at tc of the target
+// THRESHOLD: the part above the threshold luminance, averaged down to the first bloom level
+// DOWNSAMPLE: one bilinear tap averages 2x2 texels of the level above
+// BLUR: 9-tap Gaussian along direction, in 5 bilinear taps
+// UPSAMPLE: the level below, stretched by the bilinear filter and added by blending
+// TONEMAP: scene plus bloom, linear up to the knee and compressed towards 1 above it
+in vec2 tc;
+out vec4 fragColor;
+
+uniform sampler2D SOURCE;
+uniform sampler2D BLOOM;		// TONEMAP: the first bloom level
+uniform float	threshold;
+uniform float	spread;			// THRESHOLD: scale/4 texels, so that 4 bilinear taps cover scale x scale texels
+uniform vec2	direction;		// BLUR: one texel along x or y
+uniform float	strength, exposure, knee;
+
+float luminance( vec3 c ){ return dot(c,vec3(0.2126,0.7152,0.0722)); }
+
+void main()
+{
+#if defined(THRESHOLD)
+	vec2 d = spread/vec2(textureSize(SOURCE,0));
+	vec3 c = (texture(SOURCE,tc+vec2(-d.x,-d.y)).rgb + texture(SOURCE,tc+vec2(d.x,-d.y)).rgb
+			+ texture(SOURCE,tc+vec2(-d.x,d.y)).rgb + texture(SOURCE,tc+vec2(d.x,d.y)).rgb)*0.25;
+	float l = luminance(c);
+	fragColor = vec4(c*(max(l-threshold,0.0)/max(l,1e-4)),1);
+#elif defined(DOWNSAMPLE)||defined(UPSAMPLE)
+	fragColor = vec4(texture(SOURCE,tc).rgb,1);
+#elif defined(BLUR)
+	const float offsets[3] = float[3]( 0.0, 1.3846153846, 3.2307692308 );	// binomial weights of 9 taps, two texels per bilinear tap
+	const float weights[3] = float[3]( 0.2270270270, 0.3162162162, 0.0702702703 );
+	vec3 c = texture(SOURCE,tc).rgb*weights[0];
+	for(int k=1; k<3; k++) c += (texture(SOURCE,tc+direction*offsets[k]).rgb + texture(SOURCE,tc-direction*offsets[k]).rgb)*weights[k];
+	fragColor = vec4(c,1);
+#elif defined(TONEMAP)
+	vec3 c = (texture(SOURCE,tc).rgb + texture(BLOOM,tc).rgb*strength)*exposure;
+	vec3 over = max(c-knee,0.0);
+	fragColor = vec4(min(c,knee) + (1.0-knee)*(1.0-exp(-over/(1.0-knee))),1);
+#endif
+}
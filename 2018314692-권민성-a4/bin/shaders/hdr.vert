@@ -0,0 +1,9 @@
+// fullscreen triangle of the post passes (hdr.h, antialias.h); no vertex buffer
+out vec2 tc;
+
+void main()
+{
+	vec2 p = vec2((gl_VertexID<<1)&2,gl_VertexID&2);
+	tc = p;
+	gl_Position = vec4(p*2.0-1.0,0.0,1.0);
+}
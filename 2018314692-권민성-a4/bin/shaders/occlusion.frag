@@ -0,0 +1,11 @@
+#ifdef GL_ES
+	precision mediump float;
+#endif
+
+// color writes are masked off while the proxies are drawn
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = vec4(1.0);
+}
@@ -0,0 +1,18 @@
+#ifdef GL_ES
+	precision mediump float;
+#endif
+
+// weighted blended transparency: the average color of the translucent layers, blended by (1-revealage, revealage)
+uniform sampler2D ACCUMULATION;	// sum of the weighted premultiplied colors (rgb) and weights (a)
+uniform sampler2D REVEALAGE;	// product of (1-alpha)
+
+out vec4 fragColor;
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	float revealage = texelFetch( REVEALAGE, p, 0 ).r;
+	if(revealage>=1.0) discard;	// nothing translucent here
+	vec4 accumulation = texelFetch( ACCUMULATION, p, 0 );
+	fragColor = vec4( accumulation.rgb/max(accumulation.a,1e-5), revealage );
+}
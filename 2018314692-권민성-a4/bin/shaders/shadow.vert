@@ -0,0 +1,11 @@
+// casters of the shadow map (shadow.h): world positions for shadow.geom, which projects them to the cube faces
+layout(location=0) in vec3 position;
+
+uniform mat4x3 model_matrix;	// affine: the rows of the model matrix but the last
+
+out vec3 wpos;
+
+void main()
+{
+	wpos = model_matrix*vec4(position,1);
+}
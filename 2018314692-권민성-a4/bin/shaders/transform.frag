@@ -9,34 +9,99 @@
 in vec4 epos;
 in vec3 norm;
 in vec2 tc;
+#ifdef NORMAL_MAP
+in vec4 tang;	// eye-space tangent and handedness
+#endif
+#ifdef INDIRECT
+flat in uvec2 draw;	// texture layer, normal map layer of the body
+#endif
 
 
-// the only output variable
+// the only output variable; two targets with OIT and GBUFFER
+#ifdef OIT
+layout(location=0) out vec4 fragColor;	// weighted premultiplied color and weight
+layout(location=1) out vec4 revealage;	// r: alpha
+#elif defined(GBUFFER)
+layout(location=0) out vec4 fragColor;	// albedo; a: 1 for unlit surfaces
+layout(location=1) out vec4 gnormal;	// eye-space normal
+#else
 out vec4 fragColor;
+#endif
 
 // uniform variables
-uniform mat4	model_matrix;
 uniform mat4	view_matrix;
 uniform float	shininess;
 uniform vec4	light_position, Ia, Id, Is;	//light
 uniform vec4	Ka, Kd, Ks;					// material properties
+uniform samplerCubeShadow SHADOW;		// distance from the Sun to the nearest caster over shadow_range (shadow.h)
+uniform float	shadow_range;				// 0: no shadows
+uniform float	emission;					// brightness of unlit surfaces; above 1 only in HDR (hdr.h)
 
+// permutations: the application inserts one of these before compiling
+// NORMAL_MAP: planets with a normal map, RING: textured rings with alpha, UNLIT: the Sun, none: plain Phong
+// (ASTEROID only changes the vertex shader: instances are placed from per-instance orbits)
+// INDIRECT: bodies of a multi-draw (indirect.h), textured from the layers; combined with UNLIT or NORMAL_MAP per batch
+// OIT: translucent surfaces into the accumulation/revealage targets of oit.h instead of blending in order
+// GBUFFER: opaque surfaces into the G-buffer of deferred.h; deferred.comp lights them later
+#if defined(RING)
+flat in float layer;		// of the ring instance
+uniform sampler2DArray TEX1;	// ring colors, one layer per ring
+uniform sampler2DArray TEX2;	// ring alphas, one layer per ring
+#else
 uniform sampler2D TEX;	// texture sampler object
-uniform sampler2D TEX1;	// second texture sampler object (ring)
-uniform sampler2D TEX2; // third texture sampler object (alpha)
+#endif
+#if defined(NORMAL_MAP)&&!defined(INDIRECT)
 uniform sampler2D NORM;	// normal map
-uniform int idx;
+#endif
+#ifdef INDIRECT
+uniform sampler2DArray LAYERS;	// textures and normal maps of the bodies
+#endif
 
-vec4 phong( vec3 l, vec3 n, vec3 h, vec4 Kd )
+vec4 phong( vec3 l, vec3 n, vec3 h, vec4 Kd, float s )	// s: visibility of the light
 {
 	vec4 Ira = Ka*Ia;									// ambient reflection
 	vec4 Ird = max(Kd*dot(l,n)*Id,0.0);					// diffuse reflection
 	vec4 Irs = max(Ks*pow(dot(h,n),shininess)*Is,0.0);	// specular reflection
-	return Ira + Ird + Irs;
+	return Ira + Ird*s + Irs*s;
+}
+
+// visibility of the Sun from p (eye space): 0 behind another body, with 2x2 PCF from the comparison sampler
+float shadow( vec3 p, vec4 lpos )
+{
+	if(shadow_range<=0.0) return 1.0;
+	vec3 d = transpose(mat3(view_matrix))*(p-lpos.xyz);	// world-space direction from the Sun; the view is rigid
+	return texture( SHADOW, vec4(d,length(d)/shadow_range*0.998) );
+}
+
+#ifdef GBUFFER
+vec4 shade( vec3 l, vec3 n, vec3 h, vec4 Kd, float s ){ gnormal = vec4(n,0); return vec4(Kd.rgb,0); }	// deferred.comp looks up the shadow
+vec4 emit( vec4 c ){ gnormal = vec4(0); return vec4(c.rgb,1); }	// deferred.comp applies the emission
+#else
+vec4 shade( vec3 l, vec3 n, vec3 h, vec4 Kd, float s ){ return phong( l, n, h, Kd, s ); }
+vec4 emit( vec4 c ){ return vec4(c.rgb*emission,c.a); }
+#endif
+
+#ifdef NORMAL_MAP
+// TBN from the interpolated vertex frame; re-orthogonalize the tangent against n
+vec3 perturb( vec3 n, vec3 tnormal )
+{
+	tnormal = normalize(tnormal-0.5);
+	vec3 t = normalize(tang.xyz-n*dot(n,tang.xyz));
+	vec3 b = cross(n,t)*tang.w;
+	return normalize(mat3( t, b, n ) * tnormal);
 }
+#endif
 
 void main()
 {
+#ifdef INDIRECT
+	vec4 albedo = texture( LAYERS, vec3(tc,float(draw.x)) );
+#elif !defined(RING)
+	vec4 albedo = texture( TEX, tc );
+#endif
+#ifdef UNLIT
+	fragColor = emit( albedo );	// Sun
+#else
 	// light position in the eye space
 	vec4 lpos = view_matrix*light_position;
 	vec3 n = normalize(norm);	// norm interpolated via rasterizer should be normalized again here
@@ -44,29 +109,26 @@ void main()
 	vec3 l = normalize(lpos.xyz-(lpos.a==0.0?vec3(0):p));	// lpos.a==0 means directional light
 	vec3 v = normalize(-p);		// eye-epos = vec3(0)-epos
 	vec3 h = normalize(l+v);	// the halfway vector
-	vec4 iKd = texture( TEX, tc );	// Kd from image
-	
-
-	if (idx == 1 || idx == 2 || idx == 3 || idx == 4 || idx == 9)	// normal mapping
-	{
-		vec3 tnormal = texture( NORM, tc ).xyz;
-		tnormal = normalize(tnormal-0.5);
-		
-		vec3 c1 = cross(norm,vec3(0,0,1));
-		vec3 c2 = cross(norm,vec3(0,1,0));
-		vec3 tangent = normalize(length(c1)>length(c2)?c1:c2);
-		vec3 binormal = cross(norm, tangent);
-		mat3 tbn = mat3( tangent, binormal, norm );
-		vec3 world_space_bumped_normal = tbn * tnormal;
+	float s = shadow( p, lpos );
 
-		n = normalize(world_space_bumped_normal);
-		fragColor = phong( l, n, h, iKd );
-	}
-	else if(idx==-1){	// ring
-		vec4 iKd_ring = texture(TEX1, tc);
-		fragColor=phong(l, n, h, iKd_ring);
-		fragColor.a=texture(TEX2, tc).x;
-	}
-	else if(idx==0)	fragColor = iKd;	// Sun
-	else			fragColor = phong( l, n, h, iKd );
+#if defined(NORMAL_MAP)&&defined(INDIRECT)
+	n = perturb( n, texture( LAYERS, vec3(tc,float(draw.y)) ).xyz );
+	fragColor = shade( l, n, h, albedo, s );
+#elif defined(NORMAL_MAP)
+	n = perturb( n, texture( NORM, tc ).xyz );
+	fragColor = shade( l, n, h, albedo, s );
+#elif defined(RING)
+	fragColor = phong( l, n, h, texture( TEX1, vec3(tc,layer) ), s );
+	fragColor.a = texture( TEX2, vec3(tc,layer) ).x;
+#else
+	fragColor = shade( l, n, h, albedo, s );	// Kd from image
+#endif
+#endif
+#ifdef OIT
+	// weight by the view depth (McGuire and Bavoil 2013, eq. 10) so that near layers dominate without sorting
+	float a = fragColor.a;
+	float w = a*clamp(0.03/(1e-5+pow(abs(epos.z)/200.0,4.0)),1e-2,3e3);
+	revealage = vec4(a);
+	fragColor = vec4(fragColor.rgb*a,a)*w;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef __AFFINE_H__
+#define __AFFINE_H__
+#include "cgmath.h"
+#include <cstring>
+
+//*************************************
+// affine transform: the top three rows of a mat4, whose bottom row is always (0,0,0,1) and is not stored
+// - 48 bytes, laid out as a row_major mat4x3 of std140/std430 or three vec4 attributes, so it is uploaded as is
+// - compose (operator*) takes 36 multiplies against the 64 of mat4*mat4, summed in the same order,
+//   so a chain of them equals the chain of full products
+// - the builders take their values from the mat4 ones of cgmath.h, and a mat4 converts implicitly where one is needed
+struct affine3x4
+{
+	float	a[12];
+
+	affine3x4() { static const float i[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 }; memcpy(a, i, sizeof(a)); }
+	affine3x4(float a0, float a1, float a2, float a3, float a4, float a5, float a6, float a7, float a8, float a9, float a10, float a11)
+	{
+		a[0] = a0; a[1] = a1; a[2] = a2; a[3] = a3; a[4] = a4; a[5] = a5; a[6] = a6; a[7] = a7; a[8] = a8; a[9] = a9; a[10] = a10; a[11] = a11;
+	}
+	explicit affine3x4(const mat4& m) { memcpy(a, (const float*) m, sizeof(a)); }	// drops the bottom row
+
+	float&	operator[](int i) { return a[i]; }
+	float	operator[](int i) const { return a[i]; }
+	operator float*() { return a; }
+	operator const float*() const { return a; }
+	operator mat4() const { return mat4(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], 0, 0, 0, 1); }
+
+	affine3x4	operator*(const affine3x4& b) const;
+	vec4		operator*(const vec4& v) const { return vec4(a[0] * v.x + a[1] * v.y + a[2] * v.z + a[3] * v.w, a[4] * v.x + a[5] * v.y + a[6] * v.z + a[7] * v.w, a[8] * v.x + a[9] * v.y + a[10] * v.z + a[11] * v.w, v.w); }
+	vec3		point(const vec3& p) const { return vec3(a[0] * p.x + a[1] * p.y + a[2] * p.z + a[3], a[4] * p.x + a[5] * p.y + a[6] * p.z + a[7], a[8] * p.x + a[9] * p.y + a[10] * p.z + a[11]); }
+	vec3		vector(const vec3& v) const { return vec3(a[0] * v.x + a[1] * v.y + a[2] * v.z, a[4] * v.x + a[5] * v.y + a[6] * v.z, a[8] * v.x + a[9] * v.y + a[10] * v.z); }
+	affine3x4	inverse() const;
+
+	static affine3x4	translate(const vec3& v) { return affine3x4(mat4::translate(v)); }
+	static affine3x4	scale(float s) { return affine3x4(mat4::scale(s)); }
+	static affine3x4	rotate(const vec3& axis, float t) { return affine3x4(mat4::rotate(axis, t)); }
+};
+
+inline affine3x4 affine3x4::operator*(const affine3x4& b) const
+{
+	affine3x4 r;
+	for (int i = 0; i < 12; i += 4)
+	{
+		for (int j = 0; j < 3; j++) r.a[i + j] = a[i] * b.a[j] + a[i + 1] * b.a[4 + j] + a[i + 2] * b.a[8 + j];
+		r.a[i + 3] = a[i] * b.a[3] + a[i + 1] * b.a[7] + a[i + 2] * b.a[11] + a[i + 3];	// the bottom row of b picks the translation
+	}
+	return r;
+}
+
+// [L|t]^-1 = [L^-1|-L^-1 t], with L^-1 from the cofactors of L
+inline affine3x4 affine3x4::inverse() const
+{
+	float c0 = a[5] * a[10] - a[6] * a[9], c1 = a[6] * a[8] - a[4] * a[10], c2 = a[4] * a[9] - a[5] * a[8];
+	float det = a[0] * c0 + a[1] * c1 + a[2] * c2;
+	if (det == 0.0f) return affine3x4();
+	float d = 1.0f / det;
+	affine3x4 r(
+		c0 * d, (a[2] * a[9] - a[1] * a[10]) * d, (a[1] * a[6] - a[2] * a[5]) * d, 0,
+		c1 * d, (a[0] * a[10] - a[2] * a[8]) * d, (a[2] * a[4] - a[0] * a[6]) * d, 0,
+		c2 * d, (a[1] * a[8] - a[0] * a[9]) * d, (a[0] * a[5] - a[1] * a[4]) * d, 0);
+	vec3 t = r.vector(vec3(a[3], a[7], a[11]));
+	r.a[3] = -t.x; r.a[7] = -t.y; r.a[11] = -t.z;
+	return r;
+}
+
+#endif // __AFFINE_H__
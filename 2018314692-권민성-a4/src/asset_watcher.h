@@ -0,0 +1,206 @@
+#pragma once
+#ifndef __ASSET_WATCHER_H__
+#define __ASSET_WATCHER_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "profiler.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#if defined(__linux__)
+	#include <poll.h>
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+//*************************************
+// hot reload of shader and texture files
+// - a worker thread waits for inotify events on the asset directories (Linux) or polls mtimes (elsewhere)
+// - a changed texture is decoded on the worker; the GL thread only uploads it and swaps the handle
+// - a changed shader is reported as is; programs are rebuilt on the GL thread
+// - a4 watches the textures and transform.vert/frag only: deferred.comp, the bloom, FXAA and OIT shaders and the
+//   compute passes are compiled once by their modules and need a restart after an edit
+// - the worker wakes the event loop with glfwPostEmptyEvent(), so a paused scene reloads too
+struct asset_watcher_t
+{
+	enum kind_t { SHADER, TEXTURE };
+
+	struct asset_t
+	{
+		std::string	path;
+		kind_t		kind;
+		long long	mtime = 0;		// for the polling fallback; nanoseconds where stat() has them
+		long long	size = 0;
+	};
+
+	struct change_t
+	{
+		std::string	path;
+		kind_t		kind = SHADER;
+		image*		img = nullptr;	// decoded texture (owned by the receiver)
+		double		detected = 0.0;	// ms since start(), for the latency report
+		double		decode_ms = 0.0;
+	};
+
+	std::vector<asset_t>	assets;					// registered before start()
+	profiler_t*				profiler = nullptr;		// optional; decodes show up on the worker track
+	std::thread				worker;
+	std::mutex				mutex;
+	std::vector<change_t>	changes;				// ready for the GL thread
+	std::atomic<bool>		b_running{ false };
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	int						fd = -1;				// inotify descriptor; -1 falls back to polling
+	std::map<int, std::string> watch_dirs;			// inotify watch descriptor -> directory
+
+	void	add(const char* path, kind_t kind);
+	bool	start();
+	void	stop();
+	std::vector<change_t> take();					// GL thread: changes ready since the last call
+	double	now() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); }
+
+	void	run();									// worker thread
+	void	wait_inotify(std::set<std::string>& changed);
+	void	wait_polling(std::set<std::string>& changed);
+	static bool	stat_file(const std::string& path, long long& mtime, long long& size);
+	static std::string directory(const std::string& path) { size_t k = path.find_last_of("/\\"); return k == std::string::npos ? "." : path.substr(0, k); }
+};
+
+// whole seconds elsewhere: an edit that keeps the size within the second of the previous one is missed there
+inline bool asset_watcher_t::stat_file(const std::string& path, long long& mtime, long long& size)
+{
+	struct stat s; if (stat(path.c_str(), &s) != 0) return false;
+#if defined(__linux__)
+	mtime = (long long) s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+	mtime = (long long) s.st_mtimespec.tv_sec * 1000000000 + s.st_mtimespec.tv_nsec;
+#else
+	mtime = (long long) s.st_mtime * 1000000000;
+#endif
+	size = (long long) s.st_size;
+	return true;
+}
+
+inline void asset_watcher_t::add(const char* path, kind_t kind)
+{
+	for (auto& a : assets) if (a.path == path) return;
+	asset_t a; a.path = path; a.kind = kind;
+	stat_file(a.path, a.mtime, a.size);
+	assets.push_back(a);
+}
+
+inline bool asset_watcher_t::start()
+{
+	if (assets.empty() || b_running) return false;
+#if defined(__linux__)
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd >= 0)
+	{
+		std::set<std::string> dirs;
+		for (auto& a : assets) dirs.insert(directory(a.path));
+		for (auto& d : dirs)
+		{
+			int wd = inotify_add_watch(fd, d.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (wd < 0)
+			{
+				printf("%s(): unable to watch %s; polling instead\n", __func__, d.c_str());
+				close(fd); fd = -1; break;
+			}
+			watch_dirs[wd] = d;
+		}
+	}
+#endif
+	b_running = true;
+	worker = std::thread(&asset_watcher_t::run, this);
+	printf("> watching %d assets (%s)\n", int(assets.size()), fd >= 0 ? "inotify" : "mtime polling");
+	return true;
+}
+
+inline void asset_watcher_t::stop()
+{
+	if (!b_running) return;
+	b_running = false;
+	if (worker.joinable()) worker.join();
+#if defined(__linux__)
+	if (fd >= 0) { close(fd); fd = -1; }
+#endif
+	for (auto& c : changes) delete c.img;
+	changes.clear();
+}
+
+inline std::vector<asset_watcher_t::change_t> asset_watcher_t::take()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<change_t> v;
+	v.swap(changes);
+	return v;
+}
+
+inline void asset_watcher_t::wait_inotify(std::set<std::string>& changed)
+{
+#if defined(__linux__)
+	pollfd p = { fd, POLLIN, 0 };
+	if (poll(&p, 1, 100) <= 0) return;	// wakes up regularly to notice stop()
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t n;
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* ptr = buffer; ptr < buffer + n; )
+		{
+			const inotify_event* e = (const inotify_event*) ptr;
+			if (e->len && watch_dirs.count(e->wd))
+			{
+				std::string path = watch_dirs[e->wd] + "/" + e->name;
+				for (auto& a : assets) if (a.path == path) changed.insert(a.path);
+			}
+			ptr += sizeof(inotify_event) + e->len;
+		}
+	}
+#endif
+}
+
+inline void asset_watcher_t::wait_polling(std::set<std::string>& changed)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	for (auto& a : assets)
+	{
+		long long mtime, size;
+		if (!stat_file(a.path, mtime, size)) continue;	// being replaced; look again next time
+		if (mtime != a.mtime || size != a.size) { a.mtime = mtime; a.size = size; changed.insert(a.path); }
+	}
+}
+
+inline void asset_watcher_t::run()
+{
+	while (b_running)
+	{
+		std::set<std::string> changed;
+		if (fd >= 0) wait_inotify(changed); else wait_polling(changed);
+		if (changed.empty()) continue;
+
+		double detected = now();
+		for (auto& path : changed)
+		{
+			change_t c; c.path = path; c.detected = detected;
+			for (auto& a : assets) if (a.path == path) c.kind = a.kind;
+			if (c.kind == TEXTURE)
+			{
+				double t = now();
+				if (profiler) { profile_scope_t scope(*profiler, "texture decode"); c.img = cg_load_image(path.c_str()); }
+				else c.img = cg_load_image(path.c_str());
+				c.decode_ms = now() - t;
+				if (!c.img) continue;	// partially written; the next write event retries
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			changes.push_back(c);
+		}
+		glfwPostEmptyEvent();
+	}
+}
+
+#endif // __ASSET_WATCHER_H__
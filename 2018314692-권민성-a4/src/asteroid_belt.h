@@ -0,0 +1,128 @@
+#pragma once
+#ifndef __ASTEROID_BELT_H__
+#define __ASTEROID_BELT_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "catalog.h"
+#include <chrono>
+#include <random>
+
+//*************************************
+// procedural asteroid belt drawn with one instanced draw call
+// - instances are generated from the catalog seed: orbit radius, phase, inclination, node and spin
+// - positions are evaluated in the vertex shader (ASTEROID in transform.vert) from theta, so nothing is streamed per frame
+// - all instances share a low-LOD unit sphere (attributes 0-2); the instance data is attributes 4-5
+struct asteroid_t
+{
+	vec4	orbit;	// radius, phase, inclination, longitude of the ascending node
+	vec4	spin;	// revolution speed, rotation speed, size, tilt of the rotation axis
+};
+
+struct asteroid_belt_t
+{
+	uint	count = 0;
+	int		texture = -1;			// index into the application's textures
+	float	radius = 0.0f;			// bounding sphere around the origin
+	GLuint	vertex_array = 0;
+	GLuint	vertex_buffer = 0, index_buffer = 0, instance_buffer = 0;
+	GLsizei	index_count = 0;
+
+	static std::vector<asteroid_t> generate(const catalog_t::belt_t& belt, uint count);
+	bool	create(const catalog_t::belt_t& belt, uint count, uint longitudes = 12, uint latitudes = 6);
+	void	draw() const;
+	void	destroy();
+};
+
+inline std::vector<asteroid_t> asteroid_belt_t::generate(const catalog_t::belt_t& belt, uint count)
+{
+	std::mt19937 rng(belt.seed);	// the raw engine output is the same on every platform; the std distributions are not
+	auto uniform = [&]() { return float(rng() >> 8) * (1.0f / 16777216.0f); };
+	auto triangular = [&]() { return (uniform() + uniform()) * 0.5f; };	// denser in the middle of the range
+
+	std::vector<asteroid_t> v(count);
+	for (auto& a : v)
+	{
+		float radius = belt.inner + (belt.outer - belt.inner) * triangular();
+		float inclination = (triangular() * 2.0f - 1.0f) * belt.inclination;
+		a.orbit = vec4(radius, uniform() * PI * 2.0f, inclination, uniform() * PI * 2.0f);
+
+		float revolve = belt.revolve * powf(belt.inner / radius, 1.5f);
+		float size = belt.size_min * powf(belt.size_max / belt.size_min, uniform() * uniform() * uniform());	// mostly small ones
+		a.spin = vec4(revolve, 0.5f + 2.5f * uniform(), size, uniform() * PI);
+	}
+	return v;
+}
+
+inline bool asteroid_belt_t::create(const catalog_t::belt_t& belt, uint count, uint longitudes, uint latitudes)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	std::vector<asteroid_t> instances = generate(belt, count);
+	double generate_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	// low-LOD unit sphere
+	std::vector<vertex> vertices;
+	for (uint i = 0; i <= latitudes; i++)
+	{
+		for (uint j = 0; j <= longitudes; j++)
+		{
+			float theta = PI * i / float(latitudes), pi = PI * 2.0f * j / float(longitudes);
+			vec3 pos = vec3(sin(theta) * cos(pi), sin(theta) * sin(pi), cos(theta));
+			vertices.push_back({ pos, pos, vec2(j / float(longitudes), 1 - i / float(latitudes)) });
+		}
+	}
+	std::vector<uint> indices;
+	for (uint i = 0; i < latitudes; i++)
+	{
+		for (uint j = 0; j < longitudes; j++)
+		{
+			uint k = i * (longitudes + 1) + j, l = k + longitudes + 1;
+			indices.insert(indices.end(), { k + 1, k, l, k + 1, l, l + 1 });
+		}
+	}
+	index_count = GLsizei(indices.size());
+
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	glGenBuffers(1, &index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	vertex_array = cg_create_vertex_array(vertex_buffer, index_buffer);
+	if (!vertex_array) { printf("%s(): failed to create vertex array\n", __func__); return false; }
+
+	// per-instance attributes on the same vertex array
+	glBindVertexArray(vertex_array);
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(asteroid_t) * instances.size(), instances.data(), GL_STATIC_DRAW);
+	for (GLuint k = 0; k < 2; k++)
+	{
+		glEnableVertexAttribArray(4 + k);
+		glVertexAttribPointer(4 + k, 4, GL_FLOAT, GL_FALSE, sizeof(asteroid_t), (const void*) (sizeof(vec4) * k));
+		glVertexAttribDivisor(4 + k, 1);
+	}
+	glBindVertexArray(0);
+
+	this->count = count;
+	radius = belt.outer + belt.size_max;
+	printf("> asteroid belt: %u instances (%.1f MB), %d triangles each, generated in %.1f ms\n", count, sizeof(asteroid_t) * count / 1048576.0, index_count / 3, generate_ms);
+	return true;
+}
+
+inline void asteroid_belt_t::draw() const
+{
+	if (!count) return;
+	glBindVertexArray(vertex_array);
+	glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr, GLsizei(count));
+}
+
+inline void asteroid_belt_t::destroy()
+{
+	if (vertex_array) glDeleteVertexArrays(1, &vertex_array);
+	GLuint buffers[] = { vertex_buffer, index_buffer, instance_buffer };
+	glDeleteBuffers(3, buffers);
+	vertex_array = vertex_buffer = index_buffer = instance_buffer = 0;
+	count = 0;
+}
+
+#endif // __ASTEROID_BELT_H__
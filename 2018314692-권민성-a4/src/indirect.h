@@ -0,0 +1,310 @@
+#pragma once
+#ifndef __INDIRECT_H__
+#define __INDIRECT_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "catalog.h"
+#include "frustum.h"
+#include "program_cache.h"
+#include "simd_math.h"
+#include <algorithm>
+#include <cmath>
+
+//*************************************
+// GPU-driven submission of the catalog bodies (GL 4.3)
+// - a compute pass (cull.comp) transforms, culls and picks the LOD of every body, one dispatch per hierarchy level,
+//   and writes one DrawElementsIndirectCommand per body; the CPU never touches per-body data in a frame
+// - the commands are grouped by variant at create(), and each group is drawn by one glMultiDrawElementsIndirect
+//   with INDIRECT plus its UNLIT/NORMAL_MAP bits, so no fragment branches on the variant of a body;
+//   base_instance is the body index, so the per-instance attributes 6-8 and 10 fetch its model rows and layers
+// - textures and normal maps are resampled into the layers of one texture array, so no binding changes per draw
+// - reference() is the same pass on the CPU, for testing without a compute-capable GPU; --indirect-reference
+//   draws from it, and --indirect-validate compares the compute results against it every frame
+struct indirect_renderer_t
+{
+	struct body_t		// std430 body_t of cull.comp
+	{
+		vec4	orbit;			// radius, distance, rotate, revolve
+		int		parent;
+		uint	variant;		// VARIANT_* bits; selects the batch
+		uint	texture, normal;	// layers of the texture array
+	};
+	struct command_t	// DrawElementsIndirectCommand
+	{
+		uint	count, instance_count, first_index;
+		int		base_vertex;
+		uint	base_instance;
+	};
+	struct lod_t
+	{
+		uint	first_index, count;
+		int		base_vertex;
+		float	min_radius;		// projected radius in pixels from which this LOD is used
+	};
+	struct batch_t		// the commands of one variant: command_buffer[first .. first + count)
+	{
+		uint	variant, first, count;
+	};
+	static const uint NUM_LODS = 4;
+
+	GLuint		program = 0, resample_program = 0;
+	GLuint		body_buffer = 0, order_buffer = 0, model_buffer = 0, command_buffer = 0, slot_buffer = 0;
+	GLuint		layers = 0;				// GL_TEXTURE_2D_ARRAY
+	uint		layer_width = 1024, layer_height = 512;
+	std::vector<int>	layer_of;		// texture index -> layer; -1 when no body uses it
+	std::vector<body_t>	bodies;
+	std::vector<uint>	order, level_begin;	// bodies sorted by level; level l is order[level_begin[l] .. level_begin[l + 1])
+	std::vector<uint>	slot;			// body -> its command; the commands are sorted by variant, then by body
+	std::vector<batch_t>	batches;	// one multi-draw each
+	lod_t		lods[NUM_LODS];
+	frustum_culler_t	frustum;		// plane extraction shared with the CPU culler
+
+	bool		b_reference = false;	// fill the buffers from reference() instead of the compute pass
+	bool		b_validate = false;		// compare the compute pass against reference() every frame
+	uint		validated = 0, mismatches = 0;	// frames compared, commands that differed
+	float		max_error = 0.0f;		// largest difference of a model matrix element
+
+	static bool	is_supported() { return GLAD_GL_VERSION_4_3 && glDispatchCompute && glMultiDrawElementsIndirect; }
+	bool	create(program_cache_t& cache, const char* cull_path, const char* resample_path, const catalog_t& catalog, const std::vector<body_t>& body_data, const lod_t (&lod_table)[NUM_LODS]);
+	bool	create_layers(const std::vector<GLuint>& textures);	// layers for the textures that the bodies refer to, by texture index
+	void	update_layer(uint texture, GLuint source);			// hot reload of a texture
+	void	bind_attributes(GLuint vertex_array) const;			// adds the instanced attributes 6-8 and 10 to a sphere vertex array
+	void	cull(float theta, const mat4& view_projection, vec3 eye, float lod_scale);
+	template <class F> void draw(GLuint vertex_array, F use_program) const;	// use_program(variant) binds the program of a batch
+	void	reference(float theta, vec3 eye, float lod_scale, std::vector<affine3x4>& models, std::vector<command_t>& commands) const;	// after frustum.extract_planes()
+	void	validate(float theta, vec3 eye, float lod_scale);
+	void	print_stats() const;
+	void	destroy();
+};
+
+inline bool indirect_renderer_t::create(program_cache_t& cache, const char* cull_path, const char* resample_path, const catalog_t& catalog, const std::vector<body_t>& body_data, const lod_t (&lod_table)[NUM_LODS])
+{
+	if (!is_supported()) { printf("%s(): GPU-driven rendering needs OpenGL 4.3\n", __func__); return false; }
+	if (!(program = cache.create_compute(cull_path))) return false;
+	if (!(resample_program = cache.create_compute(resample_path))) return false;
+	bodies = body_data;
+	for (uint k = 0; k < NUM_LODS; k++) lods[k] = lod_table[k];
+
+	// counting sort by depth; parents precede their children in the catalog
+	uint n = uint(bodies.size());
+	std::vector<uint> depth(n, 0);
+	uint levels = n ? 1 : 0;
+	for (uint k = 0; k < n; k++) if (catalog.bodies[k].parent >= 0) levels = std::max(levels, (depth[k] = depth[catalog.bodies[k].parent] + 1) + 1);
+	level_begin.assign(levels + 1, 0);
+	for (uint k = 0; k < n; k++) level_begin[depth[k] + 1]++;
+	for (uint l = 0; l < levels; l++) level_begin[l + 1] += level_begin[l];
+	order.resize(n);
+	std::vector<uint> fill(level_begin.begin(), level_begin.end() - 1);
+	for (uint k = 0; k < n; k++) order[fill[depth[k]]++] = k;
+
+	// the commands of a variant are contiguous, in the order of the CPU path: by variant, then by body
+	std::vector<uint> sorted(n);
+	for (uint k = 0; k < n; k++) sorted[k] = k;
+	std::stable_sort(sorted.begin(), sorted.end(), [&](uint a, uint b) { return bodies[a].variant < bodies[b].variant; });
+	slot.resize(n); batches.clear();
+	for (uint s = 0; s < n; s++)
+	{
+		slot[sorted[s]] = s;
+		if (batches.empty() || batches.back().variant != bodies[sorted[s]].variant) batches.push_back({ bodies[sorted[s]].variant, s, 0 });
+		batches.back().count++;
+	}
+
+	GLuint buffers[5]; glGenBuffers(5, buffers);
+	body_buffer = buffers[0]; order_buffer = buffers[1]; model_buffer = buffers[2]; command_buffer = buffers[3]; slot_buffer = buffers[4];
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, body_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(body_t) * n, bodies.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, order_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint) * n, order.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, model_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(affine3x4) * n, nullptr, GL_DYNAMIC_COPY);	// std430 row_major mat4x3
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(command_t) * n, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint) * n, slot.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	printf("> indirect draw: %u bodies in %u levels, %u LODs, %u variant batches\n", n, levels, NUM_LODS, uint(batches.size()));
+	return true;
+}
+
+inline bool indirect_renderer_t::create_layers(const std::vector<GLuint>& textures)
+{
+	layer_of.assign(textures.size(), -1);
+	int count = 0;
+	for (auto& b : bodies)
+	{
+		for (uint t : { b.texture, b.normal }) if (t < textures.size() && layer_of[t] < 0) layer_of[t] = count++;
+	}
+	for (auto& b : bodies) { b.texture = uint(layer_of[b.texture]); b.normal = b.normal < textures.size() ? uint(layer_of[b.normal]) : 0; }	// texture indices -> layers
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, body_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(body_t) * bodies.size(), bodies.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	int mip_levels = 0; for (uint k = std::max(layer_width, layer_height); k; k >>= 1) mip_levels++;
+	glGenTextures(1, &layers); if (!layers) { printf("%s(): failed in glGenTextures()\n", __func__); return false; }
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layers);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, mip_levels, GL_RGBA8, layer_width, layer_height, std::max(count, 1));
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	for (uint t = 0; t < textures.size(); t++) if (layer_of[t] >= 0) update_layer(t, textures[t]);
+	printf("> indirect draw: %d texture layers of %ux%u (%.1f MB)\n", count, layer_width, layer_height, count * layer_width * layer_height * 4 * 4 / 3 / 1048576.0);
+	return true;
+}
+
+inline void indirect_renderer_t::update_layer(uint texture, GLuint source)
+{
+	if (!layers || texture >= layer_of.size() || layer_of[texture] < 0) return;
+	GLint w = 1, h = 1;
+	glBindTexture(GL_TEXTURE_2D, source);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+	float lod = std::max(0.0f, log2f(std::max(w / float(layer_width), h / float(layer_height))));
+
+	glUseProgram(resample_program);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(resample_program, "source"), 0);
+	glUniform1i(glGetUniformLocation(resample_program, "layer"), layer_of[texture]);
+	glUniform1f(glGetUniformLocation(resample_program, "lod"), lod);
+	glBindImageTexture(0, layers, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	glDispatchCompute((layer_width + 7) / 8, (layer_height + 7) / 8, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layers);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+inline void indirect_renderer_t::bind_attributes(GLuint vertex_array) const
+{
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, model_buffer);
+	for (GLuint k = 0; k < 3; k++)	// rows of the model matrix
+	{
+		glEnableVertexAttribArray(6 + k);
+		glVertexAttribPointer(6 + k, 4, GL_FLOAT, GL_FALSE, sizeof(affine3x4), (const void*) (sizeof(vec4) * k));
+		glVertexAttribDivisor(6 + k, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, body_buffer);	// texture and normal layers
+	glEnableVertexAttribArray(10);
+	glVertexAttribIPointer(10, 2, GL_UNSIGNED_INT, sizeof(body_t), (const void*) offsetof(body_t, texture));
+	glVertexAttribDivisor(10, 1);
+	glBindVertexArray(0);
+}
+
+inline void indirect_renderer_t::cull(float theta, const mat4& view_projection, vec3 eye, float lod_scale)
+{
+	frustum.extract_planes(view_projection);
+	uint n = uint(bodies.size());
+	if (b_reference)
+	{
+		std::vector<affine3x4> models; std::vector<command_t> commands;
+		reference(theta, eye, lod_scale, models, commands);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, model_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(affine3x4) * n, models.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command_t) * n, commands.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return;
+	}
+
+	glUseProgram(program);
+	glUniform1f(glGetUniformLocation(program, "theta"), theta);
+	glUniform4fv(glGetUniformLocation(program, "planes"), 6, (const float*) frustum.planes);
+	glUniform3f(glGetUniformLocation(program, "eye"), eye.x, eye.y, eye.z);
+	glUniform1f(glGetUniformLocation(program, "lod_scale"), lod_scale);
+	glUniform3f(glGetUniformLocation(program, "lod_radius"), lods[0].min_radius, lods[1].min_radius, lods[2].min_radius);
+	GLuint table[NUM_LODS * 3];
+	for (uint k = 0; k < NUM_LODS; k++) { table[k * 3] = lods[k].first_index; table[k * 3 + 1] = lods[k].count; table[k * 3 + 2] = GLuint(lods[k].base_vertex); }
+	glUniform3uiv(glGetUniformLocation(program, "lods"), NUM_LODS, table);
+	GLuint buffers[] = { body_buffer, order_buffer, model_buffer, command_buffer, slot_buffer };
+	for (GLuint k = 0; k < 5; k++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, k, buffers[k]);
+
+	// a level reads the models of the previous one
+	GLint first = glGetUniformLocation(program, "first"), count = glGetUniformLocation(program, "count");
+	for (uint l = 0; l + 1 < level_begin.size(); l++)
+	{
+		glUniform1ui(first, level_begin[l]);
+		glUniform1ui(count, level_begin[l + 1] - level_begin[l]);
+		glDispatchCompute((level_begin[l + 1] - level_begin[l] + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	if (b_validate) validate(theta, eye, lod_scale);
+}
+
+template <class F> void indirect_renderer_t::draw(GLuint vertex_array, F use_program) const
+{
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layers);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+	for (const batch_t& b : batches)
+	{
+		use_program(b.variant);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*) (sizeof(command_t) * b.first), GLsizei(b.count), 0);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+inline void indirect_renderer_t::reference(float theta, vec3 eye, float lod_scale, std::vector<affine3x4>& models, std::vector<command_t>& commands) const
+{
+	uint n = uint(bodies.size());
+	models.resize(n); commands.resize(n);
+	const simd_math_t& sm = simd_math();
+	for (uint k = 0; k < n; k++)	// catalog order: a parent is done before its children
+	{
+		const body_t& b = bodies[k];
+		affine3x4 m = sm.compose(sm.compose(sm.compose(affine3x4::rotate(vec3(0, 0, 1), theta * b.orbit.w), affine3x4::translate(vec3(b.orbit.y, 0, 0))), affine3x4::rotate(vec3(0, 0, 1), theta * b.orbit.z)), affine3x4::scale(b.orbit.x));
+		models[k] = b.parent >= 0 ? sm.compose(models[b.parent], m) : m;
+
+		vec3 c = frustum_culler_t::center_of(models[k]);
+		float r = frustum_culler_t::scale_of(models[k]);
+		bool b_visible = true;
+		for (const vec4& p : frustum.planes) b_visible = b_visible && p.x * c.x + p.y * c.y + p.z * c.z + p.w >= -r;
+
+		vec3 d = c - eye;
+		float px = r * lod_scale / std::max(sqrtf(d.x * d.x + d.y * d.y + d.z * d.z), 1e-6f);
+		uint lod = 0; while (lod + 1 < NUM_LODS && px < lods[lod].min_radius) lod++;
+		commands[slot[k]] = { lods[lod].count, b_visible ? 1u : 0u, lods[lod].first_index, lods[lod].base_vertex, k };
+	}
+}
+
+// reads the compute results back (a pipeline stall; for testing only)
+inline void indirect_renderer_t::validate(float theta, vec3 eye, float lod_scale)
+{
+	uint n = uint(bodies.size());
+	std::vector<affine3x4> models, gpu_models(n);
+	std::vector<command_t> commands, gpu_commands(n);
+	reference(theta, eye, lod_scale, models, commands);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, model_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(affine3x4) * n, gpu_models.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command_t) * n, gpu_commands.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (uint k = 0; k < n; k++)
+	{
+		for (int i = 0; i < 12; i++) max_error = std::max(max_error, fabsf(models[k][i] - gpu_models[k][i]));
+		if (memcmp(&commands[k], &gpu_commands[k], sizeof(command_t)) != 0) mismatches++;
+	}
+	validated++;
+}
+
+inline void indirect_renderer_t::print_stats() const
+{
+	if (!program) return;
+	if (validated) printf("[indirect] %u frames validated: %u commands differ from the CPU reference, max model error %g\n", validated, mismatches, max_error);
+}
+
+inline void indirect_renderer_t::destroy()
+{
+	GLuint buffers[] = { body_buffer, order_buffer, model_buffer, command_buffer, slot_buffer };
+	glDeleteBuffers(5, buffers);
+	if (layers) glDeleteTextures(1, &layers);
+	if (program) glDeleteProgram(program);
+	if (resample_program) glDeleteProgram(resample_program);
+	body_buffer = order_buffer = model_buffer = command_buffer = slot_buffer = layers = program = resample_program = 0;
+}
+
+#endif // __INDIRECT_H__
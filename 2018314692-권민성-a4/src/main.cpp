@@ -4,40 +4,50 @@
 #include "stb_image.h"
 #include "trackball.h"
 #include "sphere.h"
+#include "ringbuffer.h"
+#include "profiler.h"
+#include "headless.h"
+#include "frame_pacer.h"
+#include "shader_variants.h"
+#include "asset_watcher.h"
+#include "asteroid_belt.h"
+#include "frustum.h"
+#include "body_tree.h"
+#include "occlusion.h"
+#include "indirect.h"
+#include "oit.h"
+#include "texture_array.h"
+#include "deferred.h"
+#include "shadow.h"
+#include "hdr.h"
+#include "antialias.h"
+#include "soft_raster.h"
+#include "ray_tracer.h"
+#include "simd_math.h"
 
 //*************************************
 // global constants
 static const char* window_name = "Assignment 4: Solar System - Minsung Kwon 2018314692";
 static const char* vert_shader_path = "shaders/transform.vert";
 static const char* frag_shader_path = "shaders/transform.frag";
-// planets
-static const char* earth_image_path		= "shaders/textures/earth.jpg";
-static const char* jupiter_image_path	= "shaders/textures/jupiter.jpg";
-static const char* mars_image_path		= "shaders/textures/mars.jpg";
-static const char* mercury_image_path	= "shaders/textures/mercury.jpg";
-static const char* moon_image_path		= "shaders/textures/moon.jpg";
-static const char* neptune_image_path	= "shaders/textures/neptune.jpg";
-static const char* saturn_image_path	= "shaders/textures/saturn.jpg";
-static const char* sun_image_path		= "shaders/textures/sun.jpg";
-static const char* uranus_image_path	= "shaders/textures/uranus.jpg";
-static const char* venus_image_path		= "shaders/textures/venus.jpg";
-// rings
-static const char* saturn_ring_image_path		= "shaders/textures/saturn-ring.jpg";
-static const char* uranus_ring_image_path		= "shaders/textures/uranus-ring.jpg";
-static const char* saturn_ring_alpha_image_path = "shaders/textures/saturn-ring-alpha.jpg";
-static const char* uranus_ring_alpha_image_path = "shaders/textures/uranus-ring-alpha.jpg";
-// bump
-static const char* earth_bump_image_path	= "shaders/textures/earth-bump.jpg";
-static const char* mars_bump_image_path		= "shaders/textures/mars-bump.jpg";
-static const char* mercury_bump_image_path	= "shaders/textures/mercury-bump.jpg";
-static const char* moon_bump_image_path		= "shaders/textures/moon-bump.jpg";
-static const char* venus_bump_image_path	= "shaders/textures/venus-bump.jpg";
-// normal
-static const char* earth_normal_image_path		= "shaders/textures/earth-normal.jpg";
-static const char* mars_normal_image_path		= "shaders/textures/mars-normal.jpg";
-static const char* mercury_normal_image_path	= "shaders/textures/mercury-normal.jpg";
-static const char* moon_normal_image_path		= "shaders/textures/moon-normal.jpg";
-static const char* venus_normal_image_path		= "shaders/textures/venus-normal.jpg";
+static const char* occlusion_vert_path = "shaders/occlusion.vert";
+static const char* occlusion_frag_path = "shaders/occlusion.frag";
+static const char* cull_shader_path = "shaders/cull.comp";
+static const char* resample_shader_path = "shaders/resample.comp";
+static const char* oit_vert_path = "shaders/oit.vert";
+static const char* oit_frag_path = "shaders/oit.frag";
+static const char* deferred_shader_path = "shaders/deferred.comp";
+static const char* shadow_vert_path = "shaders/shadow.vert";
+static const char* shadow_geom_path = "shaders/shadow.geom";
+static const char* shadow_frag_path = "shaders/shadow.frag";
+static const char* hdr_vert_path = "shaders/hdr.vert";
+static const char* hdr_frag_path = "shaders/hdr.frag";
+static const char* fxaa_frag_path = "shaders/fxaa.frag";
+static const char* catalog_path = "catalog/solar-system.txt";
+static const char* texture_dir = "shaders/textures/";	// catalog texture names are relative to this
+static const float ring_inner = 2.0f, ring_outer = 4.0f;	// annulus of a ring in its body's model space, before the catalog scale
+static const uint ring_segments = 72;
+static const ivec2 ring_layer_size = ivec2(1024, 64);		// ring textures are radial strips
 
 //*************************************
 // common structures
@@ -71,30 +81,124 @@ struct material_t
 	float	shininess = 1000.0f;
 };
 
+// sphere vertex with a tangent frame for normal mapping (attribute locations 0-3)
+struct sphere_vertex_t
+{
+	vec3	pos;
+	vec3	norm;
+	vec2	tex;
+	vec4	tangent;	// xyz: dP/du, w: handedness of the (tangent, bitangent, normal) frame
+};
+
+// per-object data in the std140 layout of object_block in the shaders
+struct object_t
+{
+	affine3x4	model_matrix;	// row_major mat4x3 in the shaders
+};
+
+// feature bits of the transform.frag permutations
+enum { VARIANT_NORMAL_MAP = 1, VARIANT_RING = 2, VARIANT_UNLIT = 4, VARIANT_ASTEROID = 8, VARIANT_INDIRECT = 16, VARIANT_OIT = 32, VARIANT_GBUFFER = 64 };
+
+// a sphere draw; the list is sorted by variant so that each program is bound once per frame
+struct draw_t
+{
+	uint	variant;
+	int		index;			// sphere index
+	int		texture;		// index into textures
+	int		normal_texture;	// -1 without VARIANT_NORMAL_MAP
+	bool	occluder;		// drawn before the occlusion queries of the others
+	GLintptr offset;		// per-object data of the current frame
+};
+
+// a ring around a body, e.g., Saturn's
+struct ring_draw_t
+{
+	int		body;			// sphere index
+	float	scale;			// relative to the body's model
+	int		texture, alpha;	// indices into textures
+};
+
+// per-instance data of the ring draw (attributes 6-8 and 11 of the RING variant)
+struct ring_instance_t
+{
+	affine3x4	model_matrix;	// rows
+	vec4	shape;			// inner radius, outer radius, segments, texture layer
+};
+
+// a point light of the catalog emitters; it moves with its body
+struct emitter_t
+{
+	int		body;			// sphere index
+	vec4	position;		// model space of the body; w: range in model space
+	vec4	color;
+};
+
+// everything that changes the image of a paused simulation; drawn again only when it differs
+struct view_state_t
+{
+	float	theta;
+	mat4	view_matrix;
+	ivec2	window_size;
+	int		wireframe;
+	int		fc;
+};
+
 //*************************************
 // window objects
 GLFWwindow* window = nullptr;
 ivec2		window_size = cg_default_window_size(); // initial window size
+headless_t	headless;	// --headless: offscreen rendering without a window
 
 //*************************************
 // OpenGL objects
-GLuint	program = 0;	// ID holder for GPU program
+shader_variants_t	shaders;	// permutations of the GPU program, keyed by VARIANT_* bits
 GLuint	vertex_array = 0;	// ID holder for vertex array object (planet)
-GLuint	ring_vertex_array = 0;	// ID holder for vertex array object (ring)
-GLuint	PLANETS_TEX[13] = { 0 };
-GLuint	RING_TEX[4] = { 0 };
-GLuint	NORM_TEX_MERCURY;
-GLuint	NORM_TEX_VENUS;
-GLuint	NORM_TEX_EARTH;
-GLuint	NORM_TEX_MARS;
-GLuint	NORM_TEX_MOON;
+GLuint	ring_vertex_array = 0;	// ID holder for vertex array object (ring); instance attributes only
+texture_array_t	ring_colors, ring_alphas;	// layer k holds the images of ring k
+std::vector<GLuint>	textures;	// one per distinct image file of the catalog
+std::vector<std::string>	texture_paths;	// image path of each texture, for hot reload
+std::map<uint, int>	texture_index;	// catalog string -> index into textures
+ringbuffer_t	object_ring;	// per-object uniform blocks of the current frame
+std::vector<draw_t>	body_draws;	// per body, in catalog order
+std::vector<draw_t>	frame_draws;	// visible bodies of the current frame, sorted by variant
+std::vector<ring_draw_t>	ring_draws;
+std::vector<asteroid_belt_t>	belts;	// instanced asteroids of the catalog belts
+body_tree_t	tree;		// subtree bounding spheres of the bodies; hierarchical culling
+frustum_culler_t	culler;	// bounding spheres of the rings and belts of the current frame
+occlusion_culler_t	occlusion;	// GPU occlusion queries behind the Sun and the gas giants; 'o' toggles
+indirect_renderer_t	indirect;	// compute culling and one multi-draw of all bodies; 'g' toggles (GL 4.3)
+oit_t	oit;		// order-independent transparency of the rings; 't' toggles
+deferred_renderer_t	deferred;	// G-buffer and tiled light culling for the emitters; 'l' toggles (GL 4.3)
+std::vector<emitter_t>	emitters;	// point lights of the catalog, generated from their seeds
+std::vector<uint>	emitter_bodies;	// bodies with emitters and their ancestors; transformed for the lights in every frame
+GLuint	lod_vertex_array = 0;	// LODs of the unit sphere for the indirect draw
+std::vector<uint>	ring_bodies;	// bodies with rings and their ancestors; transformed on the CPU in the GPU-driven mode
+shadow_map_t	shadow;		// cube shadow map of the Sun; 's' toggles
+std::vector<uint>	shadow_casters;	// lit bodies; the Sun casts no shadow of its own light
+std::vector<uint>	shadow_bodies;	// casters and their ancestors; transformed in every frame, also out of view
+std::vector<vec4>	caster_spheres;	// this frame's bounding spheres of the casters
+hdr_t	hdr;		// HDR target, bloom and tone mapping; 'b' toggles
+antialias_t	aa;		// MSAA 2x/4x/8x or FXAA; 'a' cycles
+soft_rasterizer_t	software;	// --software: the bodies rasterized on the CPU
+std::vector<int>	software_textures;	// per texture: index in software.textures
+ray_tracer_t	tracer;		// --raytrace: the bodies ray traced on the CPU, with the textures of software
+asset_watcher_t	watcher;	// hot reload of shaders and textures (windowed mode)
 //*************************************
 // global variables
 int		frame = 0;		// index of rendering frames
-auto	spheres = std::move(create_spheres());
+profiler_t	profiler;	// CPU/GPU frame profiler; F12 or exit dumps profile.json
+frame_pacer_t	pacer;		// frame scheduler; 'v' cycles the pacing mode
+int		asteroid_count = -1;	// --asteroids N: overrides the instance count of every belt (stress test)
+uint	shadow_size = 1024;		// --shadow-size N: texels of a shadow cube face
+catalog_t	catalog;	// bodies, orbits, rings and textures, mapped from catalog/solar-system.bin
+std::vector<sphere_t>	spheres;
 
 float	theta, pause_theta = 0.0f;
 bool	b_wireframe = false;
+bool	b_gpu_driven = false;	// --gpu-driven
+bool	b_deferred = false;		// --deferred: the emitters light the bodies; forward shading has only the Sun
+bool	b_software = false;		// --software: CPU rasterization of the bodies instead of the GL passes
+bool	b_raytrace = false;		// --raytrace: CPU ray tracing of the bodies instead of the GL passes
 
 vec2	prev_pos;
 mat4	prev_view_matrix;
@@ -113,140 +217,340 @@ light_t		light;
 material_t	material;
 //*************************************
 // holder of vertices and indices of a unit sphere
-std::vector<vertex>	unit_sphere_vertices;	// host-side vertices
-std::vector<vertex> unit_ring_vertices;
+std::vector<sphere_vertex_t>	unit_sphere_vertices;	// host-side vertices
+std::vector<uint>	unit_sphere_indices;	// host-side indices; also drawn by the software rasterizer
 //*************************************
 void update()
 {
+	profile_scope_t scope(profiler, "update");
+
 	float aspect = window_size.x / float(window_size.y);
 	mat4 aspect_matrix = mat4::scale(std::min(1 / aspect, 1.0f), std::min(aspect, 1.0f), 1.0f);
 
 	// update projection matrix
 	cam.aspect = window_size.x / float(window_size.y);
-	cam.projection_matrix = mat4::perspective(cam.fovy, cam.aspect, cam.dnear, cam.dfar);
+	cam.projection_matrix = simd_math().perspective(cam.fovy, cam.aspect, cam.dnear, cam.dfar);
 
-	// update uniform variables in vertex/fragment shaders
-	GLint uloc;
-	uloc = glGetUniformLocation(program, "view_matrix");			if (uloc > -1) glUniformMatrix4fv(uloc, 1, GL_TRUE, cam.view_matrix);
-	uloc = glGetUniformLocation(program, "projection_matrix");	if (uloc > -1) glUniformMatrix4fv(uloc, 1, GL_TRUE, cam.projection_matrix);	
+	// update uniform variables in vertex/fragment shaders of every variant, and the same lighting in deferred.comp
+	auto set_uniforms = [](GLuint program)
+	{
+		GLint uloc;
+		uloc = glGetUniformLocation(program, "view_matrix");			if (uloc > -1) glUniformMatrix4fv(uloc, 1, GL_TRUE, cam.view_matrix);
+		uloc = glGetUniformLocation(program, "projection_matrix");	if (uloc > -1) glUniformMatrix4fv(uloc, 1, GL_TRUE, cam.projection_matrix);
+
+		// setup light properties
+		glUniform4fv(glGetUniformLocation(program, "light_position"), 1, light.position);
+		glUniform4fv(glGetUniformLocation(program, "Ia"), 1, light.ambient);
+		glUniform4fv(glGetUniformLocation(program, "Id"), 1, light.diffuse);
+		glUniform4fv(glGetUniformLocation(program, "Is"), 1, light.specular);
+
+		// setup material properties
+		glUniform4fv(glGetUniformLocation(program, "Ka"), 1, material.ambient);
+		glUniform4fv(glGetUniformLocation(program, "Kd"), 1, material.diffuse);
+		glUniform4fv(glGetUniformLocation(program, "Ks"), 1, material.specular);
+		glUniform1f(glGetUniformLocation(program, "shininess"), material.shininess);
+		glUniform1f(glGetUniformLocation(program, "shadow_range"), shadow.enabled && shadow.program ? shadow.range : 0.0f);
+		glUniform1f(glGetUniformLocation(program, "emission"), hdr.enabled ? hdr.emission : 1.0f);
+	};
+	shaders.for_each(set_uniforms);
+	if (deferred.program) { glUseProgram(deferred.program); set_uniforms(deferred.program); }
+}
 
-	// setup light properties
-	glUniform4fv(glGetUniformLocation(program, "light_position"), 1, light.position);
-	glUniform4fv(glGetUniformLocation(program, "Ia"), 1, light.ambient);
-	glUniform4fv(glGetUniformLocation(program, "Id"), 1, light.diffuse);
-	glUniform4fv(glGetUniformLocation(program, "Is"), 1, light.specular);
+// world-space lights of the emitters; the bodies that the culling left untransformed are brought up to date first
+void update_lights()
+{
+	profile_scope_t scope(profiler, "lights");
+	for (uint k : emitter_bodies) if (b_gpu_driven || !tree.is_visited(k)) spheres[k].update(theta, spheres);	// parents first
+	deferred.lights.resize(emitters.size());
+	for (size_t k = 0; k < emitters.size(); k++)
+	{
+		const emitter_t& e = emitters[k];
+		const affine3x4& m = spheres[e.body].model_matrix;
+		vec3 p = m.point(vec3(e.position.x, e.position.y, e.position.z));
+		deferred.lights[k] = { vec4(p.x, p.y, p.z, e.position.w * frustum_culler_t::scale_of(m)), e.color };
+	}
+	profiler.counter("point lights", float(emitters.size()));
+}
 
-	// setup material properties
-	glUniform4fv(glGetUniformLocation(program, "Ka"), 1, material.ambient);
-	glUniform4fv(glGetUniformLocation(program, "Kd"), 1, material.diffuse);
-	glUniform4fv(glGetUniformLocation(program, "Ks"), 1, material.specular);
-	glUniform1f(glGetUniformLocation(program, "shininess"), material.shininess);
+// --software: the bodies through soft_raster.h, copied into the framebuffer; rings, belts and the GL passes are left out
+void render_software()
+{
+	for (uint k = 0; k < catalog.body_count; k++) spheres[k].update(theta, spheres);	// parents come first in the catalog
+	GLfloat background[4]; glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+	software.begin(window_size, cam.view_matrix, cam.projection_matrix, { light.position, light.ambient, light.diffuse, light.specular, material.ambient, material.specular, material.shininess }, vec4(background[0], background[1], background[2], background[3]));
+	for (const draw_t& d : body_draws) software.draw(spheres[d.index].model_matrix, d.texture < 0 ? -1 : software_textures[d.texture], (d.variant & VARIANT_UNLIT) != 0);
+	software.end(profiler);
+	software.present();
+
+	profile_scope_t swap_scope(profiler, "swap", true);
+	if (!headless.enabled) glfwSwapBuffers(window);
+}
 
+// --raytrace: the bodies through ray_tracer.h, with the shadows of the Sun; the same subset as render_software()
+void render_raytrace()
+{
+	for (uint k = 0; k < catalog.body_count; k++) spheres[k].update(theta, spheres);
+	GLfloat background[4]; glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+	tracer.begin(window_size, cam.view_matrix, cam.projection_matrix, { light.position, light.ambient, light.diffuse, light.specular, material.ambient, material.specular, material.shininess }, vec4(background[0], background[1], background[2], background[3]));
+	for (const draw_t& d : body_draws) tracer.add(spheres[d.index].model_matrix, d.texture < 0 ? -1 : software_textures[d.texture], (d.variant & VARIANT_UNLIT) != 0);
+	tracer.end(profiler);
+	tracer.present();
+
+	profile_scope_t swap_scope(profiler, "swap", true);
+	if (!headless.enabled) glfwSwapBuffers(window);
 }
 
 void render()
 {
+	profile_scope_t scope(profiler, "render");
+	theta = b_rotate ? float(headless.enabled ? headless.time(frame) : glfwGetTime()) : theta;
+	aa.begin_frame(profiler, !b_software && !b_raytrace);	// the CPU renderers are not an anti-aliasing mode
+	if (b_software) { render_software(); return; }
+	if (b_raytrace) { render_raytrace(); return; }
+
+	// the scene goes into the HDR target when it is on, and into a multisampled one inside it with MSAA;
+	// FXAA takes the tone-mapped frame. everything below draws the same either way
+	bool b_fxaa = aa.begin_fxaa(window_size);
+	bool b_hdr = hdr.begin(window_size);
+	bool b_msaa = !(b_deferred && deferred.program) && aa.begin_msaa(window_size, b_hdr ? GL_RGBA16F : GL_RGBA8);	// the G-buffer is single-sampled
+
 	// clear screen (with background color) and clear depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// notify GL that we use our own program
-	glUseProgram(program);
+	// hierarchical frustum culling: only the subtrees in view are transformed and tested
+	// (in the GPU-driven mode, the compute pass does this for the bodies and the CPU keeps the rings and belts)
+	mat4 view_projection = simd_math().mul(cam.projection_matrix, cam.view_matrix);
+	uint belt_base = uint(ring_draws.size());	// rings, then belts in culler
+	{
+		profile_scope_t cull_scope(profiler, "culling");
+		uint visible = 0;
+		frame_draws.clear();
+		if (b_gpu_driven) for (uint k : ring_bodies) spheres[k].update(theta, spheres);
+		else
+		{
+			visible = tree.traverse(theta, spheres, view_projection);
 
-	// bind vertex array object
-	//glDisable(GL_BLEND);
-	glBindVertexArray(vertex_array);
+			// this frame's sphere draws sorted by variant, so that each program is bound once
+			for (uint k : tree.visible_bodies) frame_draws.push_back(body_draws[k]);
+			std::sort(frame_draws.begin(), frame_draws.end(), [](const draw_t& a, const draw_t& b) { return a.variant != b.variant ? a.variant < b.variant : a.index < b.index; });
+		}
 
-	// render vertices: trigger shader programs to process vertex data
-	theta = b_rotate ? float(glfwGetTime()) : theta;
-	int index = 0;
-	for (auto& s : spheres)
-	{
-		s.update(theta, spheres, index);
-		glActiveTexture(GL_TEXTURE0+index);
-		glBindTexture(GL_TEXTURE_2D, PLANETS_TEX[index]);
-		glUniform1i(glGetUniformLocation(program, "TEX"), index);
-		glUniform1i(glGetUniformLocation(program, "idx"), index);		// to index SUN for not shading
-		
-		// NORM TEXTURES
-		if (index == 1) 
+		// rings of the transformed bodies (outer radius 4 in model space) and the belts
+		culler.clear();
+		for (auto& d : ring_draws)
 		{
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, NORM_TEX_MERCURY);
-			glUniform1i(glGetUniformLocation(program, "NORM"), 1);
+			const affine3x4& m = spheres[d.body].model_matrix;
+			culler.add(frustum_culler_t::center_of(m), b_gpu_driven || tree.is_visited(d.body) ? frustum_culler_t::scale_of(m) * d.scale * ring_outer : -1e30f);	// never passes when its subtree was rejected
 		}
-		else if (index == 2)
+		for (auto& b : belts) culler.add(vec3(0), b.radius);
+		visible += culler.cull(view_projection);
+		if (!b_gpu_driven)
 		{
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, NORM_TEX_VENUS);
-			glUniform1i(glGetUniformLocation(program, "NORM"), 1);
+			profiler.counter("visible objects", visible);
+			profiler.counter("culled objects", catalog.body_count + culler.count - visible);
+			profiler.counter("tested spheres", tree.tested + culler.count);
 		}
-		else if (index == 3) 
+	}
+
+	// shadow map of the Sun: the casters out of view are transformed as well, since their shadows may fall into it;
+	// only the faces whose casters moved are drawn again (none while paused)
+	profiler.begin_gpu("shadows");
+	if (shadow.enabled && shadow.program)
+	{
+		for (uint k : shadow_bodies) if (b_gpu_driven || !tree.is_visited(k)) spheres[k].update(theta, spheres);	// parents first
+		caster_spheres.resize(shadow_casters.size());
+		for (uint i = 0; i < shadow_casters.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, NORM_TEX_EARTH);
-			glUniform1i(glGetUniformLocation(program, "NORM"), 1);
+			vec3 c = frustum_culler_t::center_of(spheres[shadow_casters[i]].model_matrix);
+			caster_spheres[i] = vec4(c.x, c.y, c.z, tree.radius[shadow_casters[i]]);
 		}
-		else if (index == 4)
+		uint faces = shadow.begin(vec3(light.position.x, light.position.y, light.position.z), caster_spheres);
+		if (faces)
 		{
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, NORM_TEX_MARS);
-			glUniform1i(glGetUniformLocation(program, "NORM"), 1);
+			glBindVertexArray(vertex_array);
+			for (uint i = 0; i < shadow_casters.size(); i++) shadow.draw(i, spheres[shadow_casters[i]].model_matrix, 72 * 36 * 2 * 3);
+			shadow.end();
 		}
-		else if (index >= 9)
+		uint n = 0; for (uint m = faces; m; m &= m - 1) n++;
+		profiler.counter("shadow faces", float(n));
+	}
+	profiler.end_gpu();
+
+	// write the per-object data of the visible objects in one linear pass
+	{ profile_scope_t wait_scope(profiler, "fence wait", true); object_ring.begin_frame(); }
+	for (draw_t& d : frame_draws)
+	{
+		d.offset = object_ring.alloc(sizeof(object_t));
+		if (d.offset >= 0) ((object_t*) object_ring.data(d.offset))->model_matrix = spheres[d.index].model_matrix;	// -1: the ring is full, not drawn
+	}
+	uint visible_rings = 0; for (uint k = 0; k < belt_base; k++) visible_rings += culler.visible(k);
+	GLintptr ring_offset = visible_rings ? object_ring.alloc(sizeof(ring_instance_t) * visible_rings) : 0;	// one block: the instances of the ring draw
+	if (ring_offset < 0) visible_rings = 0;
+	for (uint k = 0, i = 0; visible_rings && k < belt_base; k++)
+	{
+		if (!culler.visible(k)) continue;
+		ring_instance_t* r = (ring_instance_t*) object_ring.data(ring_offset) + i++;
+		r->model_matrix = simd_math().compose(spheres[ring_draws[k].body].get_model_matrix(), affine3x4::scale(ring_draws[k].scale));
+		r->shape = vec4(ring_inner, ring_outer, float(ring_segments), float(k));
+	}
+	std::vector<GLintptr> offsets(culler.count);
+	for (uint k = belt_base; k < culler.count; k++)
+	{
+		if (!culler.visible(k)) continue;
+		offsets[k] = object_ring.alloc(sizeof(object_t));
+		if (offsets[k] >= 0) ((object_t*) object_ring.data(offsets[k]))->model_matrix = affine3x4();	// belt orbits are around the origin
+	}
+	object_ring.flush();
+
+	// deferred: the opaque passes fill the G-buffer with the GBUFFER variants, then deferred.comp lights them
+	uint gbuffer = 0;
+	if (b_deferred && deferred.begin(window_size)) { gbuffer = VARIANT_GBUFFER; update_lights(); }
+
+	// bind vertex array object
+	glBindVertexArray(vertex_array);
+
+	// render vertices: trigger shader programs to process vertex data
+	// the draws are sorted by variant; a program is bound only when the variant changes
+	GLuint bound_program = 0;
+	auto draw_sphere = [&](const draw_t& d)
+	{
+		if (d.offset < 0) return;	// did not fit in the ring
+		GLuint p = shaders.get(d.variant | gbuffer);
+		if (p != bound_program) glUseProgram(bound_program = p);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, textures[d.texture]);
+		if (d.normal_texture >= 0)
 		{
 			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, NORM_TEX_MOON);
-			glUniform1i(glGetUniformLocation(program, "NORM"), 1);
+			glBindTexture(GL_TEXTURE_2D, textures[d.normal_texture]);
 		}
 
-		glUniformMatrix4fv(glGetUniformLocation(program, "model_matrix"), 1, GL_TRUE, s.model_matrix);
+		object_ring.bind_range(0, d.offset, sizeof(object_t));
 		glDrawElements(GL_TRIANGLES, 72 * 36 * 2 * 3, GL_UNSIGNED_INT, nullptr);
-		index++;
-	}
+	};
 
-	//*************************************
-	// Draw rings
-	glDisable(GL_CULL_FACE);			// turn off backface culling
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	// Saturn ring
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, RING_TEX[0]);
-	glUniform1i(glGetUniformLocation(program, "TEX1"), 1);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, RING_TEX[1]);
-	glUniform1i(glGetUniformLocation(program, "TEX2"), 2);
-	
-	glUniform1i(glGetUniformLocation(program, "idx"), -1);
+	if (b_gpu_driven)
+	{
+		// the compute pass writes one indirect command per body; one multi-draw per variant submits them
+		// (no occlusion queries here: conditional rendering cannot be applied per draw of a multi-draw)
+		profiler.begin_gpu("gpu culling");
+		indirect.cull(theta, view_projection, frustum_culler_t::eye_of(cam.view_matrix), window_size.y * 0.5f * cam.projection_matrix[5]);
+		profiler.end_gpu();
+
+		profiler.begin_gpu("spheres");
+		indirect.draw(lod_vertex_array, [&](uint variant) { glUseProgram(shaders.get(VARIANT_INDIRECT | variant | gbuffer)); });
+		profiler.end_gpu();
+	}
+	else
+	{
+		// occluders first, then the bounding cubes of the others against their depth, then the others
+		// under conditional rendering: a hidden body costs a 12-triangle proxy instead of its sphere
+		profiler.begin_gpu("occluders");
+		for (const draw_t& d : frame_draws) if (d.occluder) draw_sphere(d);
+		profiler.end_gpu();
+
+		profiler.begin_gpu("occlusion queries");
+		occlusion.begin_queries(cam.view_matrix, cam.projection_matrix, cam.dnear);
+		if (!b_wireframe) for (const draw_t& d : frame_draws) if (!d.occluder) occlusion.query(d.index, frustum_culler_t::center_of(spheres[d.index].model_matrix), tree.radius[d.index]);
+		occlusion.end_queries();
+		bound_program = 0;
+		profiler.end_gpu();
+
+		profiler.begin_gpu("spheres");
+		glBindVertexArray(vertex_array);
+		for (const draw_t& d : frame_draws)
+		{
+			if (d.occluder) continue;
+			occlusion.begin_draw(d.index);
+			draw_sphere(d);
+			occlusion.end_draw(d.index);
+		}
+		profiler.end_gpu();
+		profiler.counter("occluded bodies", occlusion.occluded);
+	}
 
-	glBindVertexArray(ring_vertex_array);
+	// asteroid belts: one instanced draw per belt; the vertex shader places each instance on its orbit
+	profiler.begin_gpu("asteroids");
+	if (!belts.empty())
+	{
+		GLuint p = shaders.get(VARIANT_ASTEROID | gbuffer);
+		glUseProgram(p);
+		glUniform1f(glGetUniformLocation(p, "theta"), theta);
+		glActiveTexture(GL_TEXTURE0);
+		for (uint k = 0; k < belts.size(); k++)
+		{
+			if (!culler.visible(belt_base + k) || offsets[belt_base + k] < 0) continue;
+			glBindTexture(GL_TEXTURE_2D, textures[belts[k].texture]);
+			object_ring.bind_range(0, offsets[belt_base + k], sizeof(object_t));
+			belts[k].draw();
+		}
+	}
+	profiler.end_gpu();
 
-	mat4 ring_model_matrix, saturn_model_matrix;
-	saturn_model_matrix = spheres[6].get_model_matrix();
-	ring_model_matrix = saturn_model_matrix * mat4::scale(0.8f);
-	glUniformMatrix4fv(glGetUniformLocation(program, "model_matrix"), 1, GL_TRUE, ring_model_matrix);
-	glDrawElements(GL_TRIANGLES, 72 * 2 * 3, GL_UNSIGNED_INT, nullptr);
-	
-	// Uranus ring
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, RING_TEX[2]);
-	glUniform1i(glGetUniformLocation(program, "TEX1"), 1);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, RING_TEX[3]);
-	glUniform1i(glGetUniformLocation(program, "TEX2"), 2);
+	if (gbuffer)
+	{
+		profiler.begin_gpu("lighting");
+		deferred.end(cam.projection_matrix);
+		profiler.end_gpu();
+	}
 
-	mat4 uranus_model_matrix = spheres[7].get_model_matrix();
-	ring_model_matrix = uranus_model_matrix * mat4::scale(0.6f);
-	glUniformMatrix4fv(glGetUniformLocation(program, "model_matrix"), 1, GL_TRUE, ring_model_matrix);
-	glDrawElements(GL_TRIANGLES, 72 * 2 * 3, GL_UNSIGNED_INT, nullptr);
+	//*************************************
+	// Draw rings: translucent, so weighted blended OIT makes the result independent of the draw order
+	// (plain alpha blending in catalog order when OIT is off or unsupported); one instanced draw for all rings
+	profiler.begin_gpu("rings");
+	glDisable(GL_CULL_FACE);			// turn off backface culling
+	bool b_oit = visible_rings && oit.begin(window_size);
+	if (!b_oit)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
 
+	glUseProgram(shaders.get(b_oit ? VARIANT_RING | VARIANT_OIT : VARIANT_RING));
+	if (visible_rings)
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ring_colors.texture);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ring_alphas.texture);
+		glActiveTexture(GL_TEXTURE0);
+
+		// the instance attributes point at this frame's ring_instance_t block
+		glBindVertexArray(ring_vertex_array);
+		glBindBuffer(GL_ARRAY_BUFFER, object_ring.buffer);
+		for (GLuint k = 0; k < 3; k++) glVertexAttribPointer(6 + k, 4, GL_FLOAT, GL_FALSE, sizeof(ring_instance_t), (const void*) (ring_offset + sizeof(vec4) * k));
+		glVertexAttribPointer(11, 4, GL_FLOAT, GL_FALSE, sizeof(ring_instance_t), (const void*) (ring_offset + offsetof(ring_instance_t, shape)));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, ring_segments * 6, visible_rings);
+	}
+	if (b_oit) oit.end();
 
 	glEnable(GL_CULL_FACE);			// turn off backface culling
 	glDisable(GL_BLEND);
+	profiler.end_gpu();
+	object_ring.end_frame();
+
+	if (b_msaa)
+	{
+		profiler.begin_gpu("msaa resolve");
+		aa.end_msaa();
+		profiler.end_gpu();
+	}
+
+	// bloom and tone mapping into the window (or the offscreen framebuffer); a GPU pass per stage
+	if (b_hdr) hdr.end(profiler);
+	if (b_fxaa)
+	{
+		profiler.begin_gpu("fxaa");
+		aa.end_fxaa();
+		profiler.end_gpu();
+	}
+	aa.record(profiler);
 
 	// swap front and back buffers, and display to screen
-	glfwSwapBuffers(window);
+	profile_scope_t swap_scope(profiler, "swap", true);
+	if (!headless.enabled) glfwSwapBuffers(window);
 }
 
 void reshape(GLFWwindow* window, int width, int height)
@@ -264,37 +568,51 @@ void print_help()
 	printf("- press F1 or 'h' to see help\n");
 	printf("- press 'w' to toggle wireframe\n");
 	printf("- press Home to reset camera\n");
+	printf("- drag with the left button to orbit the target; ctrl+left or middle pans the target, shift+left or right zooms toward it\n");
 	printf("- press Pause to pause the simulation\n");
+	printf("- press F12 to dump the profile (profile.json)\n");
+	printf("- press 'v' to cycle frame pacing (vsync/adaptive/target fps/unlimited)\n");
+	printf("- press 'o' to toggle occlusion culling\n");
+	printf("- press 'g' to toggle GPU-driven culling and indirect draws of the bodies\n");
+	printf("- press 't' to toggle order-independent transparency of the rings\n");
+	printf("- press 'l' to toggle deferred shading with the point lights (forward: the Sun only)\n");
+	printf("- press 's' to toggle the shadows of the Sun\n");
+	printf("- press 'b' to toggle HDR rendering with bloom and tone mapping\n");
+	printf("- press 'a' to cycle anti-aliasing (off/MSAA 2x/4x/8x/FXAA)\n");
 	printf("\n");
 }
 
-std::vector<vertex> create_sphere_vertices()
+std::vector<sphere_vertex_t> create_sphere_vertices(uint longitudes = 72, uint latitudes = 36)
 {
-	// 72 edges in longitude & 36 edges in latitude
-	std::vector<vertex> v;
+	// 72 edges in longitude & 36 edges in latitude by default; fewer for the LODs of the indirect draw
+	std::vector<sphere_vertex_t> v;
 
 	float rad = 1.0f;
-	for (uint i = 0; i <= 36; i++)
+	for (uint i = 0; i <= latitudes; i++)
 	{
-		for (uint j = 0; j <= 72; j++)
+		for (uint j = 0; j <= longitudes; j++)
 		{
-			float theta = PI * i / float(36);
-			float pi = PI * 2.0f * j / float(72);
+			float theta = PI * i / float(latitudes);
+			float pi = PI * 2.0f * j / float(longitudes);
 			vec3 pos = vec3(rad * sin(theta) * cos(pi), rad * sin(theta) * sin(pi), rad * cos(theta));
 			vec3 norm = pos;
-			vec2 tc = vec2((float)j / 72.0f, 1-(float)i/36.0f);
+			vec2 tc = vec2((float)j / float(longitudes), 1-(float)i/float(latitudes));
+
+			// analytic frame of the uv parameterization: u follows pi, v runs against theta
+			// the tangent is taken along pi directly so that it stays defined at the poles and equal across the seam
+			vec3 tangent = vec3(-sin(pi), cos(pi), 0);								// dP/du
+			vec3 bitangent = vec3(-cos(theta) * cos(pi), -cos(theta) * sin(pi), sin(theta));	// dP/dv
+			vec3 c = vec3(norm.y * tangent.z - norm.z * tangent.y, norm.z * tangent.x - norm.x * tangent.z, norm.x * tangent.y - norm.y * tangent.x);
+			float handedness = c.x * bitangent.x + c.y * bitangent.y + c.z * bitangent.z < 0 ? -1.0f : 1.0f;
 
-			v.push_back({ pos, norm, tc });
+			v.push_back({ pos, norm, tc, vec4(tangent.x, tangent.y, tangent.z, handedness) });
 		}
 	}
 	return v;
 }
 
-void update_vertex_buffer(const std::vector<vertex>& vertices)
+std::vector<uint> create_sphere_indices()
 {
-	static GLuint vertex_buffer = 0;	// ID holder for vertex buffer
-	static GLuint index_buffer = 0;		// ID holder for index buffer
-
 	std::vector<uint> indices;
 	for (uint i = 0; i < 36; i++)
 	{
@@ -309,68 +627,115 @@ void update_vertex_buffer(const std::vector<vertex>& vertices)
 			indices.push_back((i + 1) * 73 + j + 1);	//(i+1, j+1)
 		}
 	}
+	return indices;
+}
+
+void update_vertex_buffer(const std::vector<sphere_vertex_t>& vertices, const std::vector<uint>& indices)
+{
+	static GLuint vertex_buffer = 0;	// ID holder for vertex buffer
+	static GLuint index_buffer = 0;		// ID holder for index buffer
+
 	// generation of vertex buffer: use vertices as it is
 	glGenBuffers(1, &vertex_buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(sphere_vertex_t) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
 
 	// geneation of index buffer
 	glGenBuffers(1, &index_buffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * indices.size(), &indices[0], GL_STATIC_DRAW);
 
+	// vertex array with the tangent attribute; cg_create_vertex_array() only knows the plain vertex layout
 	if (vertex_array) glDeleteVertexArrays(1, &vertex_array);
-	vertex_array = cg_create_vertex_array(vertex_buffer, index_buffer);
+	glGenVertexArrays(1, &vertex_array);
 	if (!vertex_array) { printf("%s(): failed to create vertex array\n", __func__); return; }
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+
+	const GLint		sizes[] = { 3, 3, 2, 4 };
+	const size_t	offsets[] = { offsetof(sphere_vertex_t, pos), offsetof(sphere_vertex_t, norm), offsetof(sphere_vertex_t, tex), offsetof(sphere_vertex_t, tangent) };
+	for (GLuint k = 0; k < 4; k++)
+	{
+		glEnableVertexAttribArray(k);
+		glVertexAttribPointer(k, sizes[k], GL_FLOAT, GL_FALSE, sizeof(sphere_vertex_t), (const void*) offsets[k]);
+	}
+	glBindVertexArray(0);
 }
 
-std::vector<vertex> create_ring_vertcies()
+// LODs of the unit sphere in one vertex array for the indirect draw, from 72x36 down to 12x6 edges;
+// each LOD is used from the projected radius in pixels where its edges get about as long as those of the next finer one
+bool create_lod_vertex_array(indirect_renderer_t::lod_t (&lods)[indirect_renderer_t::NUM_LODS])
 {
-	std::vector<vertex> v;
-	for (uint i = 0; i <= 72; i++)
+	const uint	longitudes[] = { 72, 36, 18, 12 }, latitudes[] = { 36, 18, 9, 6 };
+	const float	min_radius[] = { 48.0f, 16.0f, 4.0f, 0.0f };
+	std::vector<sphere_vertex_t> vertices;
+	std::vector<uint> indices;
+	for (uint l = 0; l < indirect_renderer_t::NUM_LODS; l++)
 	{
-		float theta = (PI * 2.0f * i)/ float(72);
-		vec3 pos = vec3(2.0f*cos(theta), 2.0f*sin(theta), 0.0f);
-		vec3 norm =pos;
-		vec2 tc = vec2(1.0f, (float)i / 72.0f);
-		v.push_back({ pos, norm, tc });
+		uint lon = longitudes[l], lat = latitudes[l];
+		lods[l] = { uint(indices.size()), lon * lat * 6, int(vertices.size()), min_radius[l] };
+		std::vector<sphere_vertex_t> v = create_sphere_vertices(lon, lat);
+		vertices.insert(vertices.end(), v.begin(), v.end());
+		for (uint i = 0; i < lat; i++)
+		{
+			for (uint j = 0; j < lon; j++)
+			{
+				uint k = i * (lon + 1) + j, m = k + lon + 1;	// same winding as update_vertex_buffer()
+				indices.insert(indices.end(), { k + 1, k, m, k + 1, m, m + 1 });
+			}
+		}
+	}
 
-		pos = vec3(4.0f*cos(theta), 4.0f*sin(theta), 0.0f);
-		tc = vec2(0.0f, (float)i / 72.0f);
-		v.push_back({ pos, norm, tc });
+	GLuint buffers[2]; glGenBuffers(2, buffers);
+	glGenVertexArrays(1, &lod_vertex_array);
+	if (!lod_vertex_array) { printf("%s(): failed to create vertex array\n", __func__); return false; }
+	glBindVertexArray(lod_vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(sphere_vertex_t) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	const GLint		sizes[] = { 3, 3, 2, 4 };
+	const size_t	offsets[] = { offsetof(sphere_vertex_t, pos), offsetof(sphere_vertex_t, norm), offsetof(sphere_vertex_t, tex), offsetof(sphere_vertex_t, tangent) };
+	for (GLuint k = 0; k < 4; k++)
+	{
+		glEnableVertexAttribArray(k);
+		glVertexAttribPointer(k, sizes[k], GL_FLOAT, GL_FALSE, sizeof(sphere_vertex_t), (const void*) offsets[k]);
 	}
-	return v;
+	glBindVertexArray(0);
+	return true;
 }
 
-void update_ring_vertex_buffer(const std::vector<vertex>& vertices)
+// GPU-driven path: body data for the compute pass, LOD meshes and texture layers; false leaves it off
+bool create_indirect()
 {
-	static GLuint vertex_buffer = 0;	// ID holder for vertex buffer
-	static GLuint index_buffer = 0;		// ID holder for index buffer
+	if (!indirect_renderer_t::is_supported()) { printf("> GPU-driven rendering needs OpenGL 4.3; disabled\n"); return false; }
+	indirect_renderer_t::lod_t lods[indirect_renderer_t::NUM_LODS];
+	if (!create_lod_vertex_array(lods)) return false;
 
-	std::vector<uint> indices;
-	for (uint i = 0; i < 72; i++)
+	std::vector<indirect_renderer_t::body_t> bodies(catalog.body_count);
+	for (const draw_t& d : body_draws)	// texture indices; create_layers() turns them into layers
 	{
-		indices.push_back(2 * i);
-		indices.push_back(2 * i + 3);
-		indices.push_back(2 * i + 1);
-
-		indices.push_back(2 * i);
-		indices.push_back(2 * i + 2);
-		indices.push_back(2 * i + 3);
+		const catalog_t::body_t& b = catalog.bodies[d.index];
+		bodies[d.index] = { vec4(b.radius, b.distance, b.rotate, b.revolve), b.parent, d.variant, uint(d.texture), uint(d.normal_texture) };
 	}
-	// generation of vertex buffer: use vertices as it is
-	glGenBuffers(1, &vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
-
-	// geneation of index buffer
-	glGenBuffers(1, &index_buffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * indices.size(), &indices[0], GL_STATIC_DRAW);
+	if (!indirect.create(shaders.cache, cull_shader_path, resample_shader_path, catalog, bodies, lods)) return false;
+	if (!indirect.create_layers(textures)) return false;
+	indirect.bind_attributes(lod_vertex_array);
+	return true;
+}
 
-	if (ring_vertex_array) glDeleteVertexArrays(1, &ring_vertex_array);
-	ring_vertex_array = cg_create_vertex_array(vertex_buffer, index_buffer);
-	if (!ring_vertex_array) { printf("%s(): failed to create vertex array\n", __func__); return; }
+// rings have no vertex buffer (see ring_vertex() in transform.vert); the vertex array only holds
+// the per-instance attributes, which render() points into the ring buffer section of each frame
+bool create_ring_vertex_array()
+{
+	glGenVertexArrays(1, &ring_vertex_array);
+	if (!ring_vertex_array) { printf("%s(): failed to create vertex array\n", __func__); return false; }
+	glBindVertexArray(ring_vertex_array);
+	for (GLuint k : { 6u, 7u, 8u, 11u }) { glEnableVertexAttribArray(k); glVertexAttribDivisor(k, 1); }
+	glBindVertexArray(0);
+	return true;
 }
 
 void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -385,6 +750,72 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 			if (b_rotate) glfwSetTime(pause_theta);
 			else pause_theta = theta;
 		}
+		else if (key == GLFW_KEY_F12)	profiler.dump();
+		else if (key == GLFW_KEY_V)		pacer.next_mode();
+		else if (key == GLFW_KEY_G)
+		{
+			if (!indirect.program) printf("> GPU-driven rendering is not available\n");
+			else
+			{
+				b_gpu_driven = !b_gpu_driven;
+				pacer.request_redraw();
+				printf("> %s\n", b_gpu_driven ? "GPU-driven culling and indirect draws" : "CPU culling and per-body draws");
+			}
+		}
+		else if (key == GLFW_KEY_T)
+		{
+			if (!oit.program) printf("> order-independent transparency is not available\n");
+			else
+			{
+				oit.enabled = !oit.enabled;
+				pacer.request_redraw();
+				printf("> ring transparency: %s\n", oit.enabled ? "weighted blended OIT" : "alpha blending in draw order");
+			}
+		}
+		else if (key == GLFW_KEY_L)
+		{
+			if (!deferred.program) printf("> deferred shading is not available\n");
+			else
+			{
+				b_deferred = !b_deferred;
+				pacer.request_redraw();
+				printf("> %s\n", b_deferred ? "deferred shading with tiled light culling" : "forward shading");
+			}
+		}
+		else if (key == GLFW_KEY_S)
+		{
+			if (!shadow.program) printf("> shadows are not available\n");
+			else
+			{
+				shadow.enabled = !shadow.enabled;
+				shadow.invalidate();	// the faces were not kept up to date while off
+				pacer.request_redraw();
+				printf("> shadows %s\n", shadow.enabled ? "on" : "off");
+			}
+		}
+		else if (key == GLFW_KEY_B)
+		{
+			if (!hdr.programs[0]) printf("> HDR rendering is not available\n");
+			else
+			{
+				hdr.enabled = !hdr.enabled;
+				pacer.request_redraw();
+				printf("> %s\n", hdr.enabled ? "HDR with bloom and tone mapping" : "LDR");
+			}
+		}
+		else if (key == GLFW_KEY_A)
+		{
+			aa.next_mode();
+			pacer.request_redraw();
+			if (aa.samples() > 1 && b_deferred && deferred.program) printf("> anti-aliasing: %s (not with deferred shading)\n", antialias_t::name(aa.mode));
+			else printf("> anti-aliasing: %s\n", antialias_t::name(aa.mode));
+		}
+		else if (key == GLFW_KEY_O)
+		{
+			occlusion.enabled = !occlusion.enabled;
+			pacer.request_redraw();
+			printf("> occlusion culling %s\n", occlusion.enabled ? "on" : "off");
+		}
 		else if (key == GLFW_KEY_W)
 		{
 			b_wireframe = !b_wireframe;
@@ -395,7 +826,7 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 		{
 			fc = (fc + 1) % 3;
 
-			GLint uloc = glGetUniformLocation(program, "fc");	if (uloc > -1) glUniform1i(uloc, fc);
+			shaders.for_each([](GLuint program) { GLint uloc = glGetUniformLocation(program, "fc");	if (uloc > -1) glUniform1i(uloc, fc); });
 
 			if (fc == 0) printf("> using (texcoord.xy, 0) as color\n");
 			else if (fc == 1) printf("> using (texcoord.xxx) as color\n");
@@ -405,7 +836,8 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 		else if (key == GLFW_KEY_LEFT_SHIFT) b_left_shift = true;
 		else if (key == GLFW_KEY_HOME)
 		{
-			cam.view_matrix = mat4::look_at(cam.eye, cam.at, cam.up);
+			cam.view_matrix = simd_math().look_at(cam.eye, cam.at, cam.up);
+			tb.set(cam.eye, cam.at, cam.up);
 		}
 	}
 	else if (action == GLFW_RELEASE)
@@ -415,30 +847,35 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 	}
 }
 
+void refresh(GLFWwindow* window)
+{
+	pacer.request_redraw();	// the window was exposed; the last frame has to be drawn again
+}
+
 void mouse(GLFWwindow* window, int button, int action, int mods)
 {
 	if (!b_left_control && !b_left_shift && button == GLFW_MOUSE_BUTTON_LEFT)
 	{
 		dvec2 pos; glfwGetCursorPos(window, &pos.x, &pos.y);
 		vec2 npos = cursor_to_ndc(pos, window_size);
-		if (action == GLFW_PRESS)			tb.begin(cam.view_matrix, npos, 0);
-		else if (action == GLFW_RELEASE)	tb.end(0);
+		if (action == GLFW_PRESS)			tb.begin(npos, 0, glfwGetTime());
+		else if (action == GLFW_RELEASE)	tb.end(0, glfwGetTime());
 	}
 	//panning
 	else if ((b_left_control && button == GLFW_MOUSE_BUTTON_LEFT) || button == GLFW_MOUSE_BUTTON_MIDDLE)	
 	{
 		dvec2 pos; glfwGetCursorPos(window, &pos.x, &pos.y);
 		vec2 npos = cursor_to_ndc(pos, window_size);
-		if (action == GLFW_PRESS) tb.begin(cam.view_matrix, npos, 1);
-		else if (action == GLFW_RELEASE) tb.end(1);
+		if (action == GLFW_PRESS) tb.begin(npos, 1, glfwGetTime());
+		else if (action == GLFW_RELEASE) tb.end(1, glfwGetTime());
 	}
 	//zooming
 	else if ((b_left_shift && button == GLFW_MOUSE_BUTTON_LEFT) || button == GLFW_MOUSE_BUTTON_RIGHT)	
 	{
 		dvec2 pos; glfwGetCursorPos(window, &pos.x, &pos.y);
 		vec2 npos = cursor_to_ndc(pos, window_size);
-		if (action == GLFW_PRESS) tb.begin(cam.view_matrix, npos, 2);
-		else if (action == GLFW_RELEASE) tb.end(2);
+		if (action == GLFW_PRESS) tb.begin(npos, 2, glfwGetTime());
+		else if (action == GLFW_RELEASE) tb.end(2, glfwGetTime());
 	}
 }
 
@@ -448,29 +885,27 @@ void motion(GLFWwindow* window, double x, double y)
 	if (tb.is_tracking())
 	{
 		vec2 npos = cursor_to_ndc(dvec2(x, y), window_size);
-		cam.view_matrix = tb.update(npos, 0);
+		tb.update(npos, 0, glfwGetTime());
 	}
 
 	// panning
 	if (tb.is_panning())
 	{
 		vec2 npos = cursor_to_ndc(dvec2(x, y), window_size);
-		cam.view_matrix = tb.update(npos, 1);
+		tb.update(npos, 1, glfwGetTime());
 	}
 
 	// zooming
 	if (tb.is_zooming())
 	{
 		vec2 npos = cursor_to_ndc(dvec2(x, y), window_size);
-		cam.view_matrix = tb.update(npos, 2);
+		tb.update(npos, 2, glfwGetTime());
 	}
 }
 
 // this function will be avaialble as cg_create_texture() in other samples
-GLuint create_texture(const char* image_path, bool mipmap = true, GLenum wrap = GL_CLAMP_TO_EDGE, GLenum filter = GL_LINEAR)
+GLuint create_texture(const image* i, bool mipmap = true, GLenum wrap = GL_CLAMP_TO_EDGE, GLenum filter = GL_LINEAR)
 {
-	// load image
-	image* i = cg_load_image(image_path); if (!i) return 0; // return null texture; 0 is reserved as a null texture
 	int		w = i->width, h = i->height, c = i->channels;
 
 	// induce internal format and format from image
@@ -482,7 +917,9 @@ GLuint create_texture(const char* image_path, bool mipmap = true, GLenum wrap =
 	glGenTextures(1, &texture); if (texture == 0) { printf("%s(): failed in glGenTextures()\n", __func__); return 0; }
 	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, i->ptr);
-	if (i) { delete i; i = nullptr; } // release image
+
+	// single-channel images are grayscale (e.g., moon.jpg); replicate red instead of sampling (r,0,0)
+	if (c == 1) { GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE }; glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle); }
 
 	// build mipmap
 	if (mipmap)
@@ -502,6 +939,161 @@ GLuint create_texture(const char* image_path, bool mipmap = true, GLenum wrap =
 	return texture;
 }
 
+GLuint create_texture(const char* image_path, bool mipmap = true, GLenum wrap = GL_CLAMP_TO_EDGE, GLenum filter = GL_LINEAR)
+{
+	// load image
+	image* i = cg_load_image(image_path); if (!i) return 0; // return null texture; 0 is reserved as a null texture
+	GLuint texture = create_texture(i, mipmap, wrap, filter);
+	delete i; // release image
+	return texture;
+}
+
+// texture of a catalog image name (index into textures, -1 for none); each file is loaded once and shared
+bool load_texture(uint name, int& index)
+{
+	index = -1; if (!name) return true;
+	auto it = texture_index.find(name); if (it != texture_index.end()) { index = it->second; return true; }
+	std::string path = std::string(texture_dir) + catalog.str(name);
+	GLuint texture = create_texture(path.c_str(), true); if (!texture) return false;
+	textures.push_back(texture);
+	texture_paths.push_back(path);
+	watcher.add(path.c_str(), asset_watcher_t::TEXTURE);
+	texture_index[name] = index = int(textures.size()) - 1;
+	return true;
+}
+
+// fixed texture units and the per-object uniform block; set once per program instead of per draw
+void setup_programs()
+{
+	shaders.for_each([](GLuint program)
+	{
+		glUniform1i(glGetUniformLocation(program, "TEX"), 0);
+		glUniform1i(glGetUniformLocation(program, "NORM"), 1);
+		glUniform1i(glGetUniformLocation(program, "TEX1"), 1);
+		glUniform1i(glGetUniformLocation(program, "TEX2"), 2);
+		glUniform1i(glGetUniformLocation(program, "LAYERS"), 3);
+		glUniform1i(glGetUniformLocation(program, "SHADOW"), 4);
+		GLuint block_index = glGetUniformBlockIndex(program, "object_block");
+		if (block_index != GL_INVALID_INDEX) glUniformBlockBinding(program, block_index, 0);
+		glUniform1i(glGetUniformLocation(program, "fc"), fc);	// rebuilt programs keep the color mode of 'd'
+	});
+}
+
+// draws of the catalog bodies and rings with their textures;
+// body_draws are in catalog order; render() sorts the visible ones by variant: unlit (the Sun), plain Phong, then normal-mapped bodies
+bool build_draws()
+{
+	body_draws.clear();
+	for (int index = 0; index < int(catalog.body_count); index++)
+	{
+		const catalog_t::body_t& b = catalog.bodies[index];
+		draw_t d = { 0, index, -1, -1, (b.flags & catalog_t::OCCLUDER) != 0, 0 };
+		if (!load_texture(b.texture, d.texture) || !load_texture(b.normal, d.normal_texture)) return false;
+		if (d.texture < 0) { printf("%s(): %s has no texture\n", __func__, catalog.str(b.name)); return false; }
+		d.variant = (b.flags & catalog_t::UNLIT) ? VARIANT_UNLIT : d.normal_texture >= 0 ? VARIANT_NORMAL_MAP : 0;
+		body_draws.push_back(d);
+	}
+
+	ring_draws.clear();
+	for (uint k = 0; k < catalog.ring_count; k++)
+	{
+		const catalog_t::ring_t& r = catalog.rings[k];
+		ring_draw_t d = { int(r.body), r.scale, -1, -1 };
+		if (!load_texture(r.texture, d.texture) || !load_texture(r.alpha, d.alpha) || d.texture < 0 || d.alpha < 0) return false;
+		ring_draws.push_back(d);
+	}
+	std::vector<GLuint> colors, alphas;
+	for (auto& d : ring_draws) { colors.push_back(textures[d.texture]); alphas.push_back(textures[d.alpha]); }
+	if (!ring_colors.create(colors, ring_layer_size, GL_RGBA8) || !ring_alphas.create(alphas, ring_layer_size, GL_R8)) return false;
+
+	// the GPU-driven mode transforms the bodies on the GPU; only these are needed on the CPU for the rings
+	std::vector<bool> b_ring_body(catalog.body_count, false);
+	for (auto& d : ring_draws) for (int k = d.body; k >= 0 && !b_ring_body[k]; k = catalog.bodies[k].parent) b_ring_body[k] = true;
+	ring_bodies.clear();
+	for (uint k = 0; k < catalog.body_count; k++) if (b_ring_body[k]) ring_bodies.push_back(k);	// parents first
+
+	// point lights scattered over a sphere around their body; the raw engine output is the same on every platform
+	emitters.clear();
+	std::vector<bool> b_emitter_body(catalog.body_count, false);
+	for (uint k = 0; k < catalog.emitter_count; k++)
+	{
+		const catalog_t::emitter_t& e = catalog.emitters[k];
+		std::mt19937 rng(e.seed);
+		auto uniform = [&]() { return float(rng() >> 8) * (1.0f / 16777216.0f); };
+		for (uint i = 0; i < e.count; i++)
+		{
+			float z = uniform() * 2.0f - 1.0f, phi = uniform() * PI * 2.0f, r = sqrtf(1.0f - z * z);
+			float range = e.range * (0.5f + uniform());
+			emitters.push_back({ int(e.body), vec4(r * cosf(phi), r * sinf(phi), z, 0.0f) * e.altitude + vec4(0, 0, 0, range), vec4(e.color[0], e.color[1], e.color[2], 1.0f) });
+		}
+		for (int b = int(e.body); b >= 0 && !b_emitter_body[b]; b = catalog.bodies[b].parent) b_emitter_body[b] = true;
+	}
+	emitter_bodies.clear();
+	for (uint k = 0; k < catalog.body_count; k++) if (b_emitter_body[k]) emitter_bodies.push_back(k);	// parents first
+
+	// every lit body casts a shadow
+	std::vector<bool> b_shadow_body(catalog.body_count, false);
+	shadow_casters.clear();
+	for (const draw_t& d : body_draws)
+	{
+		if (d.variant & VARIANT_UNLIT) continue;
+		shadow_casters.push_back(uint(d.index));
+		for (int k = d.index; k >= 0 && !b_shadow_body[k]; k = catalog.bodies[k].parent) b_shadow_body[k] = true;
+	}
+	shadow_bodies.clear();
+	for (uint k = 0; k < catalog.body_count; k++) if (b_shadow_body[k]) shadow_bodies.push_back(k);	// parents first
+
+	for (uint k = 0; k < catalog.belt_count; k++)
+	{
+		const catalog_t::belt_t& b = catalog.belts[k];
+		asteroid_belt_t belt;
+		if (!load_texture(b.texture, belt.texture) || belt.texture < 0) { printf("%s(): belt %s has no texture\n", __func__, catalog.str(b.name)); return false; }
+		if (!belt.create(b, asteroid_count < 0 ? b.count : uint(asteroid_count))) return false;
+		belts.push_back(belt);
+	}
+	return true;
+}
+
+// applies the changes found by the watcher between frames; returns true when anything was swapped
+bool hot_reload()
+{
+	auto changes = watcher.take();
+	if (changes.empty()) return false;
+
+	profile_scope_t scope(profiler, "hot reload");
+	bool b_shaders = false;
+	double shader_detected = 0.0;	// of the first shader change in the batch
+	for (auto& c : changes)
+	{
+		if (c.kind == asset_watcher_t::SHADER) { if (!b_shaders) shader_detected = c.detected; b_shaders = true; continue; }
+		for (size_t k = 0; k < textures.size(); k++)
+		{
+			if (texture_paths[k] != c.path) continue;
+			GLuint texture = create_texture(c.img, true); if (!texture) continue;
+			glDeleteTextures(1, &textures[k]);	// the driver keeps it alive while in-flight frames still sample it
+			textures[k] = texture;	// draws refer to the index, so they pick it up as is
+			indirect.update_layer(uint(k), texture);
+			for (uint r = 0; r < ring_draws.size(); r++)
+			{
+				if (ring_draws[r].texture == int(k)) ring_colors.update(r, texture);
+				if (ring_draws[r].alpha == int(k)) ring_alphas.update(r, texture);
+			}
+		}
+		delete c.img;
+		printf("> reloaded %s: decode %.1f ms, %.1f ms from detection\n", c.path.c_str(), c.decode_ms, watcher.now() - c.detected);
+	}
+	if (b_shaders)
+	{
+		double t = watcher.now();
+		if (shaders.reload())
+		{
+			setup_programs();
+			printf("> reloaded shaders: %.1f ms (%.1f ms from detection)\n", watcher.now() - t, watcher.now() - shader_detected);
+		}
+	}
+	return true;
+}
+
 bool user_init()
 {
 	// log hotkeys
@@ -514,54 +1106,150 @@ bool user_init()
 	glEnable(GL_DEPTH_TEST);		// turn on depth tests
 	glEnable(GL_TEXTURE_2D);		// enable texturing
 	glActiveTexture(GL_TEXTURE0);	// notify GL the current texture slot is 0
+	tb.set(cam.eye, cam.at, cam.up);	// the trackball starts from the initial view
+
+	// compile the shader variants up front to avoid hitches in the first frames
+	for (uint key : { 0u, uint(VARIANT_NORMAL_MAP), uint(VARIANT_RING), uint(VARIANT_UNLIT), uint(VARIANT_ASTEROID), uint(VARIANT_INDIRECT), uint(VARIANT_INDIRECT | VARIANT_NORMAL_MAP), uint(VARIANT_INDIRECT | VARIANT_UNLIT) }) if (!shaders.get(key)) return false;
+	if (!oit.create(shaders.cache, oit_vert_path, oit_frag_path)) return false;
+	if (oit.program && !shaders.get(VARIANT_RING | VARIANT_OIT)) return false;
+	if (!deferred.create(shaders.cache, deferred_shader_path)) return false;
+	if (deferred.program) for (uint key : { 0u, uint(VARIANT_NORMAL_MAP), uint(VARIANT_UNLIT), uint(VARIANT_ASTEROID), uint(VARIANT_INDIRECT), uint(VARIANT_INDIRECT | VARIANT_NORMAL_MAP), uint(VARIANT_INDIRECT | VARIANT_UNLIT) }) if (!shaders.get(key | VARIANT_GBUFFER)) return false;
+	if (b_deferred && !deferred.program) { printf("> --deferred is not available\n"); b_deferred = false; }
+
+	setup_programs();
+
+	// bodies, rings and belts of the catalog
+	if (!catalog.load(catalog_path)) return false;
+	spheres = create_spheres(catalog);
+	tree.build(catalog);
+	if (!occlusion.create(shaders.cache, occlusion_vert_path, occlusion_frag_path, catalog.body_count)) return false;
+	float shadow_range = 0.0f;	// the whole system around the Sun
+	for (uint k : tree.roots) shadow_range = std::max(shadow_range, catalog.bodies[k].distance + tree.bound[k]);
+	if (!shadow.create(shaders.cache, shadow_vert_path, shadow_geom_path, shadow_frag_path, shadow_size, shadow_range * 1.01f)) return false;
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, shadow.texture);	// nothing else uses unit 4
+	glActiveTexture(GL_TEXTURE0);
+	if (!hdr.create(shaders.cache, hdr_vert_path, hdr_frag_path)) return false;
+	if (!aa.create(shaders.cache, hdr_vert_path, fxaa_frag_path)) return false;
 
 	unit_sphere_vertices = std::move(create_sphere_vertices());
-	update_vertex_buffer(unit_sphere_vertices);
-
-	unit_ring_vertices = std::move(create_ring_vertcies());
-	update_ring_vertex_buffer(unit_ring_vertices);
-
-	// load the image to a texture
-	PLANETS_TEX[0] = create_texture(sun_image_path, true);		if (!PLANETS_TEX[0]) return false;
-	PLANETS_TEX[1] = create_texture(mercury_image_path, true);	if (!PLANETS_TEX[1]) return false;
-	PLANETS_TEX[2] = create_texture(venus_image_path, true);	if (!PLANETS_TEX[2]) return false;
-	PLANETS_TEX[3] = create_texture(earth_image_path, true);	if (!PLANETS_TEX[3]) return false;
-	PLANETS_TEX[4] = create_texture(mars_image_path, true);		if (!PLANETS_TEX[4]) return false;
-	PLANETS_TEX[5] = create_texture(jupiter_image_path, true);	if (!PLANETS_TEX[5]) return false;
-	PLANETS_TEX[6] = create_texture(saturn_image_path, true);	if (!PLANETS_TEX[6]) return false;
-	PLANETS_TEX[7] = create_texture(uranus_image_path, true);	if (!PLANETS_TEX[7]) return false;
-	PLANETS_TEX[8] = create_texture(neptune_image_path, true);	if (!PLANETS_TEX[8]) return false;
-	PLANETS_TEX[9] = create_texture(moon_image_path, true);		if (!PLANETS_TEX[9]) return false;
-	PLANETS_TEX[10] = create_texture(moon_image_path, true);		if (!PLANETS_TEX[10]) return false;
-	PLANETS_TEX[11] = create_texture(moon_image_path, true);		if (!PLANETS_TEX[11]) return false;
-	PLANETS_TEX[12] = create_texture(moon_image_path, true);		if (!PLANETS_TEX[12]) return false;
-
-	RING_TEX[0] = create_texture(saturn_ring_image_path, true);			if (!RING_TEX[0]) return false;
-	RING_TEX[1] = create_texture(saturn_ring_alpha_image_path, true);	if (!RING_TEX[1]) return false;
-	RING_TEX[2] = create_texture(uranus_ring_image_path, true);			if (!RING_TEX[2]) return false;
-	RING_TEX[3] = create_texture(uranus_ring_alpha_image_path, true);	if (!RING_TEX[3]) return false;
-
-	NORM_TEX_MERCURY = create_texture(mercury_normal_image_path, true);		//index 1
-	NORM_TEX_VENUS = create_texture(venus_normal_image_path, true);		//index 2
-	NORM_TEX_EARTH = create_texture(earth_normal_image_path, true);		//index 3
-	NORM_TEX_MARS = create_texture(mars_normal_image_path, true);			//index 4
-	NORM_TEX_MOON = create_texture(moon_normal_image_path, true);			//index 9
+	unit_sphere_indices = create_sphere_indices();
+	update_vertex_buffer(unit_sphere_vertices, unit_sphere_indices);
+
+	if (!create_ring_vertex_array()) return false;
+
+	// load the images of the catalog to textures and generate the belts
+	profile_scope_t texture_scope(profiler, "texture upload");
+	if (!build_draws()) return false;
+	if (!object_ring.create({ { sizeof(object_t), uint(body_draws.size() + belts.size()) }, { sizeof(ring_instance_t) * ring_draws.size(), 1 } })) return false;	// the worst frame: every body and belt, and one block of all ring instances
+	if (!create_indirect() && b_gpu_driven) { printf("> --gpu-driven is not available\n"); b_gpu_driven = false; }
+
+	// the same mesh and images for the software rasterizer; the ray tracer reads the images from it
+	if (b_software || b_raytrace)
+	{
+		if (b_software && !software.create()) return false;
+		if (b_raytrace && !tracer.create()) return false;
+		tracer.textures = &software.textures;
+		if (b_software) software.set_mesh(unit_sphere_vertices, unit_sphere_indices);
+		for (const std::string& path : texture_paths)
+		{
+			image* i = cg_load_image(path.c_str()); if (!i) return false;
+			software_textures.push_back(software.add_texture(i));
+			delete i;
+		}
+	}
 
 	return true;
 }
 
 void user_finalize()
 {
+	watcher.stop();
+	profiler.dump();
+	object_ring.print_stats();
+	object_ring.destroy();
+	for (auto& b : belts) b.destroy();
+	tree.culler.print_stats("body and subtree spheres");
+	culler.print_stats("ring and belt spheres");
+	occlusion.print_stats();
+	occlusion.destroy();
+	indirect.print_stats();
+	indirect.destroy();
+	oit.destroy();
+	deferred.print_stats();
+	deferred.destroy();
+	shadow.print_stats();
+	shadow.destroy();
+	hdr.destroy();
+	aa.print_stats();
+	aa.destroy();
+	software.print_stats();
+	software.destroy();
+	tracer.print_stats();
+	tracer.destroy();
+	ring_colors.destroy();
+	ring_alphas.destroy();
+	shaders.cache.print_stats();
+	shaders.destroy();
+	catalog.close();
 }
 
 int main(int argc, char* argv[])
 {
+	// --math-bench: the SIMD transforms of simd_math.h against cgmath.h, without a window
+	for (int k = 1; k < argc; k++) if (strcmp(argv[k], "--math-bench") == 0) return simd_math_bench() ? 0 : 1;
+	for (int k = 1; k + 1 < argc; k++)
+	{
+		if (strcmp(argv[k], "--asteroids") == 0) asteroid_count = std::max(0, atoi(argv[k + 1]));
+		else if (strcmp(argv[k], "--shadow-size") == 0) shadow_size = uint(std::max(16, atoi(argv[k + 1])));
+		else if (strcmp(argv[k], "--bloom-levels") == 0) hdr.levels = uint(std::max(1, atoi(argv[k + 1])));	// clamped to hdr_t::MAX_LEVELS
+		else if (strcmp(argv[k], "--bloom-scale") == 0) hdr.scale = uint(std::max(2, atoi(argv[k + 1])));	// 2 or 4
+		else if (strcmp(argv[k], "--exposure") == 0) hdr.exposure = float(atof(argv[k + 1]));
+		else if (strcmp(argv[k], "--msaa") == 0) aa.set_samples(uint(std::max(1, atoi(argv[k + 1]))));	// 1, 2, 4 or 8
+	}
+	for (int k = 1; k < argc; k++)
+	{
+		if (strcmp(argv[k], "--gpu-driven") == 0) b_gpu_driven = true;
+		else if (strcmp(argv[k], "--indirect-reference") == 0) b_gpu_driven = indirect.b_reference = true;	// CPU reference instead of the compute pass
+		else if (strcmp(argv[k], "--indirect-validate") == 0) b_gpu_driven = indirect.b_validate = true;	// compares them every frame
+		else if (strcmp(argv[k], "--deferred") == 0) b_deferred = true;
+		else if (strcmp(argv[k], "--no-shadows") == 0) shadow.enabled = false;
+		else if (strcmp(argv[k], "--hdr") == 0) hdr.enabled = true;
+		else if (strcmp(argv[k], "--fxaa") == 0) aa.mode = antialias_t::FXAA;
+		else if (strcmp(argv[k], "--software") == 0) b_software = true;
+		else if (strcmp(argv[k], "--raytrace") == 0) b_raytrace = true;
+	}
+
+	// headless benchmark: offscreen context, fixed time steps, no event loop
+	if (headless.parse(argc, argv))
+	{
+		window_size = headless.size;
+		if (!headless.create()) { headless.destroy(); return 1; }
+		if (!shaders.load(vert_shader_path, frag_shader_path, { "NORMAL_MAP", "RING", "UNLIT", "ASTEROID", "INDIRECT", "OIT", "GBUFFER" })) { headless.destroy(); return 1; }
+		if (!user_init()) { printf("Failed to user_init()\n"); headless.destroy(); return 1; }
+
+		headless.begin();
+		for (frame = 0; frame < headless.frames; frame++)
+		{
+			profiler.begin_frame();
+			update();
+			render();
+			headless.end_frame(frame);
+			profiler.end_frame();
+		}
+		headless.report(headless.frames);
+
+		user_finalize();
+		headless.destroy();
+		return 0;
+	}
+
 	// create window and initialize OpenGL extensions
 	if (!(window = cg_create_window(window_name, window_size.x, window_size.y))) { glfwTerminate(); return 1; }
 	if (!cg_init_extensions(window)) { glfwTerminate(); return 1; }	// version and extensions
 
 	// initializations and validations
-	if (!(program = cg_create_program(vert_shader_path, frag_shader_path))) { glfwTerminate(); return 1; }	// create and compile shaders/program
+	if (!shaders.load(vert_shader_path, frag_shader_path, { "NORMAL_MAP", "RING", "UNLIT", "ASTEROID", "INDIRECT", "OIT", "GBUFFER" })) { glfwTerminate(); return 1; }	// create and compile shaders/program variants
 	if (!user_init()) { printf("Failed to user_init()\n"); glfwTerminate(); return 1; }					// user initialization
 
 	// register event callbacks
@@ -569,16 +1257,37 @@ int main(int argc, char* argv[])
 	glfwSetKeyCallback(window, keyboard);			// callback for keyboard events
 	glfwSetMouseButtonCallback(window, mouse);	// callback for mouse click inputs
 	glfwSetCursorPosCallback(window, motion);		// callback for mouse movement
+	glfwSetWindowRefreshCallback(window, refresh);	// callback for window damage (e.g., uncovered)
+
+	// hot reload: edit a shader or replace a texture in bin/shaders while running
+	// (only transform.vert/frag are watched; the programs of the other modules are built once in user_init())
+	watcher.profiler = &profiler;
+	watcher.add(vert_shader_path, asset_watcher_t::SHADER);
+	watcher.add(frag_shader_path, asset_watcher_t::SHADER);
+	watcher.start();
+
+	// frame pacing: --vsync (default), --adaptive, --unlimited or --fps N
+	pacer.parse(argc, argv);
+	pacer.set_mode(pacer.mode);
 
 	// enters rendering/event loop
 	for (frame = 0; !glfwWindowShouldClose(window); frame++)
 	{
 		glfwPollEvents();	// polling and processing of events
+		if (tb.advance(glfwGetTime())) cam.view_matrix = tb.view_matrix();	// the camera follows the mouse, smoothed, and coasts after a release
+		if (hot_reload()) pacer.request_redraw();
+		view_state_t state = { theta, cam.view_matrix, window_size, b_wireframe, fc };
+		bool b_dirty = pacer.changed(state) || b_rotate;
+		if (!pacer.begin_frame(b_dirty)) continue;	// nothing changed: the last frame stays on screen
+		profiler.begin_frame();
 		update();			// per-frame update
 		render();			// per-frame render
+		profiler.end_frame();
+		pacer.end_frame();	// sleeps until the next deadline in the target-fps mode
 	}
 
 	// normal termination
+	pacer.print_stats();
 	user_finalize();
 	cg_destroy_window(window);
 
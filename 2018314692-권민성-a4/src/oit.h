@@ -0,0 +1,134 @@
+#pragma once
+#ifndef __OIT_H__
+#define __OIT_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+
+//*************************************
+// weighted blended order-independent transparency (McGuire and Bavoil 2013)
+// - translucent surfaces are drawn in any order into an accumulation/revealage pair:
+//   accumulation (RGBA16F) sums the weighted premultiplied colors with (ONE, ONE),
+//   revealage (R8) multiplies the transmittances with (ZERO, ONE_MINUS_SRC_COLOR)
+// - the opaque depth is copied into the pair's depth buffer, so translucent fragments behind opaque ones are rejected
+// - a fullscreen composite blends the weighted average over the scene with the total transmittance
+// - needs per-target blending (GL 4.0); without it, the caller keeps plain alpha blending
+struct oit_t
+{
+	bool	enabled = true;
+	GLuint	program = 0;				// composite
+	GLuint	fbo = 0, accumulation = 0, revealage = 0, depth_buffer = 0;
+	GLuint	vertex_array = 0;			// empty; the composite triangle comes from gl_VertexID
+	ivec2	size = ivec2(0, 0);
+	GLint	scene_fbo = 0;				// framebuffer that was bound at begin()
+
+	static bool	is_supported() { return GLAD_GL_VERSION_4_0 && glBlendFunci; }
+	bool	create(program_cache_t& cache, const char* vert_path, const char* frag_path);
+	bool	resize(ivec2 new_size);
+	bool	begin(ivec2 viewport_size);	// false when disabled or unsupported: draw with plain blending instead
+	void	end();						// composites over the scene framebuffer
+	void	destroy();
+	void	destroy_targets();
+};
+
+inline bool oit_t::create(program_cache_t& cache, const char* vert_path, const char* frag_path)
+{
+	if (!is_supported()) { enabled = false; printf("> order-independent transparency needs OpenGL 4.0; disabled\n"); return true; }
+	if (!(program = cache.create_program(vert_path, frag_path))) return false;
+	glUniform1i(glGetUniformLocation(program, "ACCUMULATION"), 0);
+	glUniform1i(glGetUniformLocation(program, "REVEALAGE"), 1);
+	glGenVertexArrays(1, &vertex_array);
+	return true;
+}
+
+inline bool oit_t::resize(ivec2 new_size)
+{
+	destroy_targets();
+	size = new_size;
+	auto target = [&](GLuint& texture, GLenum internal_format, GLenum format, GLenum type)
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size.x, size.y, 0, format, type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	};
+	target(accumulation, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+	target(revealage, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+	glGenRenderbuffers(1, &depth_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);	// the format of the default framebuffer, so that the depth can be blitted
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulation, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealage, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+	const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+	bool b_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	if (!b_complete) { printf("%s(): incomplete framebuffer; transparency falls back to blending\n", __func__); destroy_targets(); enabled = false; }
+	return b_complete;
+}
+
+inline bool oit_t::begin(ivec2 viewport_size)
+{
+	if (!enabled || !program) return false;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &scene_fbo);
+	if (viewport_size.x != size.x || viewport_size.y != size.y) { if (!resize(viewport_size)) return false; }
+
+	// opaque depth for the depth test; translucent surfaces do not write depth
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	const GLfloat zero[] = { 0, 0, 0, 0 }, one[] = { 1, 1, 1, 1 };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, one);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunci(0, GL_ONE, GL_ONE);
+	glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+	return true;
+}
+
+inline void oit_t::end()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_DEPTH_TEST);
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);	// the composite writes alpha = revealage
+
+	glUseProgram(program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, accumulation);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, revealage);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vertex_array);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+}
+
+inline void oit_t::destroy_targets()
+{
+	if (fbo) glDeleteFramebuffers(1, &fbo);
+	if (accumulation) glDeleteTextures(1, &accumulation);
+	if (revealage) glDeleteTextures(1, &revealage);
+	if (depth_buffer) glDeleteRenderbuffers(1, &depth_buffer);
+	fbo = accumulation = revealage = depth_buffer = 0;
+	size = ivec2(0, 0);
+}
+
+inline void oit_t::destroy()
+{
+	destroy_targets();
+	if (vertex_array) glDeleteVertexArrays(1, &vertex_array);
+	if (program) glDeleteProgram(program);
+	vertex_array = program = 0;
+}
+
+#endif // __OIT_H__
@@ -0,0 +1,250 @@
+#pragma once
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//*************************************
+// frame profiler
+// - CPU scopes are written to lock-free per-thread ring buffers (single producer each); dump() copies them while
+//   they may still be written, and drops the events that the writer reached during the copy (begin/head indices)
+// - GPU passes are timed with GL_TIME_ELAPSED queries, read back a few frames later without stalls; a frame whose
+//   query slot is still pending is not timed at all, so the GPU averages are taken over the frames that were measured
+// - dump() writes everything as Chrome trace JSON (chrome://tracing or ui.perfetto.dev)
+struct profiler_t
+{
+	struct event_t
+	{
+		const char*	name;		// must be a string literal (kept by pointer)
+		const char*	cat;		// "cpu", "gpu" or "counter"
+		double		ts, dur;	// in microseconds
+		double		value;		// counter value
+	};
+
+	struct thread_ring_t
+	{
+		static const uint	CAPACITY = 1 << 15;	// latest events kept per thread
+		event_t				events[CAPACITY];
+		std::atomic<uint>	begin{ 0 };		// events below begin - CAPACITY are being overwritten
+		std::atomic<uint>	head{ 0 };		// events below head are complete
+		uint				tid = 0;
+		void push(const event_t& e);
+		uint snapshot(std::vector<event_t>& out) const;	// the latest complete events, oldest first; returns the first index
+	};
+
+	struct gpu_pass_t
+	{
+		static const int	LATENCY = 8;		// query slots: frames in flight before a slot is reused
+		GLuint				query[LATENCY] = { 0 };
+		double				issue_ts[LATENCY] = { 0 };
+		bool				pending[LATENCY] = { false };
+	};
+
+	static const int		MAX_THREADS = 64;
+	std::atomic<thread_ring_t*>	rings[MAX_THREADS] = {};
+	std::atomic<int>		ring_count{ 0 };
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+	std::map<const char*, gpu_pass_t> gpu_passes;	// GL thread only
+	const char*				active_pass = nullptr;
+	int						frame_slot = 0;			// which query of each pass is used this frame
+	uint					slot_pending[gpu_pass_t::LATENCY] = {};	// queries of the frame in a slot not read back yet
+	double					slot_sum[gpu_pass_t::LATENCY] = {};		// GPU time read back so far, in microseconds
+	bool					b_gpu_timed = false;	// the passes of this frame are timed (its slot was free)
+	std::vector<std::pair<int, double>> resolved;	// (slot, GPU microseconds) of the frames resolved since begin_frame()
+	double					frame_begin = 0.0;
+	double					frame_gpu_us = 0.0;		// GPU time of the last resolved frame
+	double					frame_wait = 0.0;		// time blocked in the current frame (e.g., swap)
+
+	// running frame statistics
+	uint					frames = 0;
+	uint					gpu_frames = 0, gpu_skipped = 0;	// frames whose passes were timed, and were not
+	double					cpu_sum = 0.0, gpu_sum = 0.0;	// in microseconds; gpu_sum over gpu_frames
+
+	~profiler_t() { for (auto& r : rings) delete r.load(); }
+
+	double	now() const { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count(); }
+	thread_ring_t* thread_ring();
+	void	emit(const char* name, const char* cat, double ts, double dur, double value = 0.0) { thread_ring()->push({ name, cat, ts, dur, value }); }
+	void	counter(const char* name, double value) { emit(name, "counter", now(), 0.0, value); }
+
+	void	begin_frame();
+	void	end_frame();
+	void	begin_gpu(const char* name);
+	void	end_gpu();
+	void	collect_gpu(bool wait = false);
+	void	resolve_slot(int slot);
+	bool	dump(const char* path = "profile.json");
+	void	print_summary() const;
+};
+
+// scoped CPU timer: profile_scope_t scope(profiler, "render");
+// a waiting scope (e.g., buffer swap) is excluded from the CPU time of the frame
+struct profile_scope_t
+{
+	profiler_t&	p;
+	const char*	name;
+	double		t;
+	bool		b_wait;
+	profile_scope_t(profiler_t& profiler, const char* scope_name, bool wait = false) : p(profiler), name(scope_name), t(profiler.now()), b_wait(wait) {}
+	~profile_scope_t() { double dur = p.now() - t; p.emit(name, "cpu", t, dur); if (b_wait) p.frame_wait += dur; }
+};
+
+// scoped GPU timer of a render pass (GL thread only; passes must not nest)
+struct gpu_scope_t
+{
+	profiler_t& p;
+	gpu_scope_t(profiler_t& profiler, const char* pass_name) : p(profiler) { p.begin_gpu(pass_name); }
+	~gpu_scope_t() { p.end_gpu(); }
+};
+
+// begin moves first, so a reader can tell the slot being overwritten from a complete one
+inline void profiler_t::thread_ring_t::push(const event_t& e)
+{
+	uint h = head.load(std::memory_order_relaxed);
+	begin.store(h + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	events[h % CAPACITY] = e;
+	head.store(h + 1, std::memory_order_release);
+}
+
+inline uint profiler_t::thread_ring_t::snapshot(std::vector<event_t>& out) const
+{
+	uint last = head.load(std::memory_order_acquire);
+	uint first = last > CAPACITY ? last - CAPACITY : 0;
+	out.clear();
+	for (uint k = first; k < last; k++) out.push_back(events[k % CAPACITY]);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint b = begin.load(std::memory_order_relaxed);	// events below b - CAPACITY may have been overwritten while copied
+	uint valid = b > CAPACITY ? b - CAPACITY : 0;
+	if (valid > first) out.erase(out.begin(), out.begin() + std::min(size_t(valid - first), out.size()));
+	return std::max(first, valid);
+}
+
+inline profiler_t::thread_ring_t* profiler_t::thread_ring()
+{
+	thread_local thread_ring_t* ring = nullptr;
+	if (ring) return ring;
+
+	int tid = ring_count.fetch_add(1);
+	if (tid >= MAX_THREADS) { static thread_ring_t overflow; return ring = &overflow; }
+	ring = new thread_ring_t;
+	ring->tid = uint(tid);
+	rings[tid].store(ring, std::memory_order_release);
+	return ring;
+}
+
+inline void profiler_t::begin_frame()
+{
+	resolved.clear();	// the previous frame has read them, including a slot that its end_frame() resolved
+	collect_gpu();
+	frame_begin = now();
+	frame_wait = 0.0;
+	b_gpu_timed = slot_pending[frame_slot] == 0;	// else the slot still waits on an older frame: skip instead of stalling
+	if (b_gpu_timed) slot_sum[frame_slot] = 0.0;
+	else gpu_skipped++;
+}
+
+inline void profiler_t::end_frame()
+{
+	double dur = now() - frame_begin;
+	emit("frame", "cpu", frame_begin, dur);
+	frames++;
+	cpu_sum += dur - frame_wait;
+	if (b_gpu_timed && !slot_pending[frame_slot]) resolve_slot(frame_slot);	// no GPU pass in this frame
+	frame_slot = (frame_slot + 1) % gpu_pass_t::LATENCY;
+}
+
+inline void profiler_t::begin_gpu(const char* name)
+{
+	gpu_pass_t& g = gpu_passes[name];
+	if (!g.query[0]) glGenQueries(gpu_pass_t::LATENCY, g.query);
+	if (!b_gpu_timed || g.pending[frame_slot]) return;	// result not read back yet; this frame is not timed
+	glBeginQuery(GL_TIME_ELAPSED, g.query[frame_slot]);
+	g.issue_ts[frame_slot] = now();
+	active_pass = name;
+}
+
+inline void profiler_t::end_gpu()
+{
+	if (!active_pass) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	gpu_passes[active_pass].pending[frame_slot] = true;
+	slot_pending[frame_slot]++;
+	active_pass = nullptr;
+}
+
+inline void profiler_t::collect_gpu(bool wait)
+{
+	for (auto& [name, g] : gpu_passes)
+	{
+		for (int k = 0; k < gpu_pass_t::LATENCY; k++)
+		{
+			if (!g.pending[k]) continue;
+			GLint available = 0;
+			if (!wait) glGetQueryObjectiv(g.query[k], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available && !wait) continue;
+
+			GLuint64 ns = 0; glGetQueryObjectui64v(g.query[k], GL_QUERY_RESULT, &ns);
+			g.pending[k] = false;
+			emit(name, "gpu", g.issue_ts[k], ns / 1000.0);	// placed at issue time on the GPU track
+			slot_sum[k] += ns / 1000.0;
+			if (!--slot_pending[k]) resolve_slot(k);	// the last pass of its frame (collected between frames)
+		}
+	}
+}
+
+// all passes of the frame in a slot are read back
+inline void profiler_t::resolve_slot(int slot)
+{
+	frame_gpu_us = slot_sum[slot];
+	gpu_sum += slot_sum[slot];
+	gpu_frames++;
+	resolved.push_back({ slot, slot_sum[slot] });
+}
+
+inline bool profiler_t::dump(const char* path)
+{
+	collect_gpu(true);
+
+	FILE* fp = fopen(path, "w"); if (!fp) { printf("%s(): unable to open %s\n", __func__, path); return false; }
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}");
+
+	int n = std::min(ring_count.load(), MAX_THREADS);
+	std::vector<event_t> events;
+	for (int t = 0; t < n; t++)
+	{
+		thread_ring_t* r = rings[t].load(std::memory_order_acquire); if (!r) continue;
+		r->snapshot(events);
+		for (const event_t& e : events)
+		{
+			bool gpu = e.cat[0] == 'g';
+			if (e.cat[0] == 'c' && e.cat[1] == 'o') fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}", e.name, r->tid, e.ts, e.value);
+			else fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", e.name, e.cat, gpu ? 1 : 0, gpu ? 0 : r->tid, e.ts, e.dur);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+
+	printf("> profile written to %s\n", path);
+	print_summary();
+	return true;
+}
+
+inline void profiler_t::print_summary() const
+{
+	if (!frames) return;
+	double cpu = cpu_sum / frames / 1000.0, gpu = gpu_frames ? gpu_sum / gpu_frames / 1000.0 : 0.0;
+	printf("[profiler] %u frames: cpu %.3f ms/frame, gpu %.3f ms/frame over %u timed frames -> %s-bound\n", frames, cpu, gpu, gpu_frames, gpu > cpu ? "GPU" : "CPU");
+	if (gpu_skipped) printf("[profiler] %u frames not timed on the GPU: their query slots were still pending\n", gpu_skipped);
+}
+
+#endif // __PROFILER_H__
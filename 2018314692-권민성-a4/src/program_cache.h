@@ -0,0 +1,235 @@
+#pragma once
+#ifndef __PROGRAM_CACHE_H__
+#define __PROGRAM_CACHE_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+#if defined(_WIN32)
+	#include <direct.h>
+#endif
+
+//*************************************
+// on-disk cache of linked program binaries (GL 4.1 glGetProgramBinary/glProgramBinary)
+// - key: 64-bit FNV-1a of the full shader sources plus GL_VENDOR, GL_RENDERER and GL_VERSION
+// - a blob that the driver rejects is deleted and the program is compiled from source again
+// - without GL 4.1, every program is compiled from source
+// - compute programs (GL 4.3) go through the same cache with an empty fragment source in the key;
+//   an optional geometry shader adds its source to the key
+struct program_cache_t
+{
+	struct header_t
+	{
+		uint		magic = 0x48435047;	// "GPCH"
+		uint		format = 0;			// binary format returned by the driver
+		uint64_t	key = 0;			// guards against hash-named files being swapped
+		uint		size = 0;			// bytes of the binary that follows
+		uint		pad = 0;
+	};
+
+	std::string	dir = "cache";		// relative to the working directory (bin)
+	uint		hits = 0, misses = 0;
+	double		load_ms = 0.0, compile_ms = 0.0;
+
+	bool		is_supported() const { return GLAD_GL_VERSION_4_1 && glGetProgramBinary && glProgramBinary; }
+	uint64_t	key(const std::string& vert_source, const std::string& frag_source, const std::string& geom_source = "") const;
+	GLuint		create(const std::string& vert_source, const std::string& frag_source, const std::string& geom_source = "");	// full sources including #version
+	GLuint		create_program(const char* vert_path, const char* frag_path, const char* geom_path = nullptr);				// cached drop-in for cg_create_program()
+	GLuint		create_compute(const char* comp_path);										// "#version 430" is inserted; 0 without GL 4.3
+	void		print_stats() const;
+
+	GLuint		load(uint64_t k);
+	void		store(uint64_t k, GLuint program);
+	std::string	path(uint64_t k) const { char s[32]; snprintf(s, sizeof(s), "%016llx.bin", (unsigned long long) k); return dir + "/" + s; }
+
+	static std::string	version_header();
+	static std::string	read(const char* path);
+	static GLuint		compile(GLenum type, const std::string& source, const char* name);
+	static GLuint		link(GLuint vs, GLuint fs, bool b_retrievable, GLuint gs = 0);	// fs = 0 for a compute shader in vs
+};
+
+inline uint64_t program_cache_t::key(const std::string& vert_source, const std::string& frag_source, const std::string& geom_source) const
+{
+	uint64_t h = 14695981039346656037ull;	// FNV-1a
+	auto hash = [&](const char* s) { for (; s && *s; s++) { h ^= (unsigned char) *s; h *= 1099511628211ull; } h ^= 0xff; h *= 1099511628211ull; };
+	hash(vert_source.c_str());
+	hash(frag_source.c_str());
+	if (!geom_source.empty()) hash(geom_source.c_str());	// the keys of vertex/fragment programs stay as they were
+	hash((const char*) glGetString(GL_VENDOR));
+	hash((const char*) glGetString(GL_RENDERER));
+	hash((const char*) glGetString(GL_VERSION));
+	return h;
+}
+
+inline std::string program_cache_t::version_header()
+{
+#ifdef GL_ES_VERSION_2_0
+	return "#version 300 es\n";
+#else
+	return "#version 330\n";
+#endif
+}
+
+inline std::string program_cache_t::read(const char* path)
+{
+	FILE* fp = fopen(path, "rb"); if (!fp) { printf("%s(): unable to open %s\n", __func__, path); return ""; }
+	fseek(fp, 0, SEEK_END); size_t size = ftell(fp); fseek(fp, 0, SEEK_SET);
+	std::string s(size, '\0');
+	size_t n = fread(&s[0], 1, size, fp); fclose(fp);
+	s.resize(n);
+	return s;
+}
+
+inline GLuint program_cache_t::compile(GLenum type, const std::string& source, const char* name)
+{
+	GLuint shader = glCreateShader(type);
+	const char* src = source.c_str();
+	glShaderSource(shader, 1, &src, nullptr);
+	glCompileShader(shader);
+
+	GLint status = 0; glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		char log[4096] = ""; glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		printf("%s(): failed to compile %s\n%s\n", __func__, name, log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+inline GLuint program_cache_t::link(GLuint vs, GLuint fs, bool b_retrievable, GLuint gs)
+{
+	GLuint program = glCreateProgram();
+	if (b_retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glAttachShader(program, vs);
+	if (fs) glAttachShader(program, fs);
+	if (gs) glAttachShader(program, gs);
+	glLinkProgram(program);
+	glDetachShader(program, vs);
+	if (fs) glDetachShader(program, fs);
+	if (gs) glDetachShader(program, gs);
+
+	GLint status = 0; glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		char log[4096] = ""; glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		printf("%s(): failed to link program\n%s\n", __func__, log);
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+inline GLuint program_cache_t::load(uint64_t k)
+{
+	std::string p = path(k);
+	FILE* fp = fopen(p.c_str(), "rb"); if (!fp) return 0;
+	header_t h, expected;
+	std::vector<char> blob;
+	bool b_valid = fread(&h, sizeof(h), 1, fp) == 1 && h.magic == expected.magic && h.key == k && h.size > 0;
+	if (b_valid) { blob.resize(h.size); b_valid = fread(blob.data(), 1, h.size, fp) == h.size; }
+	fclose(fp);
+
+	GLuint program = 0;
+	if (b_valid)
+	{
+		program = glCreateProgram();
+		glProgramBinary(program, GLenum(h.format), blob.data(), GLsizei(h.size));
+		GLint status = 0; glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (!status) { glDeleteProgram(program); program = 0; }
+	}
+	if (!program) { printf("> program cache: discarding invalid %s\n", p.c_str()); remove(p.c_str()); }
+	return program;
+}
+
+inline void program_cache_t::store(uint64_t k, GLuint program)
+{
+	GLint size = 0; glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size); if (size <= 0) return;
+	std::vector<char> blob(size);
+	header_t h; h.key = k;
+	GLenum format = 0; GLsizei length = 0;
+	glGetProgramBinary(program, size, &length, &format, blob.data());
+	if (length <= 0) return;
+	h.format = uint(format); h.size = uint(length);
+
+#if defined(_WIN32)
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+	std::string p = path(k), tmp = p + ".tmp";	// written aside and renamed so that a crash never leaves a torn blob
+	FILE* fp = fopen(tmp.c_str(), "wb"); if (!fp) { printf("%s(): unable to write %s\n", __func__, tmp.c_str()); return; }
+	bool b_ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(blob.data(), 1, h.size, fp) == h.size;
+	fclose(fp);
+	remove(p.c_str());
+	if (!b_ok || rename(tmp.c_str(), p.c_str()) != 0) remove(tmp.c_str());
+}
+
+inline GLuint program_cache_t::create(const std::string& vert_source, const std::string& frag_source, const std::string& geom_source)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	auto elapsed = [&]() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+
+	bool b_cache = is_supported();
+	uint64_t k = b_cache ? key(vert_source, frag_source, geom_source) : 0;
+	if (b_cache)
+	{
+		if (GLuint program = load(k)) { hits++; load_ms += elapsed(); return program; }
+	}
+
+	GLuint vs = compile(GL_VERTEX_SHADER, vert_source, "vertex shader");
+	GLuint fs = compile(GL_FRAGMENT_SHADER, frag_source, "fragment shader");
+	GLuint gs = geom_source.empty() ? 0 : compile(GL_GEOMETRY_SHADER, geom_source, "geometry shader");
+	GLuint program = vs && fs && (gs || geom_source.empty()) ? link(vs, fs, b_cache, gs) : 0;
+	if (vs) glDeleteShader(vs);
+	if (fs) glDeleteShader(fs);
+	if (gs) glDeleteShader(gs);
+	if (program && b_cache) store(k, program);
+	misses++; compile_ms += elapsed();
+	return program;
+}
+
+inline GLuint program_cache_t::create_program(const char* vert_path, const char* frag_path, const char* geom_path)
+{
+	std::string vs = read(vert_path); if (vs.empty()) return 0;
+	std::string fs = read(frag_path); if (fs.empty()) return 0;
+	std::string gs = geom_path ? read(geom_path) : std::string(); if (geom_path && gs.empty()) return 0;
+	std::string h = version_header();
+	GLuint program = create(h + vs, h + fs, geom_path ? h + gs : std::string());
+	if (program) glUseProgram(program);	// left bound as cg_create_program() does
+	return program;
+}
+
+inline GLuint program_cache_t::create_compute(const char* comp_path)
+{
+	if (!GLAD_GL_VERSION_4_3 || !glDispatchCompute) { printf("%s(): %s needs OpenGL 4.3\n", __func__, comp_path); return 0; }
+	std::string cs = read(comp_path); if (cs.empty()) return 0;
+	cs = "#version 430\n" + cs;
+
+	auto t0 = std::chrono::steady_clock::now();
+	auto elapsed = [&]() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+	bool b_cache = is_supported();
+	uint64_t k = b_cache ? key(cs, "") : 0;
+	if (b_cache)
+	{
+		if (GLuint program = load(k)) { hits++; load_ms += elapsed(); return program; }
+	}
+
+	GLuint shader = compile(GL_COMPUTE_SHADER, cs, comp_path);
+	GLuint program = shader ? link(shader, 0, b_cache) : 0;
+	if (shader) glDeleteShader(shader);
+	if (program && b_cache) store(k, program);
+	misses++; compile_ms += elapsed();
+	return program;
+}
+
+inline void program_cache_t::print_stats() const
+{
+	if (!is_supported()) { printf("[program cache] disabled (needs OpenGL 4.1)\n"); return; }
+	printf("[program cache] %u hits (%.1f ms), %u compiled (%.1f ms)\n", hits, load_ms, misses, compile_ms);
+}
+
+#endif // __PROGRAM_CACHE_H__
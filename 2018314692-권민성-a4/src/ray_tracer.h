@@ -0,0 +1,411 @@
+#pragma once
+#ifndef __RAY_TRACER_H__
+#define __RAY_TRACER_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include "soft_raster.h"
+#include <atomic>
+#include <cstdint>
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define RAY_TRACER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define RAY_TRACER_SSE
+#endif
+
+//*************************************
+// 8 lanes of a ray packet: one AVX register, two SSE registers, or a plain array elsewhere
+// (masks are all-ones/all-zeros lanes as the SIMD compares produce them; 1/0 in the plain array)
+struct float8_t
+{
+#if defined(RAY_TRACER_AVX)
+	__m256	v;
+#elif defined(RAY_TRACER_SSE)
+	__m128	lo, hi;
+#else
+	float	v[8];
+#endif
+};
+
+#if defined(RAY_TRACER_AVX)
+inline float8_t f8(__m256 v) { float8_t r; r.v = v; return r; }
+inline float8_t f8_set1(float f) { return f8(_mm256_set1_ps(f)); }
+inline float8_t f8_load(const float* p) { return f8(_mm256_loadu_ps(p)); }
+inline void		f8_store(float* p, float8_t a) { _mm256_storeu_ps(p, a.v); }
+inline float8_t f8_add(float8_t a, float8_t b) { return f8(_mm256_add_ps(a.v, b.v)); }
+inline float8_t f8_sub(float8_t a, float8_t b) { return f8(_mm256_sub_ps(a.v, b.v)); }
+inline float8_t f8_mul(float8_t a, float8_t b) { return f8(_mm256_mul_ps(a.v, b.v)); }
+inline float8_t f8_min(float8_t a, float8_t b) { return f8(_mm256_min_ps(a.v, b.v)); }
+inline float8_t f8_max(float8_t a, float8_t b) { return f8(_mm256_max_ps(a.v, b.v)); }
+inline float8_t f8_sqrt(float8_t a) { return f8(_mm256_sqrt_ps(a.v)); }
+inline float8_t f8_lt(float8_t a, float8_t b) { return f8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+inline float8_t f8_le(float8_t a, float8_t b) { return f8(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+inline float8_t f8_and(float8_t a, float8_t b) { return f8(_mm256_and_ps(a.v, b.v)); }
+inline float8_t f8_select(float8_t m, float8_t a, float8_t b) { return f8(_mm256_blendv_ps(b.v, a.v, m.v)); }
+inline int		f8_mask(float8_t m) { return _mm256_movemask_ps(m.v); }
+#elif defined(RAY_TRACER_SSE)
+inline float8_t f8(__m128 lo, __m128 hi) { float8_t r; r.lo = lo; r.hi = hi; return r; }
+inline float8_t f8_set1(float f) { return f8(_mm_set1_ps(f), _mm_set1_ps(f)); }
+inline float8_t f8_load(const float* p) { return f8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+inline void		f8_store(float* p, float8_t a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+inline float8_t f8_add(float8_t a, float8_t b) { return f8(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+inline float8_t f8_sub(float8_t a, float8_t b) { return f8(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+inline float8_t f8_mul(float8_t a, float8_t b) { return f8(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+inline float8_t f8_min(float8_t a, float8_t b) { return f8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+inline float8_t f8_max(float8_t a, float8_t b) { return f8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+inline float8_t f8_sqrt(float8_t a) { return f8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+inline float8_t f8_lt(float8_t a, float8_t b) { return f8(_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)); }
+inline float8_t f8_le(float8_t a, float8_t b) { return f8(_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)); }
+inline float8_t f8_and(float8_t a, float8_t b) { return f8(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+inline float8_t f8_select(float8_t m, float8_t a, float8_t b) { return f8(_mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo)), _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi))); }
+inline int		f8_mask(float8_t m) { return _mm_movemask_ps(m.lo) | (_mm_movemask_ps(m.hi) << 4); }
+#else
+#define F8_LANES(expr) float8_t r; for (int k = 0; k < 8; k++) r.v[k] = (expr); return r
+inline float8_t f8_set1(float f) { F8_LANES(f); }
+inline float8_t f8_load(const float* p) { F8_LANES(p[k]); }
+inline void		f8_store(float* p, float8_t a) { for (int k = 0; k < 8; k++) p[k] = a.v[k]; }
+inline float8_t f8_add(float8_t a, float8_t b) { F8_LANES(a.v[k] + b.v[k]); }
+inline float8_t f8_sub(float8_t a, float8_t b) { F8_LANES(a.v[k] - b.v[k]); }
+inline float8_t f8_mul(float8_t a, float8_t b) { F8_LANES(a.v[k] * b.v[k]); }
+inline float8_t f8_min(float8_t a, float8_t b) { F8_LANES(std::min(a.v[k], b.v[k])); }
+inline float8_t f8_max(float8_t a, float8_t b) { F8_LANES(std::max(a.v[k], b.v[k])); }
+inline float8_t f8_sqrt(float8_t a) { F8_LANES(sqrtf(a.v[k])); }
+inline float8_t f8_lt(float8_t a, float8_t b) { F8_LANES(a.v[k] < b.v[k] ? 1.0f : 0.0f); }
+inline float8_t f8_le(float8_t a, float8_t b) { F8_LANES(a.v[k] <= b.v[k] ? 1.0f : 0.0f); }
+inline float8_t f8_and(float8_t a, float8_t b) { F8_LANES(a.v[k] != 0.0f && b.v[k] != 0.0f ? 1.0f : 0.0f); }
+inline float8_t f8_select(float8_t m, float8_t a, float8_t b) { F8_LANES(m.v[k] != 0.0f ? a.v[k] : b.v[k]); }
+inline int		f8_mask(float8_t m) { int bits = 0; for (int k = 0; k < 8; k++) bits |= (m.v[k] != 0.0f) << k; return bits; }
+#undef F8_LANES
+#endif
+
+//*************************************
+// multithreaded CPU ray tracer of the bodies: exact spheres with hard shadows from the Sun
+// - the bodies of a frame (center, radius and the rotation of their model matrices) go into a BVH,
+//   built top-down by median splits along the widest axis of the centers
+// - rays travel in packets of 8 (4x2 pixels, or the shadow rays of those pixels): a node is entered when any ray
+//   of the packet hits its box, and each leaf sphere is intersected with all 8 rays at once (float8_t)
+// - hits are shaded one by one as phong() in transform.frag, with the texture at the analytic uv of the sphere mesh;
+//   unlit bodies (the Sun) are emitted as they are and cast no shadows
+// - the threads of a worker_pool_t take 16x8-pixel tiles from an atomic counter; throughput is kept as Mrays/s
+// - rings and belts are not traced
+struct ray_tracer_t
+{
+	static const int TILE_W = 16, TILE_H = 8, LEAF_SIZE = 2;
+	struct body_t { vec3 center; float radius; mat3 to_local; int texture; bool unlit; };	// to_local: world offsets to the unit sphere
+	struct node_t { vec3 lo, hi; int first, count; };	// count > 0: leaf of order[first, first+count); otherwise children first and first+1
+	struct packet_t { float8_t ox, oy, oz, dx, dy, dz, ix, iy, iz; };	// origins, unit directions and their inverses
+	typedef soft_rasterizer_t::lighting_t lighting_t;
+
+	std::vector<body_t>	bodies;				// of the current frame
+	std::vector<uint>	order;				// body indices in BVH leaf order
+	std::vector<node_t>	nodes;
+	const std::vector<soft_rasterizer_t::texture_t>* textures = nullptr;	// shared with soft_raster.h
+	std::vector<uint32_t>	color;			// bottom-up rows of stride pixels, as glReadPixels
+	ivec2	size = ivec2(0, 0);
+	int		stride = 0, tiles_x = 0, tiles_y = 0;
+	vec3	eye, right, up, forward;		// camera frame; right and up are scaled to the image plane at distance 1
+	lighting_t	lighting;
+	uint32_t	clear_color = 0;
+	worker_pool_t		pool;
+	std::atomic<uint>	next_tile{ 0 };
+
+	// GL side of present()
+	GLuint	texture = 0, read_fbo = 0;
+	ivec2	texture_size = ivec2(0, 0);
+
+	// statistics
+	uint		frames = 0;
+	std::atomic<uint64_t>	rays{ 0 };		// primary and shadow rays
+	double		build_us = 0.0, trace_us = 0.0;
+
+	bool	create(uint thread_count = 0);
+	void	begin(ivec2 viewport_size, const mat4& view, const mat4& projection, const lighting_t& l, vec4 background);
+	void	add(const mat4& model, int texture_index, bool b_unlit);
+	void	end(profiler_t& profiler);		// BVH and tracing, in a CPU scope each
+	void	present();
+	void	print_stats() const;
+	void	destroy();
+
+	void	build();
+	int		split(int node, uint first, uint count);
+	uint	trace(const packet_t& p, float8_t& t, int hit[8], bool b_shadow) const;	// closest hits, or any occluder of the shadow rays; returns the active lanes
+	void	trace_tile(uint tile);
+	vec4	shade(const body_t& b, vec3 p, vec3 d, float s) const;
+};
+
+inline bool ray_tracer_t::create(uint thread_count)
+{
+	pool.create(thread_count);
+	glGenTextures(1, &texture);
+	glGenFramebuffers(1, &read_fbo);
+	printf("> ray tracer: %u threads, %dx%d tiles, 8-ray packets (%s)\n", pool.thread_count(), TILE_W, TILE_H,
+#if defined(RAY_TRACER_AVX)
+		"AVX");
+#elif defined(RAY_TRACER_SSE)
+		"SSE");
+#else
+		"scalar");
+#endif
+	return texture && read_fbo;
+}
+
+inline void ray_tracer_t::begin(ivec2 viewport_size, const mat4& view, const mat4& projection, const lighting_t& l, vec4 background)
+{
+	if (viewport_size.x != size.x || viewport_size.y != size.y)
+	{
+		size = viewport_size;
+		tiles_x = (size.x + TILE_W - 1) / TILE_W; tiles_y = (size.y + TILE_H - 1) / TILE_H;
+		stride = tiles_x * TILE_W;
+		color.resize(size_t(stride) * tiles_y * TILE_H);
+	}
+	// view [R|t] (row-major): the rows of R are the camera axes, and the eye is -R^T t
+	vec3 r0(view[0], view[1], view[2]), r1(view[4], view[5], view[6]), r2(view[8], view[9], view[10]);
+	eye = vec3(0.0f) - (r0 * view[3] + r1 * view[7] + r2 * view[11]);
+	right = r0 * (1.0f / projection[0]); up = r1 * (1.0f / projection[5]); forward = vec3(0.0f) - r2;
+	lighting = l;
+	clear_color = soft_rasterizer_t::pack(background);
+	bodies.clear();
+}
+
+inline void ray_tracer_t::add(const mat4& model, int texture_index, bool b_unlit)
+{
+	// uniform scale s and rotation R in the upper 3x3 (s R); the unit sphere is R^T (p - c) / s
+	float s2 = model[0] * model[0] + model[4] * model[4] + model[8] * model[8];
+	mat3 to_local = mat3(model[0], model[4], model[8], model[1], model[5], model[9], model[2], model[6], model[10]);
+	for (int k = 0; k < 9; k++) to_local.a[k] /= s2;
+	bodies.push_back({ vec3(model[3], model[7], model[11]), sqrtf(s2), to_local, texture_index, b_unlit });
+}
+
+inline void ray_tracer_t::end(profiler_t& profiler)
+{
+	double t0 = profiler.now();
+	{
+		profile_scope_t scope(profiler, "bvh build");
+		build();
+	}
+	double t1 = profiler.now();
+	{
+		profile_scope_t scope(profiler, "ray tracing");
+		next_tile = 0;
+		pool.run([this]()
+		{
+			uint tile_count = uint(tiles_x * tiles_y);
+			for (uint tile; (tile = next_tile.fetch_add(1)) < tile_count;) trace_tile(tile);
+		});
+	}
+	build_us += t1 - t0;
+	trace_us += profiler.now() - t1;
+	frames++;
+}
+
+inline void ray_tracer_t::build()
+{
+	order.resize(bodies.size());
+	for (uint k = 0; k < order.size(); k++) order[k] = k;
+	nodes.clear();
+	nodes.push_back(node_t());
+	if (!bodies.empty()) split(0, 0, uint(bodies.size()));
+}
+
+inline int ray_tracer_t::split(int node, uint first, uint count)
+{
+	vec3 lo(1e30f), hi(-1e30f), clo(1e30f), chi(-1e30f);	// bounds of the spheres and of their centers
+	for (uint k = first; k < first + count; k++)
+	{
+		const body_t& b = bodies[order[k]];
+		lo = vec3(std::min(lo.x, b.center.x - b.radius), std::min(lo.y, b.center.y - b.radius), std::min(lo.z, b.center.z - b.radius));
+		hi = vec3(std::max(hi.x, b.center.x + b.radius), std::max(hi.y, b.center.y + b.radius), std::max(hi.z, b.center.z + b.radius));
+		clo = vec3(std::min(clo.x, b.center.x), std::min(clo.y, b.center.y), std::min(clo.z, b.center.z));
+		chi = vec3(std::max(chi.x, b.center.x), std::max(chi.y, b.center.y), std::max(chi.z, b.center.z));
+	}
+	nodes[node].lo = lo; nodes[node].hi = hi;
+	if (count <= uint(LEAF_SIZE)) { nodes[node].first = int(first); nodes[node].count = int(count); return node; }
+
+	vec3 extent = chi - clo;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+	uint half = count / 2;
+	auto key = [&](uint k) { const vec3& c = bodies[k].center; return axis == 0 ? c.x : axis == 1 ? c.y : c.z; };
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&](uint a, uint b) { return key(a) < key(b); });
+
+	int children = int(nodes.size());
+	nodes.push_back(node_t()); nodes.push_back(node_t());
+	nodes[node].first = children; nodes[node].count = 0;
+	split(children, first, half);
+	split(children + 1, first + half, count - half);
+	return node;
+}
+
+inline uint ray_tracer_t::trace(const packet_t& p, float8_t& t, int hit[8], bool b_shadow) const
+{
+	const float8_t zero = f8_set1(0.0f), eps = f8_set1(1e-4f);
+	uint occluded = 0, active = uint(f8_mask(f8_lt(zero, t)));	// lanes with t <= 0 take no part
+	if (!active || bodies.empty()) return active;
+	int stack[64], sp = 0;
+	stack[sp++] = 0;
+	while (sp)
+	{
+		const node_t& n = nodes[stack[--sp]];
+
+		// slab test of the box against the 8 rays
+		float8_t ax = f8_mul(f8_sub(f8_set1(n.lo.x), p.ox), p.ix), bx = f8_mul(f8_sub(f8_set1(n.hi.x), p.ox), p.ix);
+		float8_t ay = f8_mul(f8_sub(f8_set1(n.lo.y), p.oy), p.iy), by = f8_mul(f8_sub(f8_set1(n.hi.y), p.oy), p.iy);
+		float8_t az = f8_mul(f8_sub(f8_set1(n.lo.z), p.oz), p.iz), bz = f8_mul(f8_sub(f8_set1(n.hi.z), p.oz), p.iz);
+		float8_t tmin = f8_max(f8_max(f8_min(ax, bx), f8_min(ay, by)), f8_min(az, bz));
+		float8_t tmax = f8_min(f8_min(f8_max(ax, bx), f8_max(ay, by)), f8_max(az, bz));
+		float8_t enter = f8_and(f8_and(f8_le(tmin, tmax), f8_le(zero, tmax)), f8_lt(tmin, t));
+		if (!(f8_mask(enter) & active & ~occluded)) continue;
+		if (n.count == 0) { stack[sp++] = n.first + 1; stack[sp++] = n.first; continue; }
+
+		for (int k = n.first; k < n.first + n.count; k++)
+		{
+			const body_t& b = bodies[order[k]];
+			if (b_shadow && b.unlit) continue;	// the Sun does not shadow its own light
+			float8_t cx = f8_sub(p.ox, f8_set1(b.center.x)), cy = f8_sub(p.oy, f8_set1(b.center.y)), cz = f8_sub(p.oz, f8_set1(b.center.z));
+			float8_t hb = f8_add(f8_add(f8_mul(cx, p.dx), f8_mul(cy, p.dy)), f8_mul(cz, p.dz));	// unit directions: t^2 + 2 hb t + c = 0
+			float8_t c = f8_sub(f8_add(f8_add(f8_mul(cx, cx), f8_mul(cy, cy)), f8_mul(cz, cz)), f8_set1(b.radius * b.radius));
+			float8_t disc = f8_sub(f8_mul(hb, hb), c);
+			float8_t root = f8_sqrt(f8_max(disc, zero));
+			float8_t t0 = f8_sub(f8_sub(zero, hb), root), t1 = f8_add(f8_sub(zero, hb), root);
+			float8_t th = f8_select(f8_lt(eps, t0), t0, t1);	// the far side when the origin is inside
+			float8_t m = f8_and(f8_and(f8_le(zero, disc), f8_lt(eps, th)), f8_lt(th, t));
+			uint bits = uint(f8_mask(m)) & active;
+			if (!bits) continue;
+			if (b_shadow) { occluded |= bits; if ((occluded & active) == active) return active; continue; }
+			t = f8_select(m, th, t);
+			for (int l = 0; l < 8; l++) if (bits & (1u << l)) hit[l] = int(order[k]);
+		}
+	}
+	if (b_shadow) for (int l = 0; l < 8; l++) hit[l] = (occluded >> l) & 1;
+	return active;
+}
+
+inline void ray_tracer_t::trace_tile(uint tile)
+{
+	int tx = int(tile % tiles_x) * TILE_W, ty = int(tile / tiles_x) * TILE_H;
+	uint64_t count = 0;
+	for (int y = ty; y < ty + TILE_H; y += 2)
+	{
+		for (int x = tx; x < tx + TILE_W; x += 4)
+		{
+			// primary rays through the pixel centers of a 4x2 block
+			float o[3][8], d[3][8], inv[3][8], tl[8];
+			for (int l = 0; l < 8; l++)
+			{
+				float nx = (x + (l & 3) + 0.5f) / size.x * 2.0f - 1.0f, ny = (y + (l >> 2) + 0.5f) / size.y * 2.0f - 1.0f;
+				vec3 dir = (forward + right * nx + up * ny).normalize();
+				o[0][l] = eye.x; o[1][l] = eye.y; o[2][l] = eye.z;
+				d[0][l] = dir.x; d[1][l] = dir.y; d[2][l] = dir.z;
+				for (int a = 0; a < 3; a++) inv[a][l] = 1.0f / d[a][l];
+				tl[l] = x + (l & 3) < size.x && y + (l >> 2) < size.y ? 1e30f : 0.0f;	// lanes past the image stay idle
+			}
+			packet_t p = { f8_load(o[0]), f8_load(o[1]), f8_load(o[2]), f8_load(d[0]), f8_load(d[1]), f8_load(d[2]), f8_load(inv[0]), f8_load(inv[1]), f8_load(inv[2]) };
+			float8_t t = f8_load(tl);
+			int hit[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+			for (uint bits = trace(p, t, hit, false); bits; bits &= bits - 1) count++;
+			f8_store(tl, t);
+
+			// shadow rays from the lit hits to the light
+			float st[8], sd[3][8], so[3][8], sinv[3][8];
+			vec3 points[8];
+			vec4 lp = lighting.position;
+			for (int l = 0; l < 8; l++)
+			{
+				st[l] = 0.0f; so[0][l] = so[1][l] = so[2][l] = 0.0f; sd[0][l] = sd[1][l] = sd[2][l] = sinv[0][l] = sinv[1][l] = sinv[2][l] = 1.0f;
+				if (hit[l] < 0) continue;
+				const body_t& b = bodies[hit[l]];
+				vec3 q = vec3(o[0][l], o[1][l], o[2][l]) + vec3(d[0][l], d[1][l], d[2][l]) * tl[l];
+				points[l] = q;
+				if (b.unlit) continue;
+				vec3 n = (q - b.center) * (1.0f / b.radius);
+				vec3 to_light = lp.w == 0.0f ? vec3(lp.x, lp.y, lp.z) : vec3(lp.x, lp.y, lp.z) - q;
+				float dist = lp.w == 0.0f ? 1e30f : to_light.length();
+				vec3 ld = to_light.normalize();
+				if (ld.dot(n) <= 0.0f) continue;	// facing away: no diffuse or specular to shadow
+				vec3 so_l = q + n * (b.radius * 1e-3f);
+				so[0][l] = so_l.x; so[1][l] = so_l.y; so[2][l] = so_l.z;
+				sd[0][l] = ld.x; sd[1][l] = ld.y; sd[2][l] = ld.z;
+				for (int a = 0; a < 3; a++) sinv[a][l] = 1.0f / sd[a][l];
+				st[l] = dist;
+			}
+			packet_t sp = { f8_load(so[0]), f8_load(so[1]), f8_load(so[2]), f8_load(sd[0]), f8_load(sd[1]), f8_load(sd[2]), f8_load(sinv[0]), f8_load(sinv[1]), f8_load(sinv[2]) };
+			float8_t s = f8_load(st);
+			int shadowed[8] = {};
+			for (uint bits = trace(sp, s, shadowed, true); bits; bits &= bits - 1) count++;
+
+			for (int l = 0; l < 8; l++)
+			{
+				int px = x + (l & 3), py = y + (l >> 2);
+				if (px >= size.x || py >= size.y) continue;
+				uint32_t& c = color[size_t(py) * stride + px];
+				if (hit[l] < 0) { c = clear_color; continue; }
+				float visibility = st[l] > 0.0f && shadowed[l] ? 0.0f : 1.0f;
+				c = soft_rasterizer_t::pack(shade(bodies[hit[l]], points[l], vec3(d[0][l], d[1][l], d[2][l]), visibility));
+			}
+		}
+	}
+	rays += count;
+}
+
+// phong() of transform.frag in world space (the view is rigid), with the uv of create_sphere_vertices()
+inline vec4 ray_tracer_t::shade(const body_t& b, vec3 p, vec3 d, float s) const
+{
+	vec3 u = b.to_local * (p - b.center);	// on the unit sphere of the mesh
+	float theta = acosf(std::min(std::max(u.z, -1.0f), 1.0f)), phi = atan2f(u.y, u.x);
+	if (phi < 0.0f) phi += 2.0f * PI;
+	vec2 tc(phi / (2.0f * PI), 1.0f - theta / PI);
+	vec4 albedo = b.texture < 0 ? vec4(1.0f, 1.0f, 1.0f, 1.0f) : (*textures)[b.texture].sample(tc);
+	if (b.unlit) return albedo;
+
+	vec3 n = (p - b.center).normalize();
+	vec4 lp = lighting.position;
+	vec3 l = (vec3(lp.x, lp.y, lp.z) - (lp.w == 0.0f ? vec3(0.0f) : p)).normalize();
+	vec3 v = (vec3(0.0f) - d).normalize();
+	vec3 h = (l + v).normalize();
+	auto clamp0 = [](vec4 c) { return vec4(std::max(c.x, 0.0f), std::max(c.y, 0.0f), std::max(c.z, 0.0f), std::max(c.w, 0.0f)); };
+	vec4 Ira = lighting.Ka * lighting.Ia;
+	vec4 Ird = clamp0(albedo * lighting.Id * l.dot(n));
+	vec4 Irs = clamp0(lighting.Ks * lighting.Is * powf(std::max(h.dot(n), 0.0f), lighting.shininess));
+	return Ira + (Ird + Irs) * s;
+}
+
+inline void ray_tracer_t::present()
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+	if (texture_size.x != size.x || texture_size.y != size.y)
+	{
+		texture_size = size;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, color.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, color.data());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	GLint draw_fbo = 0; glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, draw_fbo);
+}
+
+inline void ray_tracer_t::print_stats() const
+{
+	if (!frames) return;
+	printf("[ray tracer] %u frames, %u bodies in %u BVH nodes: build %.3f ms/frame, trace %.3f ms/frame on %u threads\n", frames, uint(bodies.size()), uint(nodes.size()), build_us / frames / 1000.0, trace_us / frames / 1000.0, pool.thread_count());
+	printf("[ray tracer] %.2f Mrays per frame (primary and shadow), %.2f Mrays/s\n", rays.load() / 1e6 / frames, trace_us > 0.0 ? rays.load() / trace_us : 0.0);
+}
+
+inline void ray_tracer_t::destroy()
+{
+	pool.destroy();
+	if (texture) glDeleteTextures(1, &texture);
+	if (read_fbo) glDeleteFramebuffers(1, &read_fbo);
+	texture = read_fbo = 0;
+	texture_size = ivec2(0, 0);
+}
+
+#endif // __RAY_TRACER_H__
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef __SHADER_VARIANTS_H__
+#define __SHADER_VARIANTS_H__
+#include "cgmath.h"
+#include "cgut.h"
+#include "program_cache.h"
+#include <map>
+#include <string>
+
+//*************************************
+// compile-time permutations of one vertex/fragment shader pair
+// - bit k of a variant key inserts "#define features[k]" right after the #version line
+// - each permutation is built on first use and cached by its key; program_cache_t skips the compilation across runs
+struct shader_variants_t
+{
+	program_cache_t				cache;
+	std::string					vert_path, frag_path;
+	std::string					vert_source, frag_source;
+	std::vector<const char*>	features;			// names of the feature bits
+	std::map<uint, GLuint>		programs;			// variant key -> program
+
+	bool	load(const char* vert_path, const char* frag_path, const std::vector<const char*>& feature_names);
+	GLuint	get(uint key);							// 0 when compilation failed
+	bool	reload();								// rebuilds all variants from the files; keeps the old ones on failure
+	void	destroy();
+	std::string	header(uint key) const;
+
+	// binds each compiled program in turn, e.g., to set the same uniforms in all variants
+	template <class F> void for_each(F f) { for (auto& [key, p] : programs) { glUseProgram(p); f(p); } }
+};
+
+inline bool shader_variants_t::load(const char* vert_path, const char* frag_path, const std::vector<const char*>& feature_names)
+{
+	this->vert_path = vert_path; this->frag_path = frag_path;
+	vert_source = program_cache_t::read(vert_path); if (vert_source.empty()) return false;
+	frag_source = program_cache_t::read(frag_path); if (frag_source.empty()) return false;
+	features = feature_names;
+	return get(0) != 0;
+}
+
+inline std::string shader_variants_t::header(uint key) const
+{
+	std::string h = program_cache_t::version_header();
+	for (uint k = 0; k < features.size(); k++)
+		if (key & (1u << k)) h += std::string("#define ") + features[k] + "\n";
+	return h + "#line 1\n";
+}
+
+inline GLuint shader_variants_t::get(uint key)
+{
+	auto it = programs.find(key);
+	if (it != programs.end()) return it->second;
+
+	std::string h = header(key);
+	GLuint program = cache.create(h + vert_source, h + frag_source);
+	if (!program) { printf("%s(): failed to build variant 0x%x\n", __func__, key); return 0; }
+	return programs[key] = program;
+}
+
+inline bool shader_variants_t::reload()
+{
+	std::string vs = program_cache_t::read(vert_path.c_str()), fs = program_cache_t::read(frag_path.c_str());
+	if (vs.empty() || fs.empty()) return false;
+
+	std::map<uint, GLuint> rebuilt;
+	for (auto& [key, p] : programs)
+	{
+		std::string h = header(key);
+		GLuint program = cache.create(h + vs, h + fs);
+		if (!program)
+		{
+			printf("%s(): variant 0x%x failed; keeping the previous programs\n", __func__, key);
+			for (auto& [k, q] : rebuilt) glDeleteProgram(q);
+			return false;
+		}
+		rebuilt[key] = program;
+	}
+	destroy();
+	programs.swap(rebuilt);
+	vert_source.swap(vs); frag_source.swap(fs);
+	return true;
+}
+
+inline void shader_variants_t::destroy()
+{
+	for (auto& [key, p] : programs) glDeleteProgram(p);
+	programs.clear();
+}
+
+#endif // __SHADER_VARIANTS_H__
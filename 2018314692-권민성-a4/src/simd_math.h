@@ -0,0 +1,303 @@
+#pragma once
+#ifndef __SIMD_MATH_H__
+#define __SIMD_MATH_H__
+#include "cgmath.h"
+#include "affine.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define SIMD_MATH_SSE
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define SIMD_MATH_AVX_TARGET			// MSVC emits AVX intrinsics without /arch:AVX
+	#else
+		#define SIMD_MATH_AVX_TARGET __attribute__((target("avx")))
+	#endif
+#endif
+
+//*************************************
+// SSE/AVX versions of the mat4 operations of cgmath.h on the per-frame transform paths
+// - mat4 is 16 row-major floats; a row of a product is the rows of the right operand weighted by a row of the left,
+//   summed in the order of the scalar loops and without FMA, so the results match cgmath.h to the bit
+// - compose() is the affine3x4 product of affine.h, three rows of the same sums with the translation added last
+// - look_at() and perspective() keep the scalar formulas, with the cross products, dots and quotients done 4-wide
+// - AVX does two rows (or two vectors) per instruction; it is compiled for its functions only and picked at runtime
+//   when cpuid and the OS report it, so one binary runs everywhere
+// - simd_math() is the table of the best implementation; simd_math_bench() times every table against the scalar one
+struct simd_math_t
+{
+	const char*	name;			// "scalar", "SSE" or "AVX"
+	mat4	(*mul)(const mat4& a, const mat4& b);
+	vec4	(*transform)(const mat4& m, const vec4& v);
+	void	(*mul_batch)(const mat4& a, const mat4* b, mat4* out, size_t count);		// out[k] = a*b[k]
+	void	(*transform_batch)(const mat4& m, const vec4* v, vec4* out, size_t count);	// out[k] = m*v[k]
+	affine3x4	(*compose)(const affine3x4& a, const affine3x4& b);
+	mat4	(*look_at)(const vec3& eye, const vec3& at, const vec3& up);
+	mat4	(*perspective)(float fovy, float aspect, float dn, float df);
+};
+
+inline const simd_math_t& simd_math_scalar()
+{
+	static const simd_math_t t = { "scalar",
+		[](const mat4& a, const mat4& b) { return a * b; },
+		[](const mat4& m, const vec4& v) { return m * v; },
+		[](const mat4& a, const mat4* b, mat4* out, size_t count) { for (size_t k = 0; k < count; k++) out[k] = a * b[k]; },
+		[](const mat4& m, const vec4* v, vec4* out, size_t count) { for (size_t k = 0; k < count; k++) out[k] = m * v[k]; },
+		[](const affine3x4& a, const affine3x4& b) { return a * b; },
+		[](const vec3& eye, const vec3& at, const vec3& up) { return mat4::look_at(eye, at, up); },
+		[](float fovy, float aspect, float dn, float df) { return mat4::perspective(fovy, aspect, dn, df); } };
+	return t;
+}
+
+#ifdef SIMD_MATH_SSE
+inline void simd_sse_mul(const float* a, const float* b, float* r)
+{
+	__m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8), b3 = _mm_loadu_ps(b + 12);
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m128 s = _mm_mul_ps(_mm_set1_ps(a[i]), b0);
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i + 1]), b1));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i + 2]), b2));
+		_mm_storeu_ps(r + i, _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i + 3]), b3)));
+	}
+}
+
+inline void simd_sse_compose(const float* a, const float* b, float* r)
+{
+	__m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8);
+	for (int i = 0; i < 12; i += 4)
+	{
+		__m128 s = _mm_mul_ps(_mm_set1_ps(a[i]), b0);
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i + 1]), b1));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i + 2]), b2));
+		_mm_storeu_ps(r + i, _mm_add_ps(s, _mm_setr_ps(0, 0, 0, a[i + 3])));	// the implicit bottom row of b
+	}
+}
+
+// m*v as the columns of m weighted by v, so that each element sums in the order of the scalar row loop
+inline __m128 simd_sse_transform(const __m128 c[4], __m128 v)
+{
+	__m128 s = _mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+	s = _mm_add_ps(s, _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+	s = _mm_add_ps(s, _mm_mul_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+	return _mm_add_ps(s, _mm_mul_ps(c[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+}
+
+inline void simd_sse_columns(const float* m, __m128 c[4])
+{
+	c[0] = _mm_loadu_ps(m); c[1] = _mm_loadu_ps(m + 4); c[2] = _mm_loadu_ps(m + 8); c[3] = _mm_loadu_ps(m + 12);
+	_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+}
+
+// x*x+y*y+z*z of the scalar dot, left to right, in the low lane
+inline __m128 simd_sse_dot3(__m128 a, __m128 b)
+{
+	__m128 p = _mm_mul_ps(a, b);
+	return _mm_add_ss(_mm_add_ss(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+
+inline __m128 simd_sse_cross(__m128 a, __m128 b)
+{
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+}
+
+inline __m128 simd_sse_normalize(__m128 v)
+{
+	__m128 l = _mm_sqrt_ss(simd_sse_dot3(v, v));
+	return _mm_div_ps(v, _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)));
+}
+
+inline const simd_math_t& simd_math_sse()
+{
+	static const simd_math_t t = { "SSE",
+		[](const mat4& a, const mat4& b) { mat4 r; simd_sse_mul(a, b, r); return r; },
+		[](const mat4& m, const vec4& v) { __m128 c[4]; simd_sse_columns(m, c); vec4 r; _mm_storeu_ps(r, simd_sse_transform(c, _mm_loadu_ps(v))); return r; },
+		[](const mat4& a, const mat4* b, mat4* out, size_t count) { for (size_t k = 0; k < count; k++) simd_sse_mul(a, b[k], out[k]); },
+		[](const mat4& m, const vec4* v, vec4* out, size_t count)
+		{
+			__m128 c[4]; simd_sse_columns(m, c);
+			for (size_t k = 0; k < count; k++) _mm_storeu_ps(out[k], simd_sse_transform(c, _mm_loadu_ps(v[k])));
+		},
+		[](const affine3x4& a, const affine3x4& b) { affine3x4 r; simd_sse_compose(a, b, r); return r; },
+		[](const vec3& eye, const vec3& at, const vec3& up)
+		{
+			__m128 e = _mm_setr_ps(eye.x, eye.y, eye.z, 0), a = _mm_setr_ps(at.x, at.y, at.z, 0), u0 = _mm_setr_ps(up.x, up.y, up.z, 0);
+			__m128 n = simd_sse_normalize(_mm_sub_ps(e, a)), u = simd_sse_normalize(simd_sse_cross(u0, n)), v = simd_sse_cross(n, u);
+			__m128 t = _mm_setr_ps(_mm_cvtss_f32(simd_sse_dot3(u, e)), _mm_cvtss_f32(simd_sse_dot3(v, e)), _mm_cvtss_f32(simd_sse_dot3(n, e)), 0);
+			t = _mm_sub_ps(_mm_setzero_ps(), t);	// -dot(); exact, as the scalar negation
+			float r[12], w[4]; _mm_storeu_ps(r, u); _mm_storeu_ps(r + 4, v); _mm_storeu_ps(r + 8, n); _mm_storeu_ps(w, t);
+			return mat4(r[0], r[1], r[2], w[0], r[4], r[5], r[6], w[1], r[8], r[9], r[10], w[2], 0, 0, 0, 1);
+		},
+		[](float fovy, float aspect, float dn, float df)
+		{
+			// 1/tan and the two depth terms in one division; fovy in radians
+			float q[4]; _mm_storeu_ps(q, _mm_div_ps(_mm_setr_ps(1.0f, -(df + dn), -2 * df * dn, 0), _mm_setr_ps(tanf(fovy * 0.5f), df - dn, df - dn, 1)));
+			return mat4(q[0] / aspect, 0, 0, 0, 0, q[0], 0, 0, 0, 0, q[1], q[2], 0, 0, -1, 0);
+		} };
+	return t;
+}
+
+// the left operand as pairs of rows: r[p*4+k] holds a[2p][k] in the low half and a[2p+1][k] in the high half
+SIMD_MATH_AVX_TARGET inline void simd_avx_rows(const float* a, __m256 r[8])
+{
+	for (int p = 0; p < 2; p++) for (int k = 0; k < 4; k++)
+	{
+		float x = a[p * 8 + k], y = a[p * 8 + 4 + k];
+		r[p * 4 + k] = _mm256_setr_ps(x, x, x, x, y, y, y, y);
+	}
+}
+
+SIMD_MATH_AVX_TARGET inline void simd_avx_mul(const __m256 a[8], const float* b, float* r)
+{
+	__m256 b0 = _mm256_broadcast_ps((const __m128*) b), b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+	__m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8)), b3 = _mm256_broadcast_ps((const __m128*)(b + 12));
+	for (int p = 0; p < 2; p++)
+	{
+		__m256 s = _mm256_mul_ps(a[p * 4], b0);
+		s = _mm256_add_ps(s, _mm256_mul_ps(a[p * 4 + 1], b1));
+		s = _mm256_add_ps(s, _mm256_mul_ps(a[p * 4 + 2], b2));
+		_mm256_storeu_ps(r + p * 8, _mm256_add_ps(s, _mm256_mul_ps(a[p * 4 + 3], b3)));
+	}
+}
+
+SIMD_MATH_AVX_TARGET inline mat4 simd_avx_mul_one(const mat4& a, const mat4& b)
+{
+	__m256 rows[8]; simd_avx_rows(a, rows);
+	mat4 r; simd_avx_mul(rows, b, r);
+	_mm256_zeroupper();	// the callers are SSE code; not every -O level emits it on return
+	return r;
+}
+
+SIMD_MATH_AVX_TARGET inline void simd_avx_mul_batch(const mat4& a, const mat4* b, mat4* out, size_t count)
+{
+	__m256 rows[8]; simd_avx_rows(a, rows);
+	for (size_t k = 0; k < count; k++) simd_avx_mul(rows, b[k], out[k]);
+	_mm256_zeroupper();
+}
+
+// two vectors per iteration, each half as simd_sse_transform()
+SIMD_MATH_AVX_TARGET inline void simd_avx_transform_batch(const mat4& m, const vec4* v, vec4* out, size_t count)
+{
+	__m128 c[4]; simd_sse_columns(m, c);
+	__m256 c0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c[0]), c[0], 1), c1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c[1]), c[1], 1);
+	__m256 c2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c[2]), c[2], 1), c3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c[3]), c[3], 1);
+	size_t k = 0;
+	for (; k + 2 <= count; k += 2)
+	{
+		__m256 x = _mm256_loadu_ps(v[k]);	// vec4 is 4 packed floats
+		__m256 s = _mm256_mul_ps(c0, _mm256_permute_ps(x, _MM_SHUFFLE(0, 0, 0, 0)));
+		s = _mm256_add_ps(s, _mm256_mul_ps(c1, _mm256_permute_ps(x, _MM_SHUFFLE(1, 1, 1, 1))));
+		s = _mm256_add_ps(s, _mm256_mul_ps(c2, _mm256_permute_ps(x, _MM_SHUFFLE(2, 2, 2, 2))));
+		_mm256_storeu_ps(out[k], _mm256_add_ps(s, _mm256_mul_ps(c3, _mm256_permute_ps(x, _MM_SHUFFLE(3, 3, 3, 3)))));
+	}
+	_mm256_zeroupper();
+	if (k < count) _mm_storeu_ps(out[k], simd_sse_transform(c, _mm_loadu_ps(v[k])));
+}
+
+inline const simd_math_t& simd_math_avx()
+{
+	const simd_math_t& sse = simd_math_sse();	// single vectors and the camera matrices gain nothing from 8 lanes
+	static const simd_math_t t = { "AVX", simd_avx_mul_one, sse.transform, simd_avx_mul_batch, simd_avx_transform_batch, sse.compose, sse.look_at, sse.perspective };
+	return t;
+}
+#endif
+
+// AVX needs the CPU flag and the OS saving the ymm registers (OSXSAVE, XCR0)
+inline bool simd_cpu_has_avx()
+{
+#if !defined(SIMD_MATH_SSE)
+	return false;
+#elif defined(_MSC_VER)
+	int r[4]; __cpuid(r, 1);
+	return (r[2] & (1 << 27)) && (r[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+#else
+	return __builtin_cpu_supports("avx");	// libgcc checks XCR0 as well
+#endif
+}
+
+// the implementation used by the transform paths; chosen once
+inline const simd_math_t& simd_math()
+{
+#ifdef SIMD_MATH_SSE
+	static const simd_math_t& t = simd_cpu_has_avx() ? simd_math_avx() : simd_math_sse();
+#else
+	static const simd_math_t& t = simd_math_scalar();
+#endif
+	return t;
+}
+
+//*************************************
+// --math-bench: each table against the scalar one on random operands; false when a result is more than 1 ulp off
+inline int64_t simd_ulp(float a, float b)
+{
+	int32_t x, y; memcpy(&x, &a, 4); memcpy(&y, &b, 4);
+	int64_t ox = x < 0 ? int64_t(INT32_MIN) - x : x, oy = y < 0 ? int64_t(INT32_MIN) - y : y;	// monotonic; +0 and -0 meet
+	return ox > oy ? ox - oy : oy - ox;
+}
+
+inline bool simd_math_bench(size_t count = 4096, int repeats = 200)
+{
+	std::vector<mat4> a(count), b(count), m_ref(count), m_out(count);
+	std::vector<vec4> v(count), v_ref(count), v_out(count);
+	std::vector<affine3x4> f(count), f_ref(count), f_out(count);
+	std::vector<vec3> eyes(count), ats(count);
+	std::vector<vec4> frusta(count);	// fovy, aspect, near, far
+	uint seed = 1;
+	auto rnd = [&]() { seed = seed * 1664525u + 1013904223u; return float(seed >> 8) / float(1 << 24); };	// [0,1)
+	for (size_t k = 0; k < count; k++)
+	{
+		for (int i = 0; i < 16; i++) { a[k][i] = rnd() * 2.0f - 1.0f; b[k][i] = rnd() * 2.0f - 1.0f; }
+		f[k] = affine3x4(b[k]);
+		v[k] = vec4(rnd() * 2.0f - 1.0f, rnd() * 2.0f - 1.0f, rnd() * 2.0f - 1.0f, 1.0f);
+		eyes[k] = vec3(rnd() * 20.0f - 10.0f, rnd() * 20.0f - 10.0f, rnd() * 20.0f - 10.0f);
+		ats[k] = vec3(rnd() * 2.0f - 1.0f, rnd() * 2.0f - 1.0f, rnd() * 2.0f - 1.0f);
+		frusta[k] = vec4(0.2f + rnd() * 2.0f, 0.5f + rnd() * 2.0f, 0.001f + rnd(), 10.0f + rnd() * 1000.0f);
+	}
+
+	std::vector<const simd_math_t*> tables = { &simd_math_scalar() };
+#ifdef SIMD_MATH_SSE
+	tables.push_back(&simd_math_sse());
+	if (simd_cpu_has_avx()) tables.push_back(&simd_math_avx());
+#endif
+	printf("> math bench: %u operands x %d repeats; simd_math() is %s\n", uint(count), repeats, simd_math().name);
+
+	bool b_ok = true;
+	enum { MAT4, VEC4, AFFINE };
+	auto bench = [&](const char* name, int result, const std::function<void(const simd_math_t&)>& run)
+	{
+		char line[256]; int n = snprintf(line, sizeof(line), "[simd math] %-20s", name);
+		double scalar_ns = 0.0;
+		for (const simd_math_t* t : tables)
+		{
+			auto t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < repeats; r++) run(*t);
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / (double(repeats) * count);
+			int64_t ulp = 0;
+			if (t == tables[0]) { scalar_ns = ns; m_ref = m_out; v_ref = v_out; f_ref = f_out; }
+			else if (result == VEC4) { for (size_t k = 0; k < count; k++) for (int i = 0; i < 4; i++) ulp = std::max(ulp, simd_ulp(((const float*) v_out[k])[i], ((const float*) v_ref[k])[i])); }
+			else if (result == AFFINE) { for (size_t k = 0; k < count; k++) for (int i = 0; i < 12; i++) ulp = std::max(ulp, simd_ulp(f_out[k][i], f_ref[k][i])); }
+			else { for (size_t k = 0; k < count; k++) for (int i = 0; i < 16; i++) ulp = std::max(ulp, simd_ulp(m_out[k][i], m_ref[k][i])); }
+			if (t == tables[0]) n += snprintf(line + n, sizeof(line) - n, " %s %.2f ns", t->name, ns);
+			else n += snprintf(line + n, sizeof(line) - n, ", %s %.2f ns (%.2fx, %d ulp)", t->name, ns, scalar_ns / ns, int(ulp));
+			b_ok = b_ok && ulp <= 1;
+		}
+		printf("%s\n", line);
+	};
+	bench("mat4*mat4", MAT4, [&](const simd_math_t& t) { for (size_t k = 0; k < count; k++) m_out[k] = t.mul(a[k], b[k]); });
+	bench("mat4*vec4", VEC4, [&](const simd_math_t& t) { for (size_t k = 0; k < count; k++) v_out[k] = t.transform(a[k], v[k]); });
+	bench("batched mat4*mat4", MAT4, [&](const simd_math_t& t) { t.mul_batch(a[0], b.data(), m_out.data(), count); });
+	bench("batched mat4*vec4", VEC4, [&](const simd_math_t& t) { t.transform_batch(a[0], v.data(), v_out.data(), count); });
+	bench("affine3x4*affine3x4", AFFINE, [&](const simd_math_t& t) { for (size_t k = 0; k < count; k++) f_out[k] = t.compose(f[k], f[(k + 1) % count]); });
+	bench("look_at", MAT4, [&](const simd_math_t& t) { for (size_t k = 0; k < count; k++) m_out[k] = t.look_at(eyes[k], ats[k], vec3(0, 0, 1)); });
+	bench("perspective", MAT4, [&](const simd_math_t& t) { for (size_t k = 0; k < count; k++) m_out[k] = t.perspective(frusta[k].x, frusta[k].y, frusta[k].z, frusta[k].w); });
+	if (!b_ok) printf("%s(): results differ from cgmath.h by more than 1 ulp\n", __func__);
+	return b_ok;
+}
+
+#endif // __SIMD_MATH_H__
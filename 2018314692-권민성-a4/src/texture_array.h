@@ -0,0 +1,79 @@
+#pragma once
+#ifndef __TEXTURE_ARRAY_H__
+#define __TEXTURE_ARRAY_H__
+#include "cgmath.h"
+#include "cgut.h"
+
+//*************************************
+// 2D texture array whose layers are resampled from 2D textures of any size
+// - a layer is filled by a linear blit from its source, so one draw can sample several images by layer index
+// - the blit copies stored texels: a single-channel source fills only red (no swizzle as in sampling)
+struct texture_array_t
+{
+	GLuint	texture = 0;
+	GLuint	read_fbo = 0, draw_fbo = 0;
+	ivec2	size = ivec2(0, 0);
+	uint	layers = 0;
+
+	bool	create(const std::vector<GLuint>& sources, ivec2 layer_size, GLenum internal_format);
+	void	update(uint layer, GLuint source, bool b_mipmap = true);
+	void	destroy();
+};
+
+inline bool texture_array_t::create(const std::vector<GLuint>& sources, ivec2 layer_size, GLenum internal_format)
+{
+	size = layer_size;
+	layers = uint(sources.size());
+	int mip_levels = 0; for (int k = std::max(size.x, size.y); k; k >>= 1) mip_levels++;
+	GLenum format = internal_format == GL_R8 ? GL_RED : GL_RGBA;
+	glGenTextures(1, &texture); if (!texture) { printf("%s(): failed in glGenTextures()\n", __func__); return false; }
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	for (int l = 0; l < mip_levels; l++)
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, l, internal_format, std::max(size.x >> l, 1), std::max(size.y >> l, 1), std::max(layers, 1u), 0, format, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	glGenFramebuffers(1, &read_fbo);
+	glGenFramebuffers(1, &draw_fbo);
+	for (uint k = 0; k < layers; k++) update(k, sources[k], false);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	return true;
+}
+
+inline void texture_array_t::update(uint layer, GLuint source, bool b_mipmap)
+{
+	if (layer >= layers) return;
+	GLint w = 1, h = 1;
+	glBindTexture(GL_TEXTURE_2D, source);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+
+	GLint read_binding = 0, draw_binding = 0;	// e.g., the offscreen framebuffer in --headless
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_binding);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_binding);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, GLint(layer));
+	glBlitFramebuffer(0, 0, w, h, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_binding);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_binding);
+
+	if (!b_mipmap) return;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+inline void texture_array_t::destroy()
+{
+	if (texture) glDeleteTextures(1, &texture);
+	GLuint fbos[] = { read_fbo, draw_fbo };
+	glDeleteFramebuffers(2, fbos);
+	texture = read_fbo = draw_fbo = 0;
+	layers = 0;
+}
+
+#endif // __TEXTURE_ARRAY_H__